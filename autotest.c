@@ -6,10 +6,14 @@
 //
 
 #include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 #include "model.h"
 #include "floorplan.h"
 #include "control.h"
+#include "bit.h"
+#include "parts.h"
 
 time_t g_start_time;
 #define TIME()		(time(0)-g_start_time)
@@ -1732,6 +1736,763 @@ static int test_bscan_config(struct test_state* tstate)
 	return 0;
 }
 
+struct wire_user
+{
+	net_idx_t net;
+	int y, x;
+	str16_t str;
+};
+
+// Fails if a wire driven by a switch of one net is also driven
+// by a switch of another net.
+static int check_wires_shared(struct fpga_model* model,
+	const net_idx_t* nets, int num_nets)
+{
+	struct fpga_net* net_p;
+	struct wire_user* users;
+	int num_users, users_size, i, j, k, y, x, dests_o, num_dests, rc;
+	str16_t to_i;
+	void* new_ptr;
+
+	users = 0;
+	num_users = 0;
+	users_size = 0;
+	for (i = 0; i < num_nets; i++) {
+		net_p = fnet_get(model, nets[i]);
+		if (!net_p) FAIL(EINVAL);
+		for (j = 0; j < net_p->len; j++) {
+			if (net_p->el[j].idx & NET_IDX_IS_PINW)
+				continue;
+			y = net_p->el[j].y;
+			x = net_p->el[j].x;
+			to_i = fpga_switch_str_i(model, y, x,
+				net_p->el[j].idx, SW_TO);
+			if (fpga_connpt_find(model, y, x, to_i,
+				&dests_o, &num_dests) == NO_CONN)
+				FAIL(EINVAL);
+			if (num_users + 1 + num_dests > users_size) {
+				users_size = num_users + 1 + num_dests + 256;
+				new_ptr = realloc(users,
+					users_size*sizeof(*users));
+				if (!new_ptr) FAIL(ENOMEM);
+				users = new_ptr;
+			}
+			users[num_users].net = nets[i];
+			users[num_users].y = y;
+			users[num_users].x = x;
+			users[num_users++].str = to_i;
+			for (k = 0; k < num_dests; k++) {
+				users[num_users].net = nets[i];
+				fpga_conn_dest(model, y, x, dests_o+k,
+					&users[num_users].y,
+					&users[num_users].x,
+					&users[num_users].str);
+				num_users++;
+			}
+		}
+	}
+	for (i = 0; i < num_users; i++) {
+		for (j = i+1; j < num_users; j++) {
+			if (users[i].net == users[j].net
+			    || users[i].y != users[j].y
+			    || users[i].x != users[j].x
+			    || users[i].str != users[j].str)
+				continue;
+			printf("#E nets %i and %i share y%i x%i %s\n",
+				users[i].net, users[j].net, users[i].y,
+				users[i].x, strarray_lookup(&model->str,
+					users[i].str));
+			FAIL(EINVAL);
+		}
+	}
+	free(users);
+	return 0;
+fail:
+	free(users);
+	return rc;
+}
+
+#define AUTOROUTE_NETS	8
+
+// goal: route nets that compete for the same wires without sharing any
+static int test_autoroute(struct test_state* tstate)
+{
+	struct froute route;
+	struct fpga_net* net_p;
+	net_idx_t nets[AUTOROUTE_NETS];
+	int src_y, src_x, dest_y, dest_x, i, j, rc;
+
+	// All outputs of one logic device go to the inputs of a logic
+	// device 8 rows up. Routed on their own, the nets take the same
+	// few wires out of the source tile.
+	src_y = 68;
+	src_x = 13;
+	dest_y = 60;
+	dest_x = 13;
+	for (i = 0; i < AUTOROUTE_NETS; i++) {
+		rc = fnet_new(tstate->model, &nets[i]);
+		if (rc) FAIL(rc);
+		rc = fnet_add_port(tstate->model, nets[i], src_y, src_x,
+			DEV_LOGIC, DEV_LOG_X, LO_A + i);
+		if (rc) FAIL(rc);
+		rc = fnet_add_port(tstate->model, nets[i], dest_y, dest_x,
+			DEV_LOGIC, DEV_LOG_X, LI_A1 + 6*(i%4) + i/4);
+		if (rc) FAIL(rc);
+	}
+
+	// without negotiation (one iteration) wires are overused
+	printf("O Routing %i nets in one iteration, expect overused "
+		"wires.\n", AUTOROUTE_NETS);
+	memset(&route, 0, sizeof(route));
+	route.model = tstate->model;
+	route.nets = nets;
+	route.num_nets = AUTOROUTE_NETS;
+	route.max_iter = 1;
+	rc = froute_nets(&route);
+	if (rc != ENOTSUP || route.num_iter != 1
+	    || !route.stats[0].overused)
+		FAIL(EINVAL);
+	printf("O %i wires overused.\n", route.stats[0].overused);
+
+	// froute_nets() failed before adding switches, so all nets
+	// are still pending for fnet_autoroute()
+	rc = fnet_autoroute(tstate->model, NO_NET);
+	if (rc) FAIL(rc);
+	for (i = 0; i < AUTOROUTE_NETS; i++) {
+		net_p = fnet_get(tstate->model, nets[i]);
+		if (!net_p) FAIL(EINVAL);
+		for (j = 0; j < net_p->len; j++) {
+			if (!(net_p->el[j].idx & NET_IDX_IS_PINW))
+				break;
+		}
+		if (j >= net_p->len) FAIL(EINVAL);
+	}
+	rc = check_wires_shared(tstate->model, nets, AUTOROUTE_NETS);
+	if (rc) FAIL(rc);
+	printf("O %i nets routed, no wire shared.\n", AUTOROUTE_NETS);
+	if ((rc = diff_printf(tstate))) FAIL(rc);
+	return 0;
+fail:
+	return rc;
+}
+
+// Bit-serial CRC-32C over one 22-bit configuration word: the 16 data
+// bits, then the 6 register address bits, LSB first. This is the same
+// CRC model as crc_add() in bit_regs.c, so it only checks the tables
+// and the packet walk there. Whether the model matches the device can
+// only be shown with a vendor bitstream.
+static uint32_t crc22(uint32_t crc, int reg, uint16_t word)
+{
+	uint32_t val;
+	int i;
+
+	val = (uint32_t) reg << 16 | word;
+	for (i = 0; i < 22; i++) {
+		if ((crc ^ (val >> i)) & 1)
+			crc = (crc >> 1) ^ 0x82F63B78;
+		else
+			crc >>= 1;
+	}
+	return crc;
+}
+
+// Recomputes the CRC over the packets of the bitstream in d and
+// compares it with every CRC register write and auto-crc. Returns
+// the number of mismatches, or -1 if there is no sync word.
+static int crc_mismatches(const uint8_t* d, int len, int* num_checked,
+	int* bypass)
+{
+	uint32_t crc, u32;
+	int pos, u16, type, opcode, reg, num_words, i, mismatches;
+
+	*num_checked = 0;
+	*bypass = 0;
+	for (pos = 0; pos+4 <= len; pos++) {
+		if (d[pos] == 0xAA && d[pos+1] == 0x99
+		    && d[pos+2] == 0x55 && d[pos+3] == 0x66)
+			break;
+	}
+	if (pos+4 > len) return -1;
+	pos += 4;
+
+	crc = 0;
+	mismatches = 0;
+	while (pos+2 <= len) {
+		u16 = d[pos] << 8 | d[pos+1];
+		pos += 2;
+		type = u16 >> 13;
+		opcode = (u16 >> 11) & 3;
+		reg = (u16 >> 5) & 0x3F;
+		num_words = u16 & 0x1F;
+		if (!opcode) // noop
+			continue;
+		if (type == 2) {
+			if (pos+4 > len) break;
+			num_words = d[pos] << 24 | d[pos+1] << 16
+				| d[pos+2] << 8 | d[pos+3];
+			pos += 4;
+		} else if (type != 1)
+			break;
+		if (num_words < 0 || num_words > (len-pos)/2) break;
+		if (opcode != 2) { // not a write
+			pos += num_words*2;
+			continue;
+		}
+		if (reg != CRC) {
+			for (i = 0; i < num_words; i++) {
+				u16 = d[pos+i*2] << 8 | d[pos+i*2+1];
+				crc = crc22(crc, reg, u16);
+				if (num_words != 1)
+					continue;
+				if (reg == COR1)
+					*bypass = (u16 & COR1_CRC_BYPASS) != 0;
+				if (reg == CMD && u16 == CMD_RCRC)
+					crc = 0;
+			}
+			pos += num_words*2;
+			if (type != 2 || reg != FDRI)
+				continue;
+			// auto-crc follows the FDRI data
+		} else if (num_words != 2)
+			break;
+		if (pos+4 > len) break;
+		u32 = d[pos] << 24 | d[pos+1] << 16 | d[pos+2] << 8 | d[pos+3];
+		pos += 4;
+		(*num_checked)++;
+		if (u32 != crc)
+			mismatches++;
+	}
+	return mismatches;
+}
+
+// read_bitfile() from the bitstream in d, through a stream that
+// cannot be mapped.
+static int read_config_mem(struct fpga_config* cfg, uint8_t* d, int len)
+{
+	FILE* f;
+	int rc;
+
+	f = fmemopen(d, len, "r");
+	if (!f) return errno;
+	rc = read_bitfile(cfg, f);
+	fclose(f);
+	return rc;
+}
+
+// Number of CRC errors that read_bitfile() finds in d, or -1.
+static int read_crc_errors(uint8_t* d, int len)
+{
+	struct fpga_config cfg;
+	int rc;
+
+	if (read_config_mem(&cfg, d, len))
+		return -1;
+	rc = cfg.crc_errors;
+	free_config(&cfg);
+	return rc;
+}
+
+// goal: the CRC of written bitstreams matches a bit-serial version
+// of the same model and a flipped bit is caught on read. COR1 keeps
+// CRC_BYPASS because the model has not been checked against the
+// device. A bitstream written by the vendor tools can be passed in
+// FPGATOOLS_VENDOR_BIT to do that check.
+static int test_crc(struct test_state* tstate)
+{
+	struct bit_sink sink;
+	const char* vendor_path;
+	uint8_t* vendor_d;
+	FILE* f;
+	int vendor_len, mapped, num_checked, bypass, flip_o, rc;
+
+	sink_init_mem(&sink);
+	vendor_d = 0;
+	vendor_len = 0;
+	mapped = 0;
+	f = 0;
+
+	rc = fdev_logic_a2d_lut(tstate->model, 68, 13, DEV_LOG_X, LUT_D,
+		6, "A3*A5", ZTERM);
+	if (rc) FAIL(rc);
+	rc = write_bitstream(&sink, tstate->model);
+	if (rc) FAIL(rc);
+	rc = crc_mismatches(sink.buf, sink.len, &num_checked, &bypass);
+	if (rc) {
+		printf("#E %i of %i CRC values do not match.\n",
+			rc, num_checked);
+		FAIL(EINVAL);
+	}
+	if (num_checked < 2 || !bypass) FAIL(EINVAL);
+	printf("O %i CRC values match, CRC_BYPASS set.\n", num_checked);
+	if (read_crc_errors(sink.buf, sink.len)) FAIL(EINVAL);
+	printf("O Read back without CRC errors.\n");
+
+	// one bit in the middle of the FDRI data
+	flip_o = sink.len/2;
+	sink.buf[flip_o] ^= 0x01;
+	rc = crc_mismatches(sink.buf, sink.len, &num_checked, &bypass);
+	if (rc <= 0) FAIL(EINVAL);
+	if (read_crc_errors(sink.buf, sink.len) <= 0) FAIL(EINVAL);
+	printf("O Flipped bit at 0x%x caught.\n", flip_o);
+
+	vendor_path = getenv("FPGATOOLS_VENDOR_BIT");
+	if (!vendor_path || !*vendor_path) {
+		printf("O #NODIFF FPGATOOLS_VENDOR_BIT not set, "
+			"vendor CRC not checked.\n");
+		free(sink.buf);
+		return 0;
+	}
+	f = fopen(vendor_path, "r");
+	if (!f) {
+		printf("#E error opening %s\n", vendor_path);
+		FAIL(errno);
+	}
+	rc = map_file(f, &vendor_d, &vendor_len, &mapped);
+	if (rc) FAIL(rc);
+	rc = crc_mismatches(vendor_d, vendor_len, &num_checked, &bypass);
+	if (rc || !num_checked || bypass) {
+		printf("#E %s: %i of %i CRC values do not match%s.\n",
+			vendor_path, rc, num_checked,
+			bypass ? ", CRC_BYPASS set" : "");
+		FAIL(EINVAL);
+	}
+	if (read_crc_errors(vendor_d, vendor_len)) FAIL(EINVAL);
+	printf("O #NODIFF %s: %i CRC values match.\n", vendor_path,
+		num_checked);
+	unmap_file(vendor_d, vendor_len, mapped);
+	fclose(f);
+	free(sink.buf);
+	return 0;
+fail:
+	if (vendor_d) unmap_file(vendor_d, vendor_len, mapped);
+	if (f) fclose(f);
+	free(sink.buf);
+	return rc;
+}
+
+static int is_zero(const uint8_t* d, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if (d[i])
+			return 0;
+	}
+	return 1;
+}
+
+// goal: a partial bitstream against a base holds exactly the frames
+// that changed, and frames with the same content are written once
+// and copied with MFWR.
+static int test_partial_bits(struct test_state* tstate)
+{
+	struct fpga_model* model = tstate->model;
+	struct fpga_config base_cfg, part_cfg;
+	struct fpga_bits new_bits;
+	struct bit_sink sink;
+	const struct xc_info* xci;
+	const uint8_t* new_d, *base_d, *part_d;
+	int num_frames, num_changed, num_mfwr, full_len, y, x, x2, i, rc;
+
+	sink_init_mem(&sink);
+	base_cfg.bits.d = 0;
+	part_cfg.bits.d = 0;
+	new_bits.d = 0;
+	xci = xc_info(model->idcode);
+	if (!xci) FAIL(EINVAL);
+	num_frames = XC_NUM_FRAMES(xci);
+
+	// the base is the bitstream of the empty model, as read back
+	rc = write_bitstream(&sink, model);
+	if (rc) FAIL(rc);
+	full_len = sink.len;
+	rc = read_config_mem(&base_cfg, sink.buf, sink.len);
+	if (rc) FAIL(rc);
+	free(sink.buf);
+	sink_init_mem(&sink);
+
+	// The same LUT in the same row of two logic columns of the same
+	// kind changes two frames in the same way.
+	y = 68;
+	x = 13;
+	for (x2 = x+1; x2 < model->x_width; x2++) {
+		if (is_atx(X_FABRIC_LOGIC_XM_COL, model, x2)
+		    == is_atx(X_FABRIC_LOGIC_XM_COL, model, x)
+		    && has_device_type(model, y, x2, DEV_LOGIC, LOGIC_X))
+			break;
+	}
+	if (x2 >= model->x_width) FAIL(EINVAL);
+	rc = fdev_logic_a2d_lut(model, y, x, DEV_LOG_X, LUT_D, 6,
+		"A3*A5", ZTERM);
+	if (rc) FAIL(rc);
+	rc = fdev_logic_a2d_lut(model, y, x2, DEV_LOG_X, LUT_D, 6,
+		"A3*A5", ZTERM);
+	if (rc) FAIL(rc);
+
+	new_bits.idcode = model->idcode;
+	new_bits.len = XC_BITS_LEN(xci);
+	new_bits.d = calloc(new_bits.len, 1 /* elsize */);
+	if (!new_bits.d) FAIL(ENOMEM);
+	rc = write_model(&new_bits, model);
+	if (rc) FAIL(rc);
+	rc = write_partial_bitstream(&sink, model, &base_cfg.bits);
+	if (rc) FAIL(rc);
+	if (sink.len >= full_len/10) FAIL(EINVAL);
+	printf("O Partial bitstream %i bytes, full %i bytes.\n",
+		sink.len, full_len);
+	rc = read_config_mem(&part_cfg, sink.buf, sink.len);
+	if (rc) FAIL(rc);
+	if (part_cfg.crc_errors) FAIL(EINVAL);
+
+	// Changed frames must read back as in the new model, all others
+	// are not written and read back as 0.
+	num_changed = 0;
+	for (i = 0; i < num_frames; i++) {
+		new_d = &new_bits.d[i*FRAME_SIZE];
+		base_d = &base_cfg.bits.d[i*FRAME_SIZE];
+		part_d = &part_cfg.bits.d[i*FRAME_SIZE];
+		if (memcmp(new_d, base_d, FRAME_SIZE)) {
+			num_changed++;
+			if (memcmp(part_d, new_d, FRAME_SIZE)) {
+				printf("#E frame %i differs.\n", i);
+				FAIL(EINVAL);
+			}
+		} else if (!is_zero(part_d, FRAME_SIZE)) {
+			printf("#E unchanged frame %i written.\n", i);
+			FAIL(EINVAL);
+		}
+	}
+	if (!num_changed) FAIL(EINVAL);
+	i = XC_BRAM_DATA_START(xci);
+	if (!is_zero(&part_cfg.bits.d[i], new_bits.len - i))
+		FAIL(EINVAL);
+	num_mfwr = 0;
+	for (i = 0; i < part_cfg.num_regs; i++) {
+		if (part_cfg.reg[i].reg == MFWR)
+			num_mfwr++;
+	}
+	if (!num_mfwr) FAIL(EINVAL);
+	printf("O %i of %i frames changed, %i copied with MFWR.\n",
+		num_changed, num_frames, num_mfwr);
+
+	free_config(&part_cfg);
+	free_config(&base_cfg);
+	free(new_bits.d);
+	free(sink.buf);
+	if ((rc = diff_printf(tstate))) FAIL(rc);
+	return 0;
+fail:
+	free_config(&part_cfg);
+	free_config(&base_cfg);
+	free(new_bits.d);
+	free(sink.buf);
+	return rc;
+}
+
+// Reads all of f and compares it with the bitstream in the memory
+// sink.
+static int same_as_mem(const char* what, FILE* f, const struct bit_sink* mem)
+{
+	uint8_t* d;
+	int len, mapped, rc;
+
+	rc = map_file(f, &d, &len, &mapped);
+	if (rc) FAIL(rc);
+	if (len != mem->len || memcmp(d, mem->buf, len)) {
+		printf("#E %s sink wrote %i bytes that differ from "
+			"the memory sink.\n", what, len);
+		unmap_file(d, len, mapped);
+		FAIL(EINVAL);
+	}
+	unmap_file(d, len, mapped);
+	printf("O %s sink wrote the same %i bytes.\n", what, len);
+	return 0;
+fail:
+	return rc;
+}
+
+// goal: the memory, FILE and fd sinks write the same bitstream,
+// and the fd sink writes to a pipe without seeking.
+static int test_bit_sink(struct test_state* tstate)
+{
+	struct bit_sink mem_sink, sink;
+	FILE* f;
+	int fds[2], status, rc;
+	pid_t pid;
+
+	sink_init_mem(&mem_sink);
+	f = 0;
+	rc = fdev_logic_a2d_lut(tstate->model, 68, 13, DEV_LOG_X, LUT_D,
+		6, "A3*A5", ZTERM);
+	if (rc) FAIL(rc);
+	rc = write_bitstream(&mem_sink, tstate->model);
+	if (rc) FAIL(rc);
+	printf("O Memory sink wrote %i bytes.\n", mem_sink.len);
+
+	f = tmpfile();
+	if (!f) FAIL(errno);
+	sink_init_file(&sink, f);
+	rc = write_bitstream(&sink, tstate->model);
+	if (rc) FAIL(rc);
+	if (sink.len != mem_sink.len || fflush(f)) FAIL(EINVAL);
+	rewind(f);
+	rc = same_as_mem("FILE", f, &mem_sink);
+	if (rc) FAIL(rc);
+	fclose(f);
+	f = 0;
+
+	// a child writes into the pipe while we read
+	if (pipe(fds)) FAIL(errno);
+	pid = fork();
+	if (pid == -1) {
+		close(fds[0]);
+		close(fds[1]);
+		FAIL(errno);
+	}
+	if (!pid) {
+		close(fds[0]);
+		sink_init_fd(&sink, fds[1]);
+		rc = write_bitstream(&sink, tstate->model);
+		close(fds[1]);
+		_exit(rc || sink.len != mem_sink.len);
+	}
+	close(fds[1]);
+	f = fdopen(fds[0], "r");
+	if (!f) {
+		close(fds[0]);
+		waitpid(pid, &status, 0);
+		FAIL(errno);
+	}
+	rc = same_as_mem("fd (pipe)", f, &mem_sink);
+	fclose(f);
+	f = 0;
+	if (waitpid(pid, &status, 0) != pid
+	    || !WIFEXITED(status) || WEXITSTATUS(status)) {
+		printf("#E writing to the pipe failed.\n");
+		FAIL(EIO);
+	}
+	if (rc) FAIL(rc);
+
+	free(mem_sink.buf);
+	if ((rc = diff_printf(tstate))) FAIL(rc);
+	return 0;
+fail:
+	if (f) fclose(f);
+	free(mem_sink.buf);
+	return rc;
+}
+
+static int same_config(const struct fpga_config* a,
+	const struct fpga_config* b)
+{
+	return !memcmp(a->header_str, b->header_str, sizeof(a->header_str))
+		&& a->num_regs == b->num_regs
+		&& !memcmp(a->reg, b->reg, a->num_regs*sizeof(a->reg[0]))
+		&& a->num_regs_before_bits == b->num_regs_before_bits
+		&& a->bits.len == b->bits.len
+		&& !memcmp(a->bits.d, b->bits.d, a->bits.len)
+		&& a->auto_crc == b->auto_crc
+		&& a->crc_errors == b->crc_errors;
+}
+
+#define BIT_MAP_SKIP	16
+
+// goal: read_bitfile() parses a regular file from a mapping, and
+// gets the same config from a stream that cannot be mapped and from
+// a file that is not read from its start.
+static int test_bit_map(struct test_state* tstate)
+{
+	struct fpga_config map_cfg, cfg;
+	struct bit_sink sink;
+	char path[1024];
+	uint8_t* d;
+	FILE* f;
+	int len, mapped, rc;
+
+	sink_init_mem(&sink);
+	map_cfg.bits.d = 0;
+	cfg.bits.d = 0;
+	f = 0;
+	rc = fdev_logic_a2d_lut(tstate->model, 68, 13, DEV_LOG_X, LUT_D,
+		6, "A3*A5", ZTERM);
+	if (rc) FAIL(rc);
+	rc = write_bitstream(&sink, tstate->model);
+	if (rc) FAIL(rc);
+
+	snprintf(path, sizeof(path), "%s/autotest_%s.bit", tstate->tmp_dir,
+		tstate->base_name);
+
+	// the bitstream alone in a file is mapped
+	f = fopen(path, "w+");
+	if (!f) {
+		printf("#E error opening %s\n", path);
+		FAIL(errno);
+	}
+	if (fwrite(sink.buf, sink.len, 1, f) != 1 || fflush(f))
+		FAIL(EIO);
+	rewind(f);
+	rc = map_file(f, &d, &len, &mapped);
+	if (rc) FAIL(rc);
+	unmap_file(d, len, mapped);
+	if (!mapped || len != sink.len) FAIL(EINVAL);
+	rewind(f);
+	rc = read_bitfile(&map_cfg, f);
+	if (rc) FAIL(rc);
+	fclose(f);
+	f = 0;
+	if (map_cfg.crc_errors) FAIL(EINVAL);
+	printf("O Mapped file read, %i regs, %i bytes of bits.\n",
+		map_cfg.num_regs, map_cfg.bits.len);
+
+	// not mappable
+	rc = read_config_mem(&cfg, sink.buf, sink.len);
+	if (rc) FAIL(rc);
+	if (!same_config(&map_cfg, &cfg)) FAIL(EINVAL);
+	free_config(&cfg);
+	printf("O Same config from a stream.\n");
+
+	// BIT_MAP_SKIP bytes of junk before the bitstream, the file
+	// is read from where it is positioned and not mapped
+	f = fopen(path, "w+");
+	if (!f) FAIL(errno);
+	if (fwrite("0123456789abcdef", BIT_MAP_SKIP, 1, f) != 1
+	    || fwrite(sink.buf, sink.len, 1, f) != 1
+	    || fflush(f)
+	    || fseek(f, BIT_MAP_SKIP, SEEK_SET))
+		FAIL(EIO);
+	rc = map_file(f, &d, &len, &mapped);
+	if (rc) FAIL(rc);
+	unmap_file(d, len, mapped);
+	if (mapped || len != sink.len) FAIL(EINVAL);
+	if (fseek(f, BIT_MAP_SKIP, SEEK_SET)) FAIL(errno);
+	rc = read_bitfile(&cfg, f);
+	if (rc) FAIL(rc);
+	fclose(f);
+	f = 0;
+	if (!same_config(&map_cfg, &cfg)) FAIL(EINVAL);
+	printf("O Same config from offset %i of a file.\n", BIT_MAP_SKIP);
+	unlink(path);
+
+	free_config(&cfg);
+	free_config(&map_cfg);
+	free(sink.buf);
+	return 0;
+fail:
+	if (f) fclose(f);
+	free_config(&cfg);
+	free_config(&map_cfg);
+	free(sink.buf);
+	return rc;
+}
+
+// Writes the text (bin 0) or binary (bin 1) floorplan of model into
+// a malloc'ed buffer.
+static int write_fp_mem(struct fpga_model* model, int bin, char** d,
+	size_t* len)
+{
+	FILE* f;
+	int rc;
+
+	*d = 0;
+	f = open_memstream(d, len);
+	if (!f) FAIL(errno);
+	if (bin)
+		rc = write_floorplan_bin(f, model);
+	else
+		rc = write_floorplan(f, model, FP_NO_HEADER);
+	if (fclose(f) && !rc)
+		rc = EIO;
+	if (rc) FAIL(rc);
+	return 0;
+fail:
+	free(*d);
+	*d = 0;
+	return rc;
+}
+
+// goal: a binary floorplan read into a new model gives the same text
+// floorplan, and written again from there gives the same bytes.
+static int test_fpb(struct test_state* tstate)
+{
+	struct fpga_model* model = tstate->model;
+	struct fpga_model model2;
+	char* fpb, *fpb2, *fp, *fp2;
+	size_t fpb_len, fpb2_len, fp_len, fp2_len;
+	net_idx_t net;
+	int iob_y, iob_x, iob_i, model2_built, rc;
+
+	fpb = fpb2 = fp = fp2 = 0;
+	model2_built = 0;
+
+	// an input IOB routed to a LUT
+	rc = fpga_find_iob(model, "P45", &iob_y, &iob_x, &iob_i);
+	if (rc) FAIL(rc);
+	rc = fdev_iob_input(model, iob_y, iob_x, iob_i, IO_LVCMOS33);
+	if (rc) FAIL(rc);
+	rc = fdev_logic_a2d_lut(model, 68, 13, DEV_LOG_X, LUT_D, 6,
+		"A3*A5", ZTERM);
+	if (rc) FAIL(rc);
+	rc = fnet_new(model, &net);
+	if (rc) FAIL(rc);
+	rc = fnet_add_port(model, net, iob_y, iob_x, DEV_IOB, iob_i,
+		IOB_OUT_I);
+	if (rc) FAIL(rc);
+	rc = fnet_add_port(model, net, 68, 13, DEV_LOGIC, DEV_LOG_X, LI_D3);
+	if (rc) FAIL(rc);
+	rc = fnet_autoroute(model, net);
+	if (rc) FAIL(rc);
+
+	rc = write_fp_mem(model, /*bin*/ 1, &fpb, &fpb_len);
+	if (rc) FAIL(rc);
+	rc = write_fp_mem(model, /*bin*/ 0, &fp, &fp_len);
+	if (rc) FAIL(rc);
+	printf("O Binary floorplan %i bytes, text %i bytes.\n",
+		(int) fpb_len, (int) fp_len);
+
+	printf("O Building second memory model...\n");
+	rc = fpga_build_model(&model2, XC6SLX9_ROWS, XC6SLX9_COLUMNS,
+		XC6SLX9_LEFT_WIRING, XC6SLX9_RIGHT_WIRING);
+	if (rc) FAIL(rc);
+	model2_built = 1;
+	// a truncated file is rejected before the model is changed
+	printf("O Reading a truncated .fpb, expect an error.\n");
+	rc = parse_floorplan_bin(&model2, (uint8_t*) fpb, fpb_len-1);
+	if (rc != EINVAL) FAIL(EINVAL);
+	rc = parse_floorplan_bin(&model2, (uint8_t*) fpb, fpb_len);
+	if (rc) FAIL(rc);
+
+	rc = write_fp_mem(&model2, /*bin*/ 0, &fp2, &fp2_len);
+	if (rc) FAIL(rc);
+	if (fp2_len != fp_len || memcmp(fp2, fp, fp_len)) {
+		printf("#E text floorplans differ after reading .fpb\n");
+		FAIL(EINVAL);
+	}
+	printf("O Same text floorplan after reading .fpb.\n");
+	rc = write_fp_mem(&model2, /*bin*/ 1, &fpb2, &fpb2_len);
+	if (rc) FAIL(rc);
+	if (fpb2_len != fpb_len || memcmp(fpb2, fpb, fpb_len)) {
+		printf("#E .fpb written again differs\n");
+		FAIL(EINVAL);
+	}
+	printf("O Same .fpb written again.\n");
+
+	fpga_free_model(&model2);
+	free(fpb2);
+	free(fp2);
+	free(fp);
+	free(fpb);
+	if ((rc = diff_printf(tstate))) FAIL(rc);
+	return 0;
+fail:
+	if (model2_built)
+		fpga_free_model(&model2);
+	free(fpb2);
+	free(fp2);
+	free(fp);
+	free(fpb);
+	return rc;
+}
+
 #define DEFAULT_DIFF_EXEC "./autotest_diff.sh"
 
 static void printf_help(const char* argv_0, const char** available_tests)
@@ -1764,7 +2525,8 @@ int main(int argc, char** argv)
 	const char* available_tests[] =
 		{ "logic_cfg", "routing_sw", "io_sw", "iob_cfg",
 		  "lut_encoding", "bufg_cfg", "bufio_cfg", "pll_cfg",
-		  "dcm_cfg", "bscan_cfg", 0 };
+		  "dcm_cfg", "bscan_cfg", "autoroute", "crc", "partial_bits",
+		  "bit_sink", "bit_map", "fpb", 0 };
 
 	// flush after every line is better for the autotest
 	// output, tee, etc.
@@ -1913,6 +2675,30 @@ int main(int argc, char** argv)
 		rc = test_bscan_config(&tstate);
 		if (rc) FAIL(rc);
 	}
+	if (!strcmp(cmdline_test, "autoroute")) {
+		rc = test_autoroute(&tstate);
+		if (rc) FAIL(rc);
+	}
+	if (!strcmp(cmdline_test, "crc")) {
+		rc = test_crc(&tstate);
+		if (rc) FAIL(rc);
+	}
+	if (!strcmp(cmdline_test, "partial_bits")) {
+		rc = test_partial_bits(&tstate);
+		if (rc) FAIL(rc);
+	}
+	if (!strcmp(cmdline_test, "bit_sink")) {
+		rc = test_bit_sink(&tstate);
+		if (rc) FAIL(rc);
+	}
+	if (!strcmp(cmdline_test, "bit_map")) {
+		rc = test_bit_map(&tstate);
+		if (rc) FAIL(rc);
+	}
+	if (!strcmp(cmdline_test, "fpb")) {
+		rc = test_fpb(&tstate);
+		if (rc) FAIL(rc);
+	}
 
 	printf("\n");
 	printf("O Test completed.\n");
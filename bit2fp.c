@@ -5,6 +5,7 @@
 // For details see the UNLICENSE file at the root of the source tree.
 //
 
+#include <time.h>
 #include "model.h"
 #include "floorplan.h"
 #include "bit.h"
@@ -13,7 +14,8 @@ int main(int argc, char** argv)
 {
 	struct fpga_model model;
 	int bit_header, bit_regs, bit_crc, fp_header, pull_model, file_arg, flags;
-	int print_swbits, rc = -1;
+	int print_swbits, print_time, rc = -1;
+	struct timespec start, end;
 	struct fpga_config config;
 
 	// parameters
@@ -22,8 +24,10 @@ int main(int argc, char** argv)
 			"\n"
 			"%s - bitstream to floorplan\n"
 			"Usage: %s [--bit-header] [--bit-regs] [--bit-crc] [--no-model]\n"
-			"       %*s [--no-fp-header] [--printf-swbits] <bitstream_file>\n"
-			"\n", argv[0], argv[0], (int) strlen(argv[0]), "");
+			"       %*s [--no-fp-header] [--printf-swbits] [--time]\n"
+			"       %*s <bitstream_file|- for stdin>\n"
+			"\n", argv[0], argv[0], (int) strlen(argv[0]), "",
+			(int) strlen(argv[0]), "");
 		goto fail;
 	}
    	bit_header = 0;
@@ -33,6 +37,7 @@ int main(int argc, char** argv)
 	fp_header = 1;
 	file_arg = 1;
 	print_swbits = 0;
+	print_time = 0;
 	while (file_arg < argc
 	       && !strncmp(argv[file_arg], "--", 2)) {
 		if (!strcmp(argv[file_arg], "--bit-header"))
@@ -47,6 +52,8 @@ int main(int argc, char** argv)
 			fp_header = 0;
 		else if (!strcmp(argv[file_arg], "--printf-swbits"))
 			print_swbits = 1;
+		else if (!strcmp(argv[file_arg], "--time"))
+			print_time = 1;
 		else break;
 		file_arg++;
 	}
@@ -63,19 +70,32 @@ int main(int argc, char** argv)
 
 	// read binary configuration file
 	{
-		FILE* fbits = fopen(argv[file_arg], "r");
+		FILE* fbits;
+
+		if (!strcmp(argv[file_arg], "-"))
+			fbits = stdin;
+		else
+			fbits = fopen(argv[file_arg], "r");
 		if (!fbits) {
 			fprintf(stderr, "Error opening %s.\n", argv[file_arg]);
 			goto fail;
 		}
 		rc = read_bitfile(&config, fbits);
-		fclose(fbits);
+		if (fbits != stdin)
+			fclose(fbits);
 		if (rc) FAIL(rc);
 	}
 
 	// fill model from binary configuration
-	if (pull_model)
+	if (pull_model) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
 		if ((rc = extract_model(&model, &config.bits))) FAIL(rc);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		if (print_time)
+			fprintf(stderr, "extract_model %.3fs\n",
+				(end.tv_sec - start.tv_sec)
+				+ (end.tv_nsec - start.tv_nsec)/1e9);
+	}
 
 	// dump model
 	flags = FP_DEFAULT;
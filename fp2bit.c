@@ -12,15 +12,28 @@
 int main(int argc, char** argv)
 {
 	struct fpga_model model;
-	FILE* fp, *fbits;
+	struct fpga_config base_cfg;
+	FILE* fp, *fbits, *fbase;
+	const char* base_path;
 	int rc = -1;
 
 	fbits = 0;
+	base_path = 0;
+	base_cfg.bits.d = 0;
+	if (argc == 5 && !strcmp(argv[1], "--base")) {
+		base_path = argv[2];
+		argv += 2;
+		argc -= 2;
+	}
 	if (argc != 3) {
 		fprintf(stderr,
 			"\n"
 			"%s - floorplan to bitstream\n"
-			"Usage: %s <floorplan_file|- for stdin> <bits_file>\n"
+			"Usage: %s [--base <base_bits_file>] "
+			"<floorplan_file|- for stdin> <bits_file|- for stdout>\n"
+			"\n"
+			"  --base  write a partial bitstream with only the\n"
+			"          frames that differ from base_bits_file\n"
 			"\n", argv[0], argv[0]);
 		goto fail;
 	}
@@ -34,7 +47,20 @@ int main(int argc, char** argv)
 			goto fail;
 		}
 	}
-	fbits = fopen(argv[2], "w");
+	if (base_path) {
+		fbase = fopen(base_path, "r");
+		if (!fbase) {
+			fprintf(stderr, "Error opening %s.\n", base_path);
+			goto fail;
+		}
+		rc = read_bitfile(&base_cfg, fbase);
+		fclose(fbase);
+		if (rc) goto fail;
+	}
+	if (!strcmp(argv[2], "-"))
+		fbits = stdout;
+	else
+		fbits = fopen(argv[2], "w");
 	if (!fbits) {
 		fprintf(stderr, "Error opening %s.\n", argv[2]);
 		goto fail;
@@ -45,10 +71,16 @@ int main(int argc, char** argv)
 		goto fail;
 
 	if ((rc = read_floorplan(&model, fp))) goto fail;
-	if ((rc = write_bitfile(fbits, &model))) goto fail;
+	if (base_path)
+		rc = write_partial_bitfile(fbits, &model, &base_cfg.bits);
+	else
+		rc = write_bitfile(fbits, &model);
+	if (rc) goto fail;
 	fclose(fbits);
+	if (base_path) free_config(&base_cfg);
 	return EXIT_SUCCESS;
 fail:
 	if (fbits) fclose(fbits);
+	if (base_path) free_config(&base_cfg);
 	return rc;
 }
@@ -0,0 +1,71 @@
+//
+// Author: Wolfgang Spraul
+//
+// This is free and unencumbered software released into the public domain.
+// For details see the UNLICENSE file at the root of the source tree.
+//
+
+#include "model.h"
+#include "floorplan.h"
+
+int main(int argc, char** argv)
+{
+	struct fpga_model model;
+	FILE* fin, *fout;
+	int to_text, rc = -1;
+
+	to_text = 0;
+	if (argc == 4 && !strcmp(argv[1], "--text")) {
+		to_text = 1;
+		argv++;
+		argc--;
+	}
+	if (argc != 3) {
+		fprintf(stderr,
+			"\n"
+			"%s - text or binary floorplan to binary floorplan\n"
+			"Usage: %s [--text] <floorplan_file|- for stdin> "
+			"<output_file|- for stdout>\n"
+			"\n"
+			"  --text  write a text floorplan instead\n"
+			"\n", argv[0], argv[0]);
+		goto fail;
+	}
+
+	if (!strcmp(argv[1], "-"))
+		fin = stdin;
+	else {
+		fin = fopen(argv[1], "r");
+		if (!fin) {
+			fprintf(stderr, "Error opening %s.\n", argv[1]);
+			goto fail;
+		}
+	}
+	if (!strcmp(argv[2], "-"))
+		fout = stdout;
+	else
+		fout = fopen(argv[2], "w");
+	if (!fout) {
+		fprintf(stderr, "Error opening %s.\n", argv[2]);
+		goto fail;
+	}
+
+	if ((rc = fpga_build_model(&model, XC6SLX9_ROWS, XC6SLX9_COLUMNS,
+			XC6SLX9_LEFT_WIRING, XC6SLX9_RIGHT_WIRING)))
+		goto fail;
+
+	if ((rc = read_floorplan(&model, fin))) goto fail;
+	if (to_text)
+		rc = write_floorplan(fout, &model, FP_DEFAULT);
+	else
+		rc = write_floorplan_bin(fout, &model);
+	if (rc) goto fail;
+	if (fout != stdout && fclose(fout)) {
+		rc = EIO;
+		goto fail;
+	}
+	fpga_free_model(&model);
+	return EXIT_SUCCESS;
+fail:
+	return rc;
+}
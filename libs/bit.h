@@ -5,6 +5,8 @@
 // For details see the UNLICENSE file at the root of the source tree.
 //
 
+#include <sys/uio.h>
+
 // xc6 configuration registers, documentation in ug380, page90
 enum fpga_config_reg {
 	CRC = 0, FAR_MAJ, FAR_MIN, FDRI, FDRO, CMD, CTL, MASK, STAT, LOUT, COR1,
@@ -65,9 +67,13 @@ struct fpga_bits
 {
 	uint8_t* d;
 	int len;
+	int idcode; // part, see xc_info() for the layout of d
+	// xc_info(idcode), set by write_model() and extract_model()
+	// so that the bit accessors don't look it up per bit
+	const struct xc_info* xci;
 };
 
-// Use the default value together with COR1 CRC_BYPASS
+// Accepted on read together with COR1 CRC_BYPASS
 #define DEFAULT_AUTO_CRC	0x9876DEFC
 
 struct fpga_config
@@ -83,6 +89,7 @@ struct fpga_config
 
 	struct fpga_bits bits;
 	uint32_t auto_crc;
+	int crc_errors; // CRC checks that failed during read_bitfile()
 };
 
 int read_bitfile(struct fpga_config* cfg, FILE* f);
@@ -95,7 +102,32 @@ int dump_config(struct fpga_config* cfg, int flags);
 
 void free_config(struct fpga_config* cfg);
 
+// Output for the bitstream writers. Use one of the sink_init_*()
+// functions, len counts the bytes written so far.
+struct bit_sink
+{
+	int (*writev)(struct bit_sink* sink, const struct iovec* iov,
+		int iovcnt);
+	int len;
+	FILE* f;
+	int fd;
+	uint8_t* buf; // memory sink, free() after use
+	int buf_size;
+};
+
+void sink_init_file(struct bit_sink* sink, FILE* f);
+void sink_init_fd(struct bit_sink* sink, int fd);
+void sink_init_mem(struct bit_sink* sink);
+
+int write_bitstream(struct bit_sink* sink, struct fpga_model* model);
 int write_bitfile(FILE* f, struct fpga_model* model);
+// Writes only the frames that differ from base (as filled by
+// write_model() or read_bitfile()), using multi-frame writes for
+// repeated frame contents.
+int write_partial_bitstream(struct bit_sink* sink, struct fpga_model* model,
+	const struct fpga_bits* base);
+int write_partial_bitfile(FILE* f, struct fpga_model* model,
+	const struct fpga_bits* base);
 
 int extract_model(struct fpga_model* model, struct fpga_bits* bits);
 int printf_swbits(struct fpga_model* model);
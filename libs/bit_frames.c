@@ -5,6 +5,7 @@
 // For details see the UNLICENSE file at the root of the source tree.
 //
 
+#include <pthread.h>
 #include "model.h"
 #include "bit.h"
 #include "parts.h"
@@ -14,12 +15,8 @@
 
 static uint8_t* get_first_minor(struct fpga_bits* bits, int row, int major)
 {
-	int i, num_frames;
-
-	num_frames = 0;
-	for (i = 0; i < major; i++)
-		num_frames += get_major_minors(XC6SLX9, i);
-	return &bits->d[(row*FRAMES_PER_ROW + num_frames)*FRAME_SIZE];
+	return &bits->d[(row*bits->xci->frames_per_row
+		+ bits->xci->major_framestart[major])*FRAME_SIZE];
 }
 
 static int get_bit(struct fpga_bits* bits,
@@ -80,18 +77,54 @@ struct sw_yxpos
 	swidx_t idx;
 };
 
-#define MAX_YX_SWITCHES 1024
+#define YX_POS_INCREMENT 256
+
+// A routing bitpos matches a tile if (slice[w_a] & mask_a) == val_a
+// and (slice[w_b] & mask_b) == val_b, where slice holds 64 bits of
+// each of the 21 routing minors, see extract_routing_switches().
+struct bitpos_mask
+{
+	int w_a, w_b;
+	uint64_t mask_a, val_a, mask_b, val_b;
+	str16_t from_i, to_i;
+};
+
+#define ROUTING_SLICE_WORDS	21
 
 struct extract_state
 {
 	struct fpga_model* model;
 	struct fpga_bits* bits;
+	struct bitpos_mask* sw_masks; // one per model->sw_bitpos
 	// yx switches are fully extracted ones pointing into the
 	// model, stored here for later processing into nets.
-	int num_yx_pos;
-	struct sw_yxpos yx_pos[MAX_YX_SWITCHES]; // needs to be dynamically alloced...
+	int num_yx_pos, yx_pos_size;
+	struct sw_yxpos* yx_pos;
 };
 
+static int add_yx_switch(struct extract_state* es, int y, int x, swidx_t idx)
+{
+	void* new_ptr;
+	int new_size;
+
+	if (es->num_yx_pos >= es->yx_pos_size) {
+		new_size = es->yx_pos_size ? es->yx_pos_size*2
+			: YX_POS_INCREMENT;
+		new_ptr = realloc(es->yx_pos, new_size*sizeof(*es->yx_pos));
+		if (!new_ptr) {
+			OUT_OF_MEM();
+			return ENOMEM;
+		}
+		es->yx_pos = new_ptr;
+		es->yx_pos_size = new_size;
+	}
+	es->yx_pos[es->num_yx_pos].y = y;
+	es->yx_pos[es->num_yx_pos].x = x;
+	es->yx_pos[es->num_yx_pos].idx = idx;
+	es->num_yx_pos++;
+	return 0;
+}
+
 static int find_es_switch(struct extract_state* es, int y, int x, swidx_t sw)
 {
 	int i;
@@ -107,6 +140,7 @@ static int find_es_switch(struct extract_state* es, int y, int x, swidx_t sw)
 
 static int write_iobs(struct fpga_bits* bits, struct fpga_model* model)
 {
+	const struct xc_info* xci = bits->xci;
 	int i, y, x, type_idx, part_idx, dev_idx, first_iob, rc;
 	struct fpga_device* dev;
 	uint64_t u64;
@@ -120,7 +154,7 @@ static int write_iobs(struct fpga_bits* bits, struct fpga_model* model)
 		if (!dev->instantiated)
 			continue;
 
-		part_idx = find_iob_sitename(XC6SLX9, name);
+		part_idx = find_iob_sitename(bits->idcode, name);
 		if (part_idx == -1) {
 			HERE();
 			continue;
@@ -129,7 +163,7 @@ static int write_iobs(struct fpga_bits* bits, struct fpga_model* model)
 		if (!first_iob) {
 			first_iob = 1;
 			// todo: is this right on the other sides?
-			set_bit(bits, /*row*/ 0, get_rightside_major(XC6SLX9),
+			set_bit(bits, /*row*/ 0, get_rightside_major(bits->idcode),
 				/*minor*/ 22, 64*15+XC6_HCLK_BITS+4);
 		}
 
@@ -161,7 +195,7 @@ static int write_iobs(struct fpga_bits* bits, struct fpga_model* model)
 			else
 				HERE();
 
-			frame_set_u64(&bits->d[IOB_DATA_START
+			frame_set_u64(&bits->d[XC_IOB_DATA_START(xci)
 				+ part_idx*IOB_ENTRY_LEN], u64);
 		} else if (dev->u.iob.ostandard[0]) {
 			if (!dev->u.iob.drive_strength
@@ -257,7 +291,7 @@ static int write_iobs(struct fpga_bits* bits, struct fpga_model* model)
 				default: FAIL(EINVAL);
 			}
 
-			frame_set_u64(&bits->d[IOB_DATA_START
+			frame_set_u64(&bits->d[XC_IOB_DATA_START(xci)
 				+ part_idx*IOB_ENTRY_LEN], u64);
 		} else HERE();
 	}
@@ -268,20 +302,21 @@ fail:
 
 static int extract_iobs(struct extract_state* es)
 {
+	const struct xc_info* xci = es->bits->xci;
 	int i, num_iobs, iob_y, iob_x, iob_idx, dev_idx, first_iob, rc;
 	uint64_t u64;
 	const char* iob_sitename;
 	struct fpga_device* dev;
 	struct fpgadev_iob cfg;
 
-	num_iobs = get_num_iobs(XC6SLX9);
+	num_iobs = get_num_iobs(es->bits->idcode);
 	first_iob = 0;
 	for (i = 0; i < num_iobs; i++) {
 		u64 = frame_get_u64(&es->bits->d[
-			IOB_DATA_START + i*IOB_ENTRY_LEN]);
+			XC_IOB_DATA_START(xci) + i*IOB_ENTRY_LEN]);
 		if (!u64) continue;
 
-		iob_sitename = get_iob_sitename(XC6SLX9, i);
+		iob_sitename = get_iob_sitename(es->bits->idcode, i);
 		if (!iob_sitename) {
 			// The space for 6 IOBs on all four sides
 			// (6*8 = 48 bytes, *4=192 bytes) is used
@@ -298,10 +333,10 @@ static int extract_iobs(struct extract_state* es)
 		if (!first_iob) {
 			first_iob = 1;
 			// todo: is this right on the other sides?
-			if (!get_bit(es->bits, /*row*/ 0, get_rightside_major(XC6SLX9),
+			if (!get_bit(es->bits, /*row*/ 0, get_rightside_major(es->bits->idcode),
 				/*minor*/ 22, 64*15+XC6_HCLK_BITS+4))
 				HERE();
-			clear_bit(es->bits, /*row*/ 0, get_rightside_major(XC6SLX9),
+			clear_bit(es->bits, /*row*/ 0, get_rightside_major(es->bits->idcode),
 				/*minor*/ 22, 64*15+XC6_HCLK_BITS+4);
 		}
 		if (u64 & XC6_IOB_INSTANTIATED)
@@ -557,7 +592,7 @@ static int extract_iobs(struct extract_state* es)
 			}
 		}
 		if (!u64) {
-			frame_set_u64(&es->bits->d[IOB_DATA_START
+			frame_set_u64(&es->bits->d[XC_IOB_DATA_START(xci)
 				+ i*IOB_ENTRY_LEN], 0);
 			dev->instantiated = 1;
 			dev->u.iob = cfg;
@@ -1367,49 +1402,38 @@ fail:
 	return rc;
 }
 
-static int bitpos_is_set(struct extract_state* es, int y, int x,
-	struct xc6_routing_bitpos* swpos, int* is_set)
+static void bitpos_to_mask(const struct xc6_routing_bitpos* swpos,
+	struct bitpos_mask* m)
 {
-	int row_num, row_pos, start_in_frame, two_bits_val, rc;
-
-	*is_set = 0;
-	is_in_row(es->model, y, &row_num, &row_pos);
-	if (row_num == -1 || row_pos == -1
-	    || row_pos == HCLK_POS) FAIL(EINVAL);
-	if (row_pos > HCLK_POS)
-		start_in_frame = (row_pos-1)*64 + 16;
-	else
-		start_in_frame = row_pos*64;
-
+	memset(m, 0, sizeof(*m));
 	if (swpos->minor == 20) {
-		two_bits_val = ((get_bit(es->bits, row_num, es->model->x_major[x],
-			20, start_in_frame + swpos->two_bits_o) != 0) << 1)
-			| ((get_bit(es->bits, row_num, es->model->x_major[x],
-			20, start_in_frame + swpos->two_bits_o+1) != 0) << 0);
-		if (two_bits_val != swpos->two_bits_val)
-			return 0;
-
-		if (!get_bit(es->bits, row_num, es->model->x_major[x], 20,
-			start_in_frame + swpos->one_bit_o))
-			return 0;
+		m->w_a = m->w_b = 20;
+		m->mask_a = 1ULL << swpos->two_bits_o
+			| 1ULL << (swpos->two_bits_o+1)
+			| 1ULL << swpos->one_bit_o;
+		m->val_a = 1ULL << swpos->one_bit_o;
+		if (swpos->two_bits_val & 2)
+			m->val_a |= 1ULL << swpos->two_bits_o;
+		if (swpos->two_bits_val & 1)
+			m->val_a |= 1ULL << (swpos->two_bits_o+1);
+		return;
+	}
+	// bit 1 of two_bits_val is in the first minor of the pair,
+	// bit 0 in the second
+	m->w_a = swpos->minor;
+	m->w_b = swpos->minor+1;
+	m->mask_a = m->mask_b = 1ULL << (swpos->two_bits_o/2);
+	if (swpos->two_bits_val & 2)
+		m->val_a = m->mask_a;
+	if (swpos->two_bits_val & 1)
+		m->val_b = m->mask_b;
+	if (swpos->one_bit_o & 1) {
+		m->mask_b |= 1ULL << (swpos->one_bit_o/2);
+		m->val_b |= 1ULL << (swpos->one_bit_o/2);
 	} else {
-		two_bits_val = 
-			((get_bit(es->bits, row_num, es->model->x_major[x], swpos->minor,
-				start_in_frame + swpos->two_bits_o/2) != 0) << 1)
-			| ((get_bit(es->bits, row_num, es->model->x_major[x], swpos->minor+1,
-			    start_in_frame + swpos->two_bits_o/2) != 0) << 0);
-		if (two_bits_val != swpos->two_bits_val)
-			return 0;
-
-		if (!get_bit(es->bits, row_num, es->model->x_major[x],
-			swpos->minor + (swpos->one_bit_o&1),
-			start_in_frame + swpos->one_bit_o/2))
-			return 0;
+		m->mask_a |= 1ULL << (swpos->one_bit_o/2);
+		m->val_a |= 1ULL << (swpos->one_bit_o/2);
 	}
-	*is_set = 1;
-	return 0;
-fail:
-	return rc;
 }
 
 static int bitpos_clear_bits(struct extract_state* es, int y, int x,
@@ -1485,32 +1509,52 @@ fail:
 static int extract_routing_switches(struct extract_state* es, int y, int x)
 {
 	struct fpga_tile* tile;
+	struct bitpos_mask* m;
+	uint64_t slice[ROUTING_SLICE_WORDS], any_set;
+	const uint8_t* minor0_p;
+	int row_num, row_pos, start_in_frame, i, rc;
 	swidx_t sw_idx;
-	int i, is_set, rc;
 
 	tile = YX_TILE(es->model, y, x);
+	is_in_row(es->model, y, &row_num, &row_pos);
+	if (row_num == -1 || row_pos == -1
+	    || row_pos == HCLK_POS) FAIL(EINVAL);
+	if (row_pos > HCLK_POS)
+		start_in_frame = (row_pos-1)*64 + 16;
+	else
+		start_in_frame = row_pos*64;
+
+	// Load the 64 bits of the tile in each minor once and match
+	// all bitpos against them.
+	minor0_p = get_first_minor(es->bits, row_num, es->model->x_major[x])
+		+ start_in_frame/8;
+	any_set = 0;
+	for (i = 0; i < ROUTING_SLICE_WORDS; i++) {
+		slice[i] = frame_get_u64(minor0_p + i*FRAME_SIZE);
+		any_set |= slice[i];
+	}
+	if (!any_set)
+		return 0;
 
 	for (i = 0; i < es->model->num_bitpos; i++) {
-		rc = bitpos_is_set(es, y, x, &es->model->sw_bitpos[i], &is_set);
-		if (rc) FAIL(rc);
-		if (!is_set) continue;
+		m = &es->sw_masks[i];
+		if ((slice[m->w_a] & m->mask_a) != m->val_a
+		    || (slice[m->w_b] & m->mask_b) != m->val_b)
+			continue;
 
 		sw_idx = fpga_switch_lookup(es->model, y, x,
-			fpga_wire2str_i(es->model, es->model->sw_bitpos[i].from),
-			fpga_wire2str_i(es->model, es->model->sw_bitpos[i].to));
+			m->from_i, m->to_i);
 		if (sw_idx == NO_SWITCH) FAIL(EINVAL);
 		// todo: es->model->sw_bitpos[i].bidir handling
 
 		if (tile->switches[sw_idx] & SWITCH_BIDIRECTIONAL)
 			HERE();
-		if (tile->switches[sw_idx] & SWITCH_USED)
+		if (SW_USED(tile, sw_idx))
 			HERE();
-		if (es->num_yx_pos >= MAX_YX_SWITCHES)
-			{ FAIL(ENOTSUP); }
-		es->yx_pos[es->num_yx_pos].y = y;
-		es->yx_pos[es->num_yx_pos].x = x;
-		es->yx_pos[es->num_yx_pos].idx = sw_idx;
-		es->num_yx_pos++;
+		rc = add_yx_switch(es, y, x, sw_idx);
+		if (rc) FAIL(rc);
+		slice[m->w_a] &= ~m->mask_a;
+		slice[m->w_b] &= ~m->mask_b;
 		rc = bitpos_clear_bits(es, y, x, &es->model->sw_bitpos[i]);
 		if (rc) FAIL(rc);
 	}
@@ -1560,12 +1604,8 @@ static int extract_logic_switches(struct extract_state* es, int y, int x)
 				cout_x, cout_str, SW_TO);
 			if (cout_sw == NO_SWITCH) HERE();
 			else {
-				if (es->num_yx_pos >= MAX_YX_SWITCHES)
-					{ FAIL(ENOTSUP); }
-				es->yx_pos[es->num_yx_pos].y = cout_y;
-				es->yx_pos[es->num_yx_pos].x = cout_x;
-				es->yx_pos[es->num_yx_pos].idx = cout_sw;
-				es->num_yx_pos++;
+				rc = add_yx_switch(es, cout_y, cout_x, cout_sw);
+				if (rc) FAIL(rc);
 
 				frame_clear_bit(u8_p + minor*FRAME_SIZE,
 					byte_off*8 + XC6_ML_CIN_USED);
@@ -1767,12 +1807,8 @@ static int extract_iologic_switches(struct extract_state* es, int y, int x)
 				from_str_i, to_str_i);
 			if (sw_idx == NO_SWITCH) FAIL(EINVAL);
 
-			if (es->num_yx_pos >= MAX_YX_SWITCHES)
-				{ FAIL(ENOTSUP); }
-			es->yx_pos[es->num_yx_pos].y = y;
-			es->yx_pos[es->num_yx_pos].x = x;
-			es->yx_pos[es->num_yx_pos].idx = sw_idx;
-			es->num_yx_pos++;
+			rc = add_yx_switch(es, y, x, sw_idx);
+			if (rc) FAIL(rc);
 		}
 		for (j = 0; sw_pos[i].minor[j] != -1; j++)
 			frame_clear_bit(&minor0_p[sw_pos[i].minor[j]
@@ -1787,35 +1823,174 @@ fail:
 	return rc;
 }
 
-static int extract_switches(struct extract_state* es)
+// extract_column() handles the tiles of column x in row (-1 for the
+// tiles outside of all rows).
+static int extract_column(struct extract_state* es, int x, int row)
 {
-	int x, y, rc;
+	int y, rc;
 
-	for (x = 0; x < es->model->x_width; x++) {
-		for (y = 0; y < es->model->y_height; y++) {
-			// routing switches
-			if (is_atx(X_ROUTING_COL, es->model, x)
-			    && y >= TOP_IO_TILES
-			    && y < es->model->y_height-BOT_IO_TILES
-			    && !is_aty(Y_ROW_HORIZ_AXSYMM|Y_CHIP_HORIZ_REGS,
-					es->model, y)) {
-				rc = extract_routing_switches(es, y, x);
-				if (rc) FAIL(rc);
-			}
-			// logic switches
-			if (has_device(es->model, y, x, DEV_LOGIC)) {
-				rc = extract_logic_switches(es, y, x);
-				if (rc) FAIL(rc);
-			}
-			// iologic switches
-			if (has_device(es->model, y, x, DEV_ILOGIC)) {
-				rc = extract_iologic_switches(es, y, x);
-				if (rc) FAIL(rc);
+	for (y = 0; y < es->model->y_height; y++) {
+		if (which_row(y, es->model) != row)
+			continue;
+		// routing switches
+		if (is_atx(X_ROUTING_COL, es->model, x)
+		    && y >= TOP_IO_TILES
+		    && y < es->model->y_height-BOT_IO_TILES
+		    && !is_aty(Y_ROW_HORIZ_AXSYMM|Y_CHIP_HORIZ_REGS,
+				es->model, y)) {
+			rc = extract_routing_switches(es, y, x);
+			if (rc) FAIL(rc);
+		}
+		// logic switches
+		if (has_device(es->model, y, x, DEV_LOGIC)) {
+			rc = extract_logic_switches(es, y, x);
+			if (rc) FAIL(rc);
+		}
+		// iologic switches
+		if (has_device(es->model, y, x, DEV_ILOGIC)) {
+			rc = extract_iologic_switches(es, y, x);
+			if (rc) FAIL(rc);
+		}
+	}
+	return 0;
+fail:
+	return rc;
+}
+
+// Each row of a major has its own frames, see get_first_minor().
+// Columns with the same major share them, so a thread takes one
+// (major, row) and all columns of that major in it. Each column and
+// row collects its switches in its own extract_state, merged back
+// into y order per column by extract_switches().
+struct extract_job
+{
+	struct extract_state* part_es; // x_width * (cfg_rows+1)
+	int num_majors;
+	int next_part;
+	int rc;
+};
+
+static void* extract_thread(void* _job)
+{
+	struct extract_job* job = _job;
+	struct fpga_model* model = job->part_es[0].model;
+	int part, major, row, x, rc;
+
+	while (!__atomic_load_n(&job->rc, __ATOMIC_RELAXED)) {
+		part = __sync_fetch_and_add(&job->next_part, 1);
+		if (part >= job->num_majors*(model->cfg_rows+1))
+			break;
+		major = part / (model->cfg_rows+1);
+		row = part % (model->cfg_rows+1);
+		for (x = 0; x < model->x_width; x++) {
+			if (model->x_major[x] != major)
+				continue;
+			rc = extract_column(&job->part_es[x*(model->cfg_rows+1)
+				+ row], x, row-1);
+			if (rc) {
+				__sync_bool_compare_and_swap(&job->rc, 0, rc);
+				break;
 			}
 		}
 	}
 	return 0;
+}
+
+static int extract_switches(struct extract_state* es)
+{
+	struct fpga_model* model = es->model;
+	struct extract_job job;
+	struct extract_state* part;
+	pthread_t* threads;
+	struct sw_yxpos* new_ptr;
+	int num_threads, num_parts, num_new, x, y, i, rc;
+
+	memset(&job, 0, sizeof(job));
+	threads = 0;
+	num_parts = model->x_width*(model->cfg_rows+1);
+	int pos[model->cfg_rows+1];
+	es->sw_masks = malloc(model->num_bitpos*sizeof(*es->sw_masks));
+	job.part_es = calloc(num_parts, sizeof(*job.part_es));
+	if (!es->sw_masks || !job.part_es) {
+		OUT_OF_MEM();
+		FAIL(ENOMEM);
+	}
+	for (i = 0; i < model->num_bitpos; i++) {
+		bitpos_to_mask(&model->sw_bitpos[i], &es->sw_masks[i]);
+		es->sw_masks[i].from_i = fpga_wire2str_i(model,
+			model->sw_bitpos[i].from);
+		es->sw_masks[i].to_i = fpga_wire2str_i(model,
+			model->sw_bitpos[i].to);
+	}
+	for (i = 0; i < num_parts; i++) {
+		job.part_es[i].model = model;
+		job.part_es[i].bits = es->bits;
+		job.part_es[i].sw_masks = es->sw_masks;
+	}
+	for (x = 0; x < model->x_width; x++) {
+		if (model->x_major[x] >= job.num_majors)
+			job.num_majors = model->x_major[x]+1;
+	}
+
+	num_threads = model_threads();
+	if (num_threads > job.num_majors*(model->cfg_rows+1))
+		num_threads = job.num_majors*(model->cfg_rows+1);
+	i = 0;
+	if (num_threads > 1) {
+		threads = malloc(num_threads*sizeof(*threads));
+		if (!threads) {
+			OUT_OF_MEM();
+			FAIL(ENOMEM);
+		}
+		for (; i < num_threads; i++) {
+			if (pthread_create(&threads[i], 0, extract_thread,
+					&job))
+				break;
+		}
+	}
+	if (!i) // no threads at all, run in this thread
+		extract_thread(&job);
+	num_threads = i;
+	for (i = 0; i < num_threads; i++)
+		pthread_join(threads[i], 0);
+	rc = job.rc;
+	if (rc) FAIL(rc);
+
+	num_new = 0;
+	for (i = 0; i < num_parts; i++)
+		num_new += job.part_es[i].num_yx_pos;
+	if (es->num_yx_pos + num_new > es->yx_pos_size) {
+		new_ptr = realloc(es->yx_pos,
+			(es->num_yx_pos + num_new)*sizeof(*new_ptr));
+		if (!new_ptr) {
+			OUT_OF_MEM();
+			FAIL(ENOMEM);
+		}
+		es->yx_pos = new_ptr;
+		es->yx_pos_size = es->num_yx_pos + num_new;
+	}
+	// Each part is in y order, walk y to merge the rows of a column.
+	for (x = 0; x < model->x_width; x++) {
+		part = &job.part_es[x*(model->cfg_rows+1)];
+		memset(pos, 0, sizeof(pos));
+		for (y = 0; y < model->y_height; y++) {
+			i = which_row(y, model)+1;
+			while (pos[i] < part[i].num_yx_pos
+			       && part[i].yx_pos[pos[i]].y == y)
+				es->yx_pos[es->num_yx_pos++]
+					= part[i].yx_pos[pos[i]++];
+		}
+	}
+	rc = 0;
 fail:
+	if (job.part_es) {
+		for (i = 0; i < num_parts; i++)
+			free(job.part_es[i].yx_pos);
+		free(job.part_es);
+	}
+	free(threads);
+	free(es->sw_masks);
+	es->sw_masks = 0;
 	return rc;
 }
 
@@ -1835,6 +2010,10 @@ int extract_model(struct fpga_model* model, struct fpga_bits* bits)
 
 	rc = construct_extract_state(&es, model);
 	if (rc) FAIL(rc);
+	if (!xc_info(model->idcode)
+	    || xc_info(bits->idcode) != xc_info(model->idcode))
+		FAIL(EINVAL);
+	bits->xci = xc_info(bits->idcode);
 	es.bits = bits;
 	for (i = 0; i < sizeof(s_default_bits)/sizeof(s_default_bits[0]); i++) {
 		if (!get_bitp(bits, &s_default_bits[i]))
@@ -1859,8 +2038,10 @@ int extract_model(struct fpga_model* model, struct fpga_bits* bits)
 			es.yx_pos[i].x, &es.yx_pos[i].idx, 1);
 		if (rc) FAIL(rc);
 	}
+	free(es.yx_pos);
 	return 0;
 fail:
+	free(es.yx_pos);
 	return rc;
 }
 
@@ -1924,15 +2105,12 @@ static int find_bitpos(struct fpga_model* model, int y, int x, swidx_t sw)
 
 static int write_routing_sw(struct fpga_bits* bits, struct fpga_model* model, int y, int x)
 {
-	struct fpga_tile* tile;
 	int i, bit_pos, rc;
 
 	// go through enabled switches, lookup in sw_bitpos
 	// and set bits
-	tile = YX_TILE(model, y, x);
-	for (i = 0; i < tile->num_switches; i++) {
-		if (!(tile->switches[i] & SWITCH_USED))
-			continue;
+	for (i = fpga_switch_used_first(model, y, x); i != NO_SWITCH;
+	     i = fpga_switch_used_next(model, y, x, i)) {
 		bit_pos = find_bitpos(model, y, x, i);
 		if (bit_pos == -1) {
 			HERE();
@@ -1957,14 +2135,8 @@ static int get_used_switches(struct fpga_model* model, int y, int x,
 	struct str_sw** str_sw, int* num_sw)
 {
 	int i, num_used, rc;
-	struct fpga_tile* tile;
 
-	tile = YX_TILE(model, y, x);
-	num_used = 0;
-	for (i = 0; i < tile->num_switches; i++) {
-		if (tile->switches[i] & SWITCH_USED)
-			num_used++;
-	}
+	num_used = fpga_switch_num_used(model, y, x);
 	if (!num_used) {
 		*num_sw = 0;
 		*str_sw = 0;
@@ -1973,9 +2145,8 @@ static int get_used_switches(struct fpga_model* model, int y, int x,
 	*str_sw = malloc(num_used * sizeof(**str_sw));
 	if (!(*str_sw)) FAIL(ENOMEM);
 	*num_sw = 0;
-	for (i = 0; i < tile->num_switches; i++) {
-		if (!(tile->switches[i] & SWITCH_USED))
-			continue;
+	for (i = fpga_switch_used_first(model, y, x); i != NO_SWITCH;
+	     i = fpga_switch_used_next(model, y, x, i)) {
 		(*str_sw)[*num_sw].from_str =
 			fpga_switch_str(model, y, x, i, SW_FROM);
 		(*str_sw)[*num_sw].to_str =
@@ -2078,11 +2249,14 @@ fail:
 
 static int write_switches(struct fpga_bits* bits, struct fpga_model* model)
 {
-	struct fpga_tile* tile;
 	int x, y, i, rc;
 
+	if (!fpga_num_used_switches(model))
+		return 0;
 	for (x = 0; x < model->x_width; x++) {
 		for (y = 0; y < model->y_height; y++) {
+			if (!fpga_switch_num_used(model, y, x))
+				continue;
 			if (is_atx(X_ROUTING_COL, model, x)
 			    && y >= TOP_IO_TILES
 			    && y < model->y_height-BOT_IO_TILES
@@ -2102,10 +2276,9 @@ static int write_switches(struct fpga_bits* bits, struct fpga_model* model)
 			//       tiles that need no bits...
 			if (is_atyx(YX_DEV_LOGIC|YX_DEV_IOB, model, y, x))
 				continue;
-			tile = YX_TILE(model, y, x);
-			for (i = 0; i < tile->num_switches; i++) {
-				if (!(tile->switches[i] & SWITCH_USED))
-					continue;
+			for (i = fpga_switch_used_first(model, y, x);
+			     i != NO_SWITCH;
+			     i = fpga_switch_used_next(model, y, x, i)) {
 				fprintf(stderr, "#E %s:%i unsupported switch "
 					"y%02i x%02i %s\n", __FILE__, __LINE__,
 					y, x,
@@ -2210,6 +2383,10 @@ int write_model(struct fpga_bits* bits, struct fpga_model* model)
 {
 	int i, rc;
 
+	if (!xc_info(model->idcode)
+	    || xc_info(bits->idcode) != xc_info(model->idcode))
+		FAIL(EINVAL);
+	bits->xci = xc_info(bits->idcode);
 	for (i = 0; i < sizeof(s_default_bits)/sizeof(s_default_bits[0]); i++)
 		set_bitp(bits, &s_default_bits[i]);
 	rc = write_switches(bits, model);
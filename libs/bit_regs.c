@@ -5,6 +5,7 @@
 // For details see the UNLICENSE file at the root of the source tree.
 //
 
+#include <unistd.h>
 #include "model.h"
 #include "bit.h"
 #include "parts.h"
@@ -28,39 +29,81 @@ static int parse_commands(struct fpga_config* config, uint8_t* d,
 #define PACKET_HDR_OPCODE_WRITE  2
 #define PACKET_HDR_OPCODE_RSRV   3
 
-#define BITSTREAM_READ_PAGESIZE		4096
+
+//
+// Configuration CRC (ug380, Cyclic Redundancy Check): CRC-32C over
+// 22 bits per written 16-bit word - the data word followed by the
+// 6-bit register address, LSB first. Writes to the CRC register are
+// not included. CMD RCRC resets the CRC.
+// The 22-bit steps do not fit the byte-oriented CRC32 instructions,
+// so we use one 8-bit table for the data bytes and a 6-bit table for
+// the address.
+//
+
+#define CRC32C_POLY	0x82F63B78
+
+struct xc6_crc
+{
+	uint32_t crc;
+	uint32_t t8[256];
+	uint32_t t6[64];
+};
+
+static void crc_init(struct xc6_crc* c)
+{
+	uint32_t v;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		v = i;
+		for (j = 0; j < 8; j++)
+			v = (v >> 1) ^ ((v & 1) ? CRC32C_POLY : 0);
+		c->t8[i] = v;
+	}
+	for (i = 0; i < 64; i++) {
+		v = i;
+		for (j = 0; j < 6; j++)
+			v = (v >> 1) ^ ((v & 1) ? CRC32C_POLY : 0);
+		c->t6[i] = v;
+	}
+	c->crc = 0;
+}
+
+static inline void crc_add(struct xc6_crc* c, int reg, uint16_t word)
+{
+	uint32_t v = c->crc;
+
+	v = (v >> 8) ^ c->t8[(v ^ word) & 0xFF];
+	v = (v >> 8) ^ c->t8[(v ^ (word >> 8)) & 0xFF];
+	v = (v >> 6) ^ c->t6[(v ^ reg) & 0x3F];
+	c->crc = v;
+}
+
+// d points to len bytes of big-endian 16-bit words
+static void crc_add_words(struct xc6_crc* c, int reg,
+	const uint8_t* d, int len)
+{
+	int i;
+
+	for (i = 0; i+1 < len; i += 2)
+		crc_add(c, reg, d[i] << 8 | d[i+1]);
+}
 
 int read_bitfile(struct fpga_config* cfg, FILE* f)
 {
 	uint8_t* bit_data = 0;
-	int rc, file_len, bit_len, bit_cur;
+	int rc, bit_len, bit_cur, mapped;
 
 	memset(cfg, 0, sizeof(*cfg));
 	cfg->num_regs_before_bits = -1;
 	cfg->idcode_reg = -1;
 	cfg->FLR_reg = -1;
 
-	// read .bit into memory
-	if (fseek(f, 0, SEEK_END) == -1)
-		FAIL(errno);
-	if ((file_len = ftell(f)) == -1)
-		FAIL(errno);
-	if (fseek(f, 0, SEEK_SET) == -1)
-		FAIL(errno);
-	if (!file_len)
-		FAIL(EINVAL);
-
-	if (!(bit_data = malloc(file_len)))
-		FAIL(ENOMEM);
-	bit_len = 0;
-	while (bit_len < file_len) {
-		size_t num_read = fread(&bit_data[bit_len], sizeof(uint8_t),
-			BITSTREAM_READ_PAGESIZE, f);
-		bit_len += num_read;
-		if (num_read != BITSTREAM_READ_PAGESIZE)
-			break;
-	}
-	if (bit_len != file_len)
+	// Regular files are parsed in place from a read-only mapping,
+	// everything else is read into memory.
+	rc = map_file(f, &bit_data, &bit_len, &mapped);
+	if (rc) FAIL(rc);
+	if (!bit_len)
 		FAIL(EINVAL);
 
 	// parse header and commands
@@ -69,10 +112,10 @@ int read_bitfile(struct fpga_config* cfg, FILE* f)
 	if ((rc = parse_commands(cfg, bit_data, bit_len, bit_cur)))
 		FAIL(rc);
 
-	free(bit_data);
+	unmap_file(bit_data, bit_len, mapped);
 	return 0;
 fail:
-	free(bit_data);
+	unmap_file(bit_data, bit_len, mapped);
 	return rc;
 }
 
@@ -807,45 +850,48 @@ static void printf_lut(const uint8_t* bits, int row, int major,
 	}
 }
 
-static int dump_maj_zero(const uint8_t* bits, int row, int major)
+static int dump_maj_zero(const struct xc_info* xci,
+	const uint8_t* bits, int row, int major)
 {
 	int minor;
 
-	for (minor = 0; minor < get_major_minors(XC6SLX9, major); minor++)
+	for (minor = 0; minor < xci->majors[major].minors; minor++)
 		printf_clock(&bits[minor*FRAME_SIZE], row, major, minor);
-	for (minor = 0; minor < get_major_minors(XC6SLX9, major); minor++)
+	for (minor = 0; minor < xci->majors[major].minors; minor++)
 		printf_frames(&bits[minor*FRAME_SIZE], /*max_frames*/ 1,
 			row, major, minor, /*print_empty*/ 0, /*no_clock*/ 1);
 	return 0;
 }
 
-static int dump_maj_left(const uint8_t* bits, int row, int major)
+static int dump_maj_left(const struct xc_info* xci,
+	const uint8_t* bits, int row, int major)
 {
 	int minor;
 
-	for (minor = 0; minor < get_major_minors(XC6SLX9, major); minor++)
+	for (minor = 0; minor < xci->majors[major].minors; minor++)
 		printf_clock(&bits[minor*FRAME_SIZE], row, major, minor);
-	for (minor = 0; minor < get_major_minors(XC6SLX9, major); minor++)
+	for (minor = 0; minor < xci->majors[major].minors; minor++)
 		printf_frames(&bits[minor*FRAME_SIZE], /*max_frames*/ 1,
 			row, major, minor, /*print_empty*/ 0, /*no_clock*/ 1);
 	return 0;
 }
 
-static int dump_maj_right(const uint8_t* bits, int row, int major)
+static int dump_maj_right(const struct xc_info* xci,
+	const uint8_t* bits, int row, int major)
 {
 	int minor;
 
-	for (minor = 0; minor < get_major_minors(XC6SLX9, major); minor++)
+	for (minor = 0; minor < xci->majors[major].minors; minor++)
 		printf_clock(&bits[minor*FRAME_SIZE], row, major, minor);
-	for (minor = 0; minor < get_major_minors(XC6SLX9, major); minor++)
+	for (minor = 0; minor < xci->majors[major].minors; minor++)
 		printf_frames(&bits[minor*FRAME_SIZE], /*max_frames*/ 1,
 			row, major, minor, /*print_empty*/ 0, /*no_clock*/ 1);
 	return 0;
 }
 
-static int dump_maj_logic(const uint8_t* bits, int row, int major)
+static int dump_maj_logic(const struct xc_info* xci,
+	const uint8_t* bits, int row, int major)
 {
-	const struct xc_info* xci = xc_info(XC6SLX9);
 	int minor, i, logdev_start, logdev_end;
 
 	for (minor = 0; minor < xci->majors[major].minors; minor++)
@@ -861,7 +907,7 @@ static int dump_maj_logic(const uint8_t* bits, int row, int major)
 	logdev_start = 0;
 	logdev_end = 15;
 	if (xci->majors[major].flags & XC_MAJ_TOP_BOT_IO) {
-		if (row == xc_info(XC6SLX9)->num_rows-1)
+		if (row == xci->num_rows-1)
 			logdev_start += TOPBOT_IO_ROWS;
 		else if (!row)
 			logdev_end -= TOPBOT_IO_ROWS;
@@ -944,12 +990,13 @@ static int dump_maj_logic(const uint8_t* bits, int row, int major)
 	return 0;
 }
 
-static int dump_maj_bram(const uint8_t* bits, int row, int major)
+static int dump_maj_bram(const struct xc_info* xci,
+	const uint8_t* bits, int row, int major)
 {
 	ramb16_cfg_t ramb16_cfg[4];
 	int minor, i, j, offset_in_frame;
 
-	for (minor = 0; minor < get_major_minors(XC6SLX9, major); minor++)
+	for (minor = 0; minor < xci->majors[major].minors; minor++)
 		printf_clock(&bits[minor*FRAME_SIZE], row, major, minor);
 
 	// 0:19 routing minor pairs
@@ -988,11 +1035,12 @@ static int dump_maj_bram(const uint8_t* bits, int row, int major)
 	return 0;
 }
 
-static int dump_maj_macc(const uint8_t* bits, int row, int major)
+static int dump_maj_macc(const struct xc_info* xci,
+	const uint8_t* bits, int row, int major)
 {
 	int minor, i;
 
-	for (minor = 0; minor < get_major_minors(XC6SLX9, major); minor++)
+	for (minor = 0; minor < xci->majors[major].minors; minor++)
 		printf_clock(&bits[minor*FRAME_SIZE], row, major, minor);
 
 	// 0:19 routing minor pairs
@@ -1002,7 +1050,7 @@ static int dump_maj_macc(const uint8_t* bits, int row, int major)
 	// mi20 as 64-char 0/1 string
 	printf_v64_mi20(&bits[20*FRAME_SIZE], row, major);
 
-	for (minor = 21; minor < get_major_minors(XC6SLX9, major); minor++)
+	for (minor = 21; minor < xci->majors[major].minors; minor++)
 		printf_frames(&bits[minor*FRAME_SIZE], /*max_frames*/ 1,
 			row, major, minor, /*print_empty*/ 0, /*no_clock*/ 1);
 	return 0;
@@ -1010,42 +1058,41 @@ static int dump_maj_macc(const uint8_t* bits, int row, int major)
 
 static int dump_bits(struct fpga_config* cfg)
 {
-	int idcode, num_rows, row, major, off, rc;
+	const struct xc_info* xci;
+	int idcode, row, major, off, rc;
 
-	if (cfg->idcode_reg == -1) FAIL(EINVAL);
-	idcode = cfg->reg[cfg->idcode_reg].int_v;
-	num_rows = xc_num_rows(idcode);
-	if (num_rows < 1) FAIL(EINVAL);
+	idcode = cfg->bits.idcode;
+	if (!(xci = xc_info(idcode))) FAIL(EINVAL);
 
 	// type0
-	for (major = 0; major <= get_rightside_major(idcode); major++) {
-		for (row = num_rows-1; row >= 0; row--) {
-			off = (row*get_frames_per_row(idcode) + get_major_framestart(idcode, major)) * FRAME_SIZE;
+	for (major = 0; major < xci->num_majors; major++) {
+		for (row = xci->num_rows-1; row >= 0; row--) {
+			off = (row*xci->frames_per_row + xci->major_framestart[major]) * FRAME_SIZE;
 			switch (get_major_type(idcode, major)) {
 				case MAJ_ZERO:
-					rc = dump_maj_zero(&cfg->bits.d[off], row, major);
+					rc = dump_maj_zero(xci, &cfg->bits.d[off], row, major);
 					if (rc) FAIL(rc);
 					break;
 				case MAJ_LEFT:
-					rc = dump_maj_left(&cfg->bits.d[off], row, major);
+					rc = dump_maj_left(xci, &cfg->bits.d[off], row, major);
 					if (rc) FAIL(rc);
 					break;
 				case MAJ_RIGHT:
-					rc = dump_maj_right(&cfg->bits.d[off], row, major);
+					rc = dump_maj_right(xci, &cfg->bits.d[off], row, major);
 					if (rc) FAIL(rc);
 					break;
 				case MAJ_LOGIC_XM:
 				case MAJ_LOGIC_XL:
 				case MAJ_CENTER:
-					rc = dump_maj_logic(&cfg->bits.d[off], row, major);
+					rc = dump_maj_logic(xci, &cfg->bits.d[off], row, major);
 					if (rc) FAIL(rc);
 					break;
 				case MAJ_BRAM:
-					rc = dump_maj_bram(&cfg->bits.d[off], row, major);
+					rc = dump_maj_bram(xci, &cfg->bits.d[off], row, major);
 					if (rc) FAIL(rc);
 					break;
 				case MAJ_MACC:
-					rc = dump_maj_macc(&cfg->bits.d[off], row, major);
+					rc = dump_maj_macc(xci, &cfg->bits.d[off], row, major);
 					if (rc) FAIL(rc);
 					break;
 				default: HERE(); break;
@@ -1059,14 +1106,17 @@ fail:
 
 static int dump_bram(struct fpga_config* cfg)
 {
-	int row, i, j, off, newline;
+	const struct xc_info* xci;
+	int row, i, j, off, newline, rc;
 
+	if (!(xci = xc_info(cfg->bits.idcode))) FAIL(EINVAL);
 	newline = 0;
-	for (row = 0; row < 4; row++) {
-		for (i = 0; i < 8; i++) {
+	for (row = 0; row < xci->num_rows; row++) {
+		for (i = 0; i < xci->bram_frames_per_row/18; i++) {
+			off = XC_BRAM_DATA_START(xci)
+				+ (row*xci->bram_frames_per_row + i*18)*FRAME_SIZE;
 			for (j = 0; j < 18*130; j++) {
-				if (cfg->bits.d[BRAM_DATA_START + row*144*130
-					  + i*18*130 + j])
+				if (cfg->bits.d[off + j])
 					break;
 			}
 			if (j >= 18*130)
@@ -1077,16 +1127,18 @@ static int dump_bram(struct fpga_config* cfg)
 			}
 			printf("br%i ramb16 i%i\n", row, i);
 			printf("{\n");
-			off = BRAM_DATA_START + row*144*130 + i*18*130;
 			printf_ramb16_data(cfg->bits.d, off);
 			printf("}\n");
 		}
 	}
 	return 0;
+fail:
+	return rc;
 }
 
 int dump_config(struct fpga_config* cfg, int flags)
 {
+	const struct xc_info* xci;
 	int rc;
 
 	if (flags & DUMP_HEADER_STR)
@@ -1100,8 +1152,9 @@ int dump_config(struct fpga_config* cfg, int flags)
 		if (rc) FAIL(rc);
 		rc = dump_bram(cfg);
 		if (rc) FAIL(rc);
-		printf_type2(cfg->bits.d, cfg->bits.len,
-			BRAM_DATA_START + BRAM_DATA_LEN, 896*2/8);
+		xci = xc_info(cfg->bits.idcode);
+		printf_type2(cfg->bits.d, cfg->bits.len, XC_IOB_DATA_START(xci),
+			XC_IOB_DATA_LEN(xci)/IOB_ENTRY_LEN);
 		if (flags & DUMP_CRC)
 			printf("auto-crc 0x%X\n", cfg->auto_crc);
 	}
@@ -1175,40 +1228,44 @@ static int parse_header(struct fpga_config* cfg, uint8_t* d, int len,
 	return 0;
 }
 
-static int FAR_pos(int FAR_row, int FAR_major, int FAR_minor)
+static int FAR_pos(const struct xc_info* xci,
+	int FAR_row, int FAR_major, int FAR_minor)
 {
-	int result, i;
-
 	if (FAR_row < 0 || FAR_major < 0 || FAR_minor < 0)
 		return -1;
-	if (FAR_row > 3 || FAR_major > 17
-	    || FAR_minor >= get_major_minors(XC6SLX9, FAR_major))
+	if (FAR_row >= xci->num_rows || FAR_major >= xci->num_majors
+	    || FAR_minor >= xci->majors[FAR_major].minors)
 		return -1;
-	result = FAR_row * 505*130;
-	for (i = 0; i < FAR_major; i++)
-		result += get_major_minors(XC6SLX9, i)*130;
-	return result + FAR_minor*130;
+	return (FAR_row*xci->frames_per_row
+		+ xci->major_framestart[FAR_major]
+		+ FAR_minor)*FRAME_SIZE;
 }
 
 static int read_bits(struct fpga_config* cfg, uint8_t* d, int len,
 	int inpos, int* outdelta)
 {
+	const struct xc_info* xci;
 	int src_off, packet_hdr_type, packet_hdr_opcode;
 	int packet_hdr_register, packet_hdr_wordcount;
 	int FAR_block, FAR_row, FAR_major, FAR_minor, i, j, rc, MFW_src_off;
 	int offset_in_bits, block0_words, padding_frames, last_FDRI_pos;
+	int row_frames, bram_data_words;
 	uint16_t u16;
 	uint32_t u32;
 
 	last_FDRI_pos = -1;
 	*outdelta = 0;
-	if (cfg->idcode_reg == -1 || cfg->FLR_reg == -1
-	    || (cfg->reg[cfg->idcode_reg].int_v != XC6SLX4
-	        && cfg->reg[cfg->idcode_reg].int_v != XC6SLX9)
-	    || cfg->reg[cfg->FLR_reg].int_v != 896)
+	cfg->bits.d = 0;
+	if (cfg->idcode_reg == -1 || cfg->FLR_reg == -1)
 		FAIL(EINVAL);
+	cfg->bits.idcode = cfg->reg[cfg->idcode_reg].int_v;
+	if (!(xci = xc_info(cfg->bits.idcode))
+	    || cfg->reg[cfg->FLR_reg].int_v != xci->flr)
+		FAIL(EINVAL);
+	row_frames = xci->frames_per_row + PADDING_FRAMES_PER_ROW;
+	bram_data_words = (XC_BRAM_DATA_LEN(xci) + XC_IOB_DATA_LEN(xci))/2;
 
-	cfg->bits.len = (4*505 + 4*144) * 130 + 896*2;
+	cfg->bits.len = XC_BITS_LEN(xci);
 	cfg->bits.d = calloc(cfg->bits.len, 1 /* elsize */);
 	if (!cfg->bits.d) FAIL(ENOMEM);
 	cfg->auto_crc = 0;
@@ -1259,7 +1316,7 @@ static int read_bits(struct fpga_config* cfg, uint8_t* d, int len,
 					FAIL(EINVAL);
 				if (u16 == CMD_MFW) {
 					if (FAR_block != 0) FAIL(EINVAL);
-					MFW_src_off = FAR_pos(FAR_row, FAR_major, FAR_minor);
+					MFW_src_off = FAR_pos(xci, FAR_row, FAR_major, FAR_minor);
 					if (MFW_src_off == -1) FAIL(EINVAL);
 				}
 				src_off += 2;
@@ -1294,7 +1351,7 @@ static int read_bits(struct fpga_config* cfg, uint8_t* d, int len,
 				// The first MFWR will overwrite itself, so
 				// use memmove().
 				if (FAR_block != 0) FAIL(EINVAL);
-				offset_in_bits = FAR_pos(FAR_row, FAR_major, FAR_minor);
+				offset_in_bits = FAR_pos(xci, FAR_row, FAR_major, FAR_minor);
 				if (offset_in_bits == -1) FAIL(EINVAL);
 				memmove(&cfg->bits.d[offset_in_bits], &cfg->bits.d[MFW_src_off], 130);
 				   
@@ -1324,11 +1381,11 @@ static int read_bits(struct fpga_config* cfg, uint8_t* d, int len,
 		block0_words = 0;
 		if (!FAR_block) {
 
-			offset_in_bits = FAR_pos(FAR_row, FAR_major, FAR_minor);
+			offset_in_bits = FAR_pos(xci, FAR_row, FAR_major, FAR_minor);
 			if (offset_in_bits == -1) FAIL(EINVAL);
 			if (!FAR_row && !FAR_major && !FAR_minor
-			    && u32 > 4*(505+2)*65)
-				block0_words = 4*(505+2)*65;
+			    && u32 > xci->num_rows*row_frames*FRAME_SIZE/2)
+				block0_words = xci->num_rows*row_frames*FRAME_SIZE/2;
 			else {
 				block0_words = u32;
 				if (block0_words % 65) FAIL(EINVAL);
@@ -1350,7 +1407,7 @@ static int read_bits(struct fpga_config* cfg, uint8_t* d, int len,
 						break;
 				}
 				if (!FAR_major && !FAR_minor
-				    && (i%507 == 505)) {
+				    && (i%row_frames == xci->frames_per_row)) {
 					for (j = 0; j < 2*130; j++) {
 						if (d[src_off+i*130+j]
 						    != 0xFF) FAIL(EINVAL);
@@ -1365,14 +1422,13 @@ static int read_bits(struct fpga_config* cfg, uint8_t* d, int len,
 			}
 		}
 		if (u32 - block0_words > 0) {
-			int bram_data_words = 4*144*65 + 896;
 			if (u32 - block0_words != bram_data_words + 1) FAIL(EINVAL);
-			offset_in_bits = BRAM_DATA_START;
+			offset_in_bits = XC_BRAM_DATA_START(xci);
 			memcpy(&cfg->bits.d[offset_in_bits],
 				&d[src_off+block0_words*2],
 				bram_data_words*2);
-			u16 = __be16_to_cpu(*(uint16_t*)&d[
-			  (src_off+block0_words+bram_data_words)*2]);
+			u16 = __be16_to_cpu(*(uint16_t*)&d[src_off
+			  + (block0_words+bram_data_words)*2]);
 			if (u16) FAIL(EINVAL);
 		}
 		src_off += 2*u32;
@@ -1389,6 +1445,79 @@ success:
 	return 0;
 }
 
+//
+// Walks the packets after the sync word at inpos and compares the
+// CRC register writes and the auto-crc after FDRI against the computed
+// CRC. The default value is accepted as long as COR1 has CRC_BYPASS.
+// Mismatches are counted in cfg->crc_errors.
+//
+static int check_crc(struct fpga_config* cfg, uint8_t* d, int len,
+	int inpos)
+{
+	struct xc6_crc* crc;
+	int curpos, type, opcode, reg, num_words, bypass, rc;
+	uint32_t u32, crc_off;
+	uint16_t u16;
+
+	crc = malloc(sizeof(*crc));
+	if (!crc) FAIL(ENOMEM);
+	crc_init(crc);
+	bypass = 0;
+	curpos = inpos;
+	while (curpos + 2 <= len) {
+		u16 = __be16_to_cpu(*(uint16_t*)&d[curpos]);
+		curpos += 2;
+		type = (u16 & 0xE000) >> 13;
+		opcode = (u16 & 0x1800) >> 11;
+		reg = (u16 & 0x07E0) >> 5;
+		num_words = u16 & 0x001F;
+		if (opcode == PACKET_HDR_OPCODE_NOOP)
+			continue;
+		if (type == PACKET_TYPE_2) {
+			if (curpos + 4 > len) break;
+			num_words = __be32_to_cpu(*(uint32_t*)&d[curpos]);
+			curpos += 4;
+		} else if (type != PACKET_TYPE_1)
+			break;
+		if (num_words < 0 || num_words > (len - curpos)/2) break;
+		if (opcode != PACKET_HDR_OPCODE_WRITE) {
+			curpos += num_words*2;
+			continue;
+		}
+		if (reg == CRC) {
+			if (num_words != 2) break;
+			crc_off = curpos;
+			u32 = __be32_to_cpu(*(uint32_t*)&d[curpos]);
+			curpos += 4;
+		} else {
+			crc_add_words(crc, reg, &d[curpos], num_words*2);
+			if (reg == COR1 && num_words == 1)
+				bypass = d[curpos+1] & COR1_CRC_BYPASS;
+			if (reg == CMD && num_words == 1
+			    && d[curpos+1] == CMD_RCRC && !d[curpos])
+				crc->crc = 0;
+			curpos += num_words*2;
+			if (type != PACKET_TYPE_2 || reg != FDRI)
+				continue;
+			// auto-crc follows the FDRI data
+			if (curpos + 4 > len) break;
+			crc_off = curpos;
+			u32 = __be32_to_cpu(*(uint32_t*)&d[curpos]);
+			curpos += 4;
+		}
+		if (u32 == crc->crc
+		    || (bypass && u32 == DEFAULT_AUTO_CRC))
+			continue;
+		printf("#W 0x%x CRC 0x%X does not match computed 0x%X.\n",
+			crc_off, u32, crc->crc);
+		cfg->crc_errors++;
+	}
+	free(crc);
+	return 0;
+fail:
+	return rc;
+}
+
 static int parse_commands(struct fpga_config* cfg, uint8_t* d,
 	int len, int inpos)
 {
@@ -1426,6 +1555,8 @@ static int parse_commands(struct fpga_config* cfg, uint8_t* d,
 		fprintf(stderr, "#E Unexpected sync word 0x%x.\n", u32);
 		FAIL(EINVAL);
 	}
+	rc = check_crc(cfg, d, len, curpos);
+	if (rc) FAIL(rc);
 	first_FAR_off = -1;
 	while (curpos < len) {
 		// packet header: ug380, Configuration Packets (p88)
@@ -1494,9 +1625,9 @@ static int parse_commands(struct fpga_config* cfg, uint8_t* d,
 				__be32_to_cpu(*(uint32_t*)&d[u16_off+2]);
 			cfg->num_regs++;
 
-			if ((cfg->reg[cfg->idcode_reg].int_v == XC6SLX4
-			     || cfg->reg[cfg->idcode_reg].int_v == XC6SLX9)
-			    && cfg->reg[cfg->FLR_reg].int_v != 896)
+			if (xc_info(cfg->reg[cfg->idcode_reg].int_v)
+			    && cfg->reg[cfg->FLR_reg].int_v
+				!= xc_info(cfg->reg[cfg->idcode_reg].int_v)->flr)
 				printf("#W Unexpected FLR value %i on "
 					"idcode 0x%X.\n",
 					cfg->reg[cfg->FLR_reg].int_v,
@@ -1601,40 +1732,161 @@ fail:
 	return rc;
 }
 
-static int write_header_str(FILE* f, int code, const char* s)
+static int sink_writev(struct bit_sink* sink, const struct iovec* iov,
+	int iovcnt)
+{
+	int i, rc;
+
+	rc = (*sink->writev)(sink, iov, iovcnt);
+	if (rc) return rc;
+	for (i = 0; i < iovcnt; i++)
+		sink->len += iov[i].iov_len;
+	return 0;
+}
+
+static int sink_write(struct bit_sink* sink, const void* d, int len)
+{
+	struct iovec iov;
+
+	iov.iov_base = (void*) d;
+	iov.iov_len = len;
+	return sink_writev(sink, &iov, 1);
+}
+
+static int file_writev(struct bit_sink* sink, const struct iovec* iov,
+	int iovcnt)
+{
+	int i;
+
+	for (i = 0; i < iovcnt; i++) {
+		if (fwrite(iov[i].iov_base, /*size*/ 1, iov[i].iov_len,
+				sink->f) != iov[i].iov_len)
+			return errno ? errno : EIO;
+	}
+	return 0;
+}
+
+static int fd_writev(struct bit_sink* sink, const struct iovec* iov,
+	int iovcnt)
+{
+	ssize_t n, written;
+	int i;
+
+	do {
+		written = writev(sink->fd, iov, iovcnt);
+	} while (written == -1 && errno == EINTR);
+	if (written == -1) return errno;
+
+	// finish short writes one buffer at a time
+	for (i = 0; i < iovcnt; i++) {
+		if (written >= iov[i].iov_len) {
+			written -= iov[i].iov_len;
+			continue;
+		}
+		while (written < iov[i].iov_len) {
+			n = write(sink->fd, (uint8_t*) iov[i].iov_base
+				+ written, iov[i].iov_len - written);
+			if (n == -1) {
+				if (errno == EINTR) continue;
+				return errno;
+			}
+			written += n;
+		}
+		written = 0;
+	}
+	return 0;
+}
+
+static int mem_writev(struct bit_sink* sink, const struct iovec* iov,
+	int iovcnt)
+{
+	void* new_buf;
+	int new_size, len, i;
+
+	len = sink->len;
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+	if (len > sink->buf_size) {
+		new_size = sink->buf_size ? sink->buf_size : 4096;
+		while (new_size < len)
+			new_size *= 2;
+		new_buf = realloc(sink->buf, new_size);
+		if (!new_buf) return ENOMEM;
+		sink->buf = new_buf;
+		sink->buf_size = new_size;
+	}
+	len = sink->len;
+	for (i = 0; i < iovcnt; i++) {
+		memcpy(&sink->buf[len], iov[i].iov_base, iov[i].iov_len);
+		len += iov[i].iov_len;
+	}
+	return 0;
+}
+
+// counts the bytes only, to compute the length field up front
+static int count_writev(struct bit_sink* sink, const struct iovec* iov,
+	int iovcnt)
+{
+	return 0;
+}
+
+void sink_init_file(struct bit_sink* sink, FILE* f)
+{
+	memset(sink, 0, sizeof(*sink));
+	sink->writev = file_writev;
+	sink->f = f;
+}
+
+void sink_init_fd(struct bit_sink* sink, int fd)
+{
+	memset(sink, 0, sizeof(*sink));
+	sink->writev = fd_writev;
+	sink->fd = fd;
+}
+
+void sink_init_mem(struct bit_sink* sink)
+{
+	memset(sink, 0, sizeof(*sink));
+	sink->writev = mem_writev;
+}
+
+static int write_header_str(struct bit_sink* sink, int code, const char* s)
 {
 	uint16_t be16_len;
-	int s_len, nwritten, rc;
+	uint8_t u8;
+	int s_len, rc;
 
 	// format:  8-bit code 'a' - 'd'
 	//         16-bit string len, including '\0'
 	//         z-terminated string
-	if (fputc(code, f) == EOF) FAIL(errno);
+	u8 = code;
+	rc = sink_write(sink, &u8, sizeof(u8));
+	if (rc) FAIL(rc);
 	s_len = strlen(s)+1;
 	be16_len = __cpu_to_be16(s_len);
-	nwritten = fwrite(&be16_len, /*size*/ 1, sizeof(be16_len), f);
-	if (nwritten != sizeof(be16_len)) FAIL(errno);
-	nwritten = fwrite(s, /*size*/ 1, s_len, f);
-	if (nwritten != s_len) FAIL(errno);
+	rc = sink_write(sink, &be16_len, sizeof(be16_len));
+	if (rc) FAIL(rc);
+	rc = sink_write(sink, s, s_len);
+	if (rc) FAIL(rc);
 	return 0;
 fail:
 	return rc;
 }
 
-static int write_header(FILE* f, const char* str_a, const char* str_b, const char* str_c, const char* str_d)
+static int write_header(struct bit_sink* sink, const char* str_a, const char* str_b, const char* str_c, const char* str_d)
 {
-	int nwritten, rc;
+	int rc;
 
-	nwritten = fwrite(s_bit_bof, /*size*/ 1, sizeof(s_bit_bof), f);
-	if (nwritten != sizeof(s_bit_bof)) FAIL(errno);
+	rc = sink_write(sink, s_bit_bof, sizeof(s_bit_bof));
+	if (rc) FAIL(rc);
 
-	rc = write_header_str(f, 'a', str_a);
+	rc = write_header_str(sink, 'a', str_a);
 	if (rc) FAIL(rc);
-	rc = write_header_str(f, 'b', str_b);
+	rc = write_header_str(sink, 'b', str_b);
 	if (rc) FAIL(rc);
-	rc = write_header_str(f, 'c', str_c);
+	rc = write_header_str(sink, 'c', str_c);
 	if (rc) FAIL(rc);
-	rc = write_header_str(f, 'd', str_d);
+	rc = write_header_str(sink, 'd', str_d);
 	if (rc) FAIL(rc);
 	return 0;
 fail:
@@ -1644,10 +1896,10 @@ fail:
 static struct fpga_config_reg_rw s_defregs_before_bits[] =
 	{{ CMD,		.int_v = CMD_RCRC },
 	 { REG_NOOP },
-	 { FLR,		.int_v = 896 }, 
+	 { FLR }, // from xc_info
 	 { COR1,	.int_v = COR1_DEF | COR1_CRC_BYPASS }, 
 	 { COR2,	.int_v = COR2_DEF }, 
-	 { IDCODE,	.int_v = XC6SLX9 }, 
+	 { IDCODE }, // from xc_info
 	 { MASK,	.int_v = MASK_DEF }, 
 	 { CTL,		.int_v = CTL_DEF }, 
 	 { REG_NOOP }, { REG_NOOP }, { REG_NOOP }, { REG_NOOP },
@@ -1688,22 +1940,23 @@ static struct fpga_config_reg_rw s_defregs_after_bits[] =
 	 { CMD,		.int_v = CMD_START },
 	 { MASK,	.int_v = MASK_DEF | MASK_SECURITY }, 
 	 { CTL,		.int_v = CTL_DEF }, 
-	 { CRC,		.int_v = DEFAULT_AUTO_CRC },
+	 { CRC },	// computed
 	 { CMD,		.int_v = CMD_DESYNC },
 	 { REG_NOOP }, { REG_NOOP }, { REG_NOOP }, { REG_NOOP },
 	 { REG_NOOP }, { REG_NOOP }, { REG_NOOP }, { REG_NOOP },
 	 { REG_NOOP }, { REG_NOOP }, { REG_NOOP }, { REG_NOOP },
 	 { REG_NOOP }, { REG_NOOP }};
 
-static int write_reg_action(FILE* f, const struct fpga_config_reg_rw* reg)
+static int write_reg_action(struct bit_sink* sink, const struct fpga_config_reg_rw* reg,
+	struct xc6_crc* crc)
 {
 	uint16_t u16;
-	int nwritten, i, rc;
+	int i, rc;
 
 	if (reg->reg == REG_NOOP) {
 		u16 = __cpu_to_be16(1 << PACKET_HDR_TYPE_S);
-		nwritten = fwrite(&u16, /*size*/ 1, sizeof(u16), f);
-		if (nwritten != sizeof(u16)) FAIL(errno);
+		rc = sink_write(sink, &u16, sizeof(u16));
+		if (rc) FAIL(rc);
 		return 0;
 	}
 	if (reg->reg == MFWR) {
@@ -1713,13 +1966,14 @@ static int write_reg_action(FILE* f, const struct fpga_config_reg_rw* reg)
 		u16 |= 4; // four 16-bit words
 
 		u16 = __cpu_to_be16(u16);
-		nwritten = fwrite(&u16, /*size*/ 1, sizeof(u16), f);
-		if (nwritten != sizeof(u16)) FAIL(errno);
+		rc = sink_write(sink, &u16, sizeof(u16));
+		if (rc) FAIL(rc);
 
 		u16 = 0;
 		for (i = 0; i < 4; i++) {
-			nwritten = fwrite(&u16, /*size*/ 1, sizeof(u16), f);
-			if (nwritten != sizeof(u16)) FAIL(errno);
+			crc_add(crc, MFWR, 0);
+			rc = sink_write(sink, &u16, sizeof(u16));
+			if (rc) FAIL(rc);
 		}
 		return 0;
 	}
@@ -1730,19 +1984,21 @@ static int write_reg_action(FILE* f, const struct fpga_config_reg_rw* reg)
 		u16 |= 2; // two 16-bit words
 
 		u16 = __cpu_to_be16(u16);
-		nwritten = fwrite(&u16, /*size*/ 1, sizeof(u16), f);
-		if (nwritten != sizeof(u16)) FAIL(errno);
+		rc = sink_write(sink, &u16, sizeof(u16));
+		if (rc) FAIL(rc);
 
 		if (reg->far[FAR_MAJ_O] > 0xFFFF
 		    || reg->far[FAR_MIN_O] > 0xFFF) FAIL(EINVAL);
+		crc_add(crc, FAR_MAJ, reg->far[FAR_MAJ_O]);
+		crc_add(crc, FAR_MAJ, reg->far[FAR_MIN_O]);
 
 		u16 = __cpu_to_be16(reg->far[FAR_MAJ_O]);
-		nwritten = fwrite(&u16, /*size*/ 1, sizeof(u16), f);
-		if (nwritten != sizeof(u16)) FAIL(errno);
+		rc = sink_write(sink, &u16, sizeof(u16));
+		if (rc) FAIL(rc);
 
 		u16 = __cpu_to_be16(reg->far[FAR_MIN_O]);
-		nwritten = fwrite(&u16, /*size*/ 1, sizeof(u16), f);
-		if (nwritten != sizeof(u16)) FAIL(errno);
+		rc = sink_write(sink, &u16, sizeof(u16));
+		if (rc) FAIL(rc);
 		return 0;
 	}
 	if (reg->reg == CRC || reg->reg == IDCODE || reg->reg == EXP_SIGN) {
@@ -1754,12 +2010,19 @@ static int write_reg_action(FILE* f, const struct fpga_config_reg_rw* reg)
 		u16 |= 2; // two 16-bit words
 
 		u16 = __cpu_to_be16(u16);
-		nwritten = fwrite(&u16, /*size*/ 1, sizeof(u16), f);
-		if (nwritten != sizeof(u16)) FAIL(errno);
+		rc = sink_write(sink, &u16, sizeof(u16));
+		if (rc) FAIL(rc);
 
-		u32 = __cpu_to_be32(reg->int_v);
-		nwritten = fwrite(&u32, /*size*/ 1, sizeof(u32), f);
-		if (nwritten != sizeof(u32)) FAIL(errno);
+		if (reg->reg == CRC)
+			u32 = crc->crc;
+		else {
+			u32 = reg->int_v;
+			crc_add(crc, reg->reg, u32 >> 16);
+			crc_add(crc, reg->reg, u32 & 0xFFFF);
+		}
+		u32 = __cpu_to_be32(u32);
+		rc = sink_write(sink, &u32, sizeof(u32));
+		if (rc) FAIL(rc);
 		return 0;
 	}
 	static const int t1_oneword_regs[] =
@@ -1780,33 +2043,51 @@ static int write_reg_action(FILE* f, const struct fpga_config_reg_rw* reg)
 	u16 |= 1; // one word
 
 	u16 = __cpu_to_be16(u16);
-	nwritten = fwrite(&u16, /*size*/ 1, sizeof(u16), f);
-	if (nwritten != sizeof(u16)) FAIL(errno);
+	rc = sink_write(sink, &u16, sizeof(u16));
+	if (rc) FAIL(rc);
 
 	if (reg->int_v > 0xFFFF) FAIL(EINVAL);
+	crc_add(crc, reg->reg, reg->int_v);
+	if (reg->reg == CMD && reg->int_v == CMD_RCRC)
+		crc->crc = 0;
 	u16 = __cpu_to_be16(reg->int_v);
-	nwritten = fwrite(&u16, /*size*/ 1, sizeof(u16), f);
-	if (nwritten != sizeof(u16)) FAIL(errno);
+	rc = sink_write(sink, &u16, sizeof(u16));
+	if (rc) FAIL(rc);
 
 	return 0;
 fail:
 	return rc;
 }
 
-static int write_bits(FILE* f, struct fpga_model* model)
+// Writes regs, taking the FLR and IDCODE values from xci.
+static int write_part_regs(struct bit_sink* sink,
+	const struct fpga_config_reg_rw* regs, int num_regs,
+	const struct xc_info* xci, struct xc6_crc* crc)
 {
-	struct fpga_bits bits;
-	uint16_t u16;
-	uint32_t u32;
-	int nwritten, i, j, rc;
-	char padding_frame[FRAME_SIZE];
+	struct fpga_config_reg_rw reg;
+	int i, rc;
 
-	bits.len = IOB_DATA_START + IOB_DATA_LEN;
-	bits.d = calloc(bits.len, /*elsize*/ 1);
-	if (!bits.d) FAIL(ENOMEM);
+	for (i = 0; i < num_regs; i++) {
+		reg = regs[i];
+		if (reg.reg == FLR)
+			reg.int_v = xci->flr;
+		else if (reg.reg == IDCODE)
+			reg.int_v = xci->idcode;
+		rc = write_reg_action(sink, &reg, crc);
+		if (rc) return rc;
+	}
+	return 0;
+}
 
-	rc = write_model(&bits, model);
-	if (rc) FAIL(rc);
+static int write_bits(struct bit_sink* sink, const struct fpga_bits* bits,
+	struct xc6_crc* crc)
+{
+	const struct xc_info* xci = xc_info(bits->idcode);
+	uint8_t padding_frames[PADDING_FRAMES_PER_ROW*FRAME_SIZE];
+	struct iovec iov[2];
+	uint16_t u16;
+	uint32_t u32;
+	int i, rc;
 
 	u16 = PACKET_TYPE_2 << PACKET_HDR_TYPE_S;
 	u16 |= PACKET_HDR_OPCODE_WRITE << PACKET_HDR_OPCODE_S;
@@ -1814,52 +2095,133 @@ static int write_bits(FILE* f, struct fpga_model* model)
 	u16 |= 0; // zero 16-bit words
 
 	u16 = __cpu_to_be16(u16);
-	nwritten = fwrite(&u16, /*size*/ 1, sizeof(u16), f);
-	if (nwritten != sizeof(u16)) FAIL(errno);
+	rc = sink_write(sink, &u16, sizeof(u16));
+	if (rc) FAIL(rc);
 
-	u32 = (FRAMES_DATA_LEN + NUM_ROWS*PADDING_FRAMES_PER_ROW*FRAME_SIZE
-		+ BRAM_DATA_LEN + IOB_DATA_LEN)/2;
+	u32 = (XC_BITS_LEN(xci)
+		+ xci->num_rows*PADDING_FRAMES_PER_ROW*FRAME_SIZE)/2;
 	u32++; // there is one extra 16-bit 0x0000 padding at the end
 	u32 = __cpu_to_be32(u32);
-	nwritten = fwrite(&u32, /*size*/ 1, sizeof(u32), f);
-	if (nwritten != sizeof(u32)) FAIL(errno);
+	rc = sink_write(sink, &u32, sizeof(u32));
+	if (rc) FAIL(rc);
 
-	// initialize padding frame to 0xFF
-	for (i = 0; i < FRAME_SIZE; i++)
-		padding_frame[i] = 0xFF;
+	memset(padding_frames, 0xFF, sizeof(padding_frames));
 
 	// write rows with padding frames
-	for (i = 0; i < NUM_ROWS; i++) {
-		nwritten = fwrite(&bits.d[i*FRAMES_PER_ROW*FRAME_SIZE],
-			/*size*/ 1, FRAMES_PER_ROW*FRAME_SIZE, f);
-		if (nwritten != FRAMES_PER_ROW*FRAME_SIZE) FAIL(errno);
-		for (j = 0; j < PADDING_FRAMES_PER_ROW; j++) {
-			nwritten = fwrite(padding_frame,
-				/*size*/ 1, FRAME_SIZE, f);
-			if (nwritten != FRAME_SIZE) FAIL(errno);
-		}
+	iov[1].iov_base = padding_frames;
+	iov[1].iov_len = sizeof(padding_frames);
+	for (i = 0; i < xci->num_rows; i++) {
+		iov[0].iov_base = &bits->d[i*xci->frames_per_row*FRAME_SIZE];
+		iov[0].iov_len = xci->frames_per_row*FRAME_SIZE;
+		crc_add_words(crc, FDRI, iov[0].iov_base, iov[0].iov_len);
+		crc_add_words(crc, FDRI, padding_frames, sizeof(padding_frames));
+		rc = sink_writev(sink, iov, 2);
+		if (rc) FAIL(rc);
 	}
 
-	// write bram data
-	nwritten = fwrite(&bits.d[BRAM_DATA_START],
-		/*size*/ 1, BRAM_DATA_LEN, f);
-	if (nwritten != BRAM_DATA_LEN) FAIL(errno);
+	// write bram and IOB data, plus an extra 0x0000 padding at
+	// the end of the FDRI block
+	u16 = 0;
+	iov[0].iov_base = &bits->d[XC_BRAM_DATA_START(xci)];
+	iov[0].iov_len = XC_BRAM_DATA_LEN(xci) + XC_IOB_DATA_LEN(xci);
+	iov[1].iov_base = &u16;
+	iov[1].iov_len = sizeof(u16);
+	crc_add_words(crc, FDRI, iov[0].iov_base, iov[0].iov_len);
+	crc_add(crc, FDRI, u16);
+	rc = sink_writev(sink, iov, 2);
+	if (rc) FAIL(rc);
 
-	// write IOB data
-	nwritten = fwrite(&bits.d[IOB_DATA_START],
-		/*size*/ 1, IOB_DATA_LEN, f);
-	if (nwritten != IOB_DATA_LEN) FAIL(errno);
+	u32 = __cpu_to_be32(crc->crc);
+	rc = sink_write(sink, &u32, sizeof(u32));
+	if (rc) FAIL(rc);
+	return 0;
+fail:
+	return rc;
+}
 
-	// write extra 0x0000 padding at end of FDRI block
-	u16 = 0;
-	nwritten = fwrite(&u16, /*size*/ 1, sizeof(u16), f);
-	if (nwritten != sizeof(u16)) FAIL(errno);
+//
+// Writes the header strings, the length of everything after it, and
+// the sync word, followed by the packets from write_body(). The body
+// is run once against a counting sink first so that the length is
+// known without seeking back, which allows writing to pipes.
+//
+static int write_stream(struct bit_sink* sink, const struct xc_info* xci,
+	int (*write_body)(struct bit_sink* sink, const void* priv),
+	const void* priv)
+{
+	struct bit_sink count;
+	uint8_t u8;
+	uint32_t u32;
+	int rc;
 
-	// todo: support real auto-crc calculation
-	u32 = DEFAULT_AUTO_CRC;
-	u32 = __cpu_to_be32(u32);
-	nwritten = fwrite(&u32, /*size*/ 1, sizeof(u32), f);
-	if (nwritten != sizeof(u32)) FAIL(errno);
+	memset(&count, 0, sizeof(count));
+	count.writev = count_writev;
+	rc = (*write_body)(&count, priv);
+	if (rc) FAIL(rc);
+
+	rc = write_header(sink, "fpgatools.fp;UserID=0xFFFFFFFF",
+		xci->part_str, "2010/05/26", "08:00:00");
+	if (rc) FAIL(rc);
+	u8 = 'e';
+	rc = sink_write(sink, &u8, sizeof(u8));
+	if (rc) FAIL(rc);
+	u32 = __cpu_to_be32(sizeof(s_0xFF_words) + sizeof(u32) + count.len);
+	rc = sink_write(sink, &u32, sizeof(u32));
+	if (rc) FAIL(rc);
+
+	rc = sink_write(sink, s_0xFF_words, sizeof(s_0xFF_words));
+	if (rc) FAIL(rc);
+
+	u32 = __cpu_to_be32(SYNC_WORD);
+	rc = sink_write(sink, &u32, sizeof(u32));
+	if (rc) FAIL(rc);
+
+	rc = (*write_body)(sink, priv);
+	if (rc) FAIL(rc);
+	return 0;
+fail:
+	return rc;
+}
+
+static int write_full_body(struct bit_sink* sink, const void* priv)
+{
+	const struct fpga_bits* bits = priv;
+	struct xc6_crc crc;
+	int i, rc;
+
+	crc_init(&crc);
+	rc = write_part_regs(sink, s_defregs_before_bits,
+		sizeof(s_defregs_before_bits)/sizeof(s_defregs_before_bits[0]),
+		xc_info(bits->idcode), &crc);
+	if (rc) FAIL(rc);
+	rc = write_bits(sink, bits, &crc);
+	if (rc) FAIL(rc);
+	for (i = 0; i < sizeof(s_defregs_after_bits)/sizeof(s_defregs_after_bits[0]); i++) {
+		rc = write_reg_action(sink, &s_defregs_after_bits[i], &crc);
+		if (rc) FAIL(rc);
+	}
+	return 0;
+fail:
+	return rc;
+}
+
+int write_bitstream(struct bit_sink* sink, struct fpga_model* model)
+{
+	const struct xc_info* xci;
+	struct fpga_bits bits;
+	int rc;
+
+	bits.d = 0;
+	if (!(xci = xc_info(model->idcode))) FAIL(EINVAL);
+	bits.idcode = model->idcode;
+	bits.len = XC_BITS_LEN(xci);
+	bits.d = calloc(bits.len, /*elsize*/ 1);
+	if (!bits.d) FAIL(ENOMEM);
+
+	rc = write_model(&bits, model);
+	if (rc) FAIL(rc);
+	rc = write_stream(sink, xci, write_full_body, &bits);
+	if (rc) FAIL(rc);
 
 	free(bits.d);
 	return 0;
@@ -1870,48 +2232,279 @@ fail:
 
 int write_bitfile(FILE* f, struct fpga_model* model)
 {
+	struct bit_sink sink;
+
+	sink_init_file(&sink, f);
+	return write_bitstream(&sink, model);
+}
+
+// Writes a type 2 FDRI packet with len bytes of d, followed by a 0xFF
+// padding frame (pad_frame) or a single 0x0000 word, and the auto-crc.
+static int write_fdri(struct bit_sink* sink, struct xc6_crc* crc, const uint8_t* d,
+	int len, int pad_frame)
+{
+	uint8_t padding[FRAME_SIZE];
+	struct iovec iov[2];
+	uint16_t u16;
 	uint32_t u32;
-	int len_to_eof_pos, eof_pos, nwritten, i, rc;
+	int pad_len, rc;
+
+	if (pad_frame) {
+		memset(padding, 0xFF, FRAME_SIZE);
+		pad_len = FRAME_SIZE;
+	} else {
+		memset(padding, 0, sizeof(u16));
+		pad_len = sizeof(u16);
+	}
+	u16 = PACKET_TYPE_2 << PACKET_HDR_TYPE_S;
+	u16 |= PACKET_HDR_OPCODE_WRITE << PACKET_HDR_OPCODE_S;
+	u16 |= FDRI << PACKET_HDR_REG_S;
+	u16 = __cpu_to_be16(u16);
+	rc = sink_write(sink, &u16, sizeof(u16));
+	if (rc) FAIL(rc);
 
-	rc = write_header(f, "fpgatools.fp;UserID=0xFFFFFFFF",
-		"6slx9tqg144", "2010/05/26", "08:00:00");
+	u32 = __cpu_to_be32((len + pad_len)/2);
+	rc = sink_write(sink, &u32, sizeof(u32));
 	if (rc) FAIL(rc);
-	if (fputc('e', f) == EOF) FAIL(errno);
-	if ((len_to_eof_pos = ftell(f)) == -1)
-		FAIL(errno);
-	u32 = 0;
-	nwritten = fwrite(&u32, /*size*/ 1, sizeof(u32), f);
-	if (nwritten != sizeof(u32)) FAIL(errno);
 
-	nwritten = fwrite(s_0xFF_words, /*size*/ 1, sizeof(s_0xFF_words), f);
-	if (nwritten != sizeof(s_0xFF_words)) FAIL(errno);
+	iov[0].iov_base = (void*) d;
+	iov[0].iov_len = len;
+	iov[1].iov_base = padding;
+	iov[1].iov_len = pad_len;
+	crc_add_words(crc, FDRI, d, len);
+	crc_add_words(crc, FDRI, padding, pad_len);
+	rc = sink_writev(sink, iov, 2);
+	if (rc) FAIL(rc);
 
-	u32 = __cpu_to_be32(SYNC_WORD);
-	nwritten = fwrite(&u32, /*size*/ 1, sizeof(u32), f);
-	if (nwritten != sizeof(u32)) FAIL(errno);
+	u32 = __cpu_to_be32(crc->crc);
+	rc = sink_write(sink, &u32, sizeof(u32));
+	if (rc) FAIL(rc);
+	return 0;
+fail:
+	return rc;
+}
 
-	for (i = 0; i < sizeof(s_defregs_before_bits)/sizeof(s_defregs_before_bits[0]); i++) {
-		rc = write_reg_action(f, &s_defregs_before_bits[i]);
-		if (rc) FAIL(rc);
+// frame is the index of a type 0 frame in bits
+static int write_frame_far(struct bit_sink* sink, struct xc6_crc* crc,
+	const struct xc_info* xci, int frame)
+{
+	struct fpga_config_reg_rw reg;
+	int row, major, minor;
+
+	row = frame / xci->frames_per_row;
+	minor = frame % xci->frames_per_row;
+	for (major = xci->num_majors-1; major > 0; major--) {
+		if (minor >= xci->major_framestart[major])
+			break;
+	}
+	minor -= xci->major_framestart[major];
+	reg.reg = FAR_MAJ;
+	reg.far[FAR_MAJ_O] = row << 8 | major;
+	reg.far[FAR_MIN_O] = minor;
+	return write_reg_action(sink, &reg, crc);
+}
+
+static int write_cmd(struct bit_sink* sink, struct xc6_crc* crc, int cmd)
+{
+	struct fpga_config_reg_rw reg;
+
+	reg.reg = CMD;
+	reg.int_v = cmd;
+	return write_reg_action(sink, &reg, crc);
+}
+
+static int write_noops(struct bit_sink* sink, struct xc6_crc* crc, int num)
+{
+	struct fpga_config_reg_rw reg;
+	int i, rc;
+
+	reg.reg = REG_NOOP;
+	for (i = 0; i < num; i++) {
+		rc = write_reg_action(sink, &reg, crc);
+		if (rc) return rc;
 	}
-	rc = write_bits(f, model);
+	return 0;
+}
+
+static uint32_t frame_hash(const uint8_t* d)
+{
+	uint32_t h;
+	int i;
+
+	h = 2166136261u; // fnv-1a
+	for (i = 0; i < FRAME_SIZE; i++)
+		h = (h ^ d[i]) * 16777619u;
+	return h;
+}
+
+struct partial_state
+{
+	struct fpga_bits bits;
+	// src_of[frame] is -2 for unchanged frames, -1 for the first
+	// frame with a given content, -3 if that first frame is copied
+	// to others with multi-frame writes, and otherwise the index of
+	// that first frame.
+	int* src_of;
+	int bram_dirty;
+};
+
+static int write_partial_body(struct bit_sink* sink, const void* priv)
+{
+	static const struct fpga_config_reg_rw partial_regs_before[] =
+		{{ CMD,		.int_v = CMD_RCRC },
+		 { REG_NOOP },
+		 { FLR },
+		 { IDCODE }};
+	const struct partial_state* ps = priv;
+	const struct xc_info* xci = xc_info(ps->bits.idcode);
+	const uint8_t* d = ps->bits.d;
+	struct xc6_crc crc;
+	struct fpga_config_reg_rw crc_reg = { CRC };
+	int num_frames, dup, i, j, rc;
+
+	num_frames = XC_NUM_FRAMES(xci);
+	crc_init(&crc);
+	rc = write_part_regs(sink, partial_regs_before,
+		sizeof(partial_regs_before)/sizeof(partial_regs_before[0]),
+		xci, &crc);
 	if (rc) FAIL(rc);
-	for (i = 0; i < sizeof(s_defregs_after_bits)/sizeof(s_defregs_after_bits[0]); i++) {
-		rc = write_reg_action(f, &s_defregs_after_bits[i]);
+
+	// Frames with a content that repeats are written once, then
+	// copied with multi-frame writes.
+	for (i = 0; i < num_frames; i++) {
+		if (ps->src_of[i] != -3) continue;
+		if ((rc = write_frame_far(sink, &crc, xci, i))) FAIL(rc);
+		if ((rc = write_cmd(sink, &crc, CMD_MFW))) FAIL(rc);
+		rc = write_fdri(sink, &crc, &d[i*FRAME_SIZE], FRAME_SIZE,
+			/*pad_frame*/ 1);
+		if (rc) FAIL(rc);
+		for (dup = i+1; dup < num_frames; dup++) {
+			struct fpga_config_reg_rw mfwr = { MFWR };
+
+			if (ps->src_of[dup] != i) continue;
+			if ((rc = write_frame_far(sink, &crc, xci, dup))) FAIL(rc);
+			if ((rc = write_reg_action(sink, &mfwr, &crc))) FAIL(rc);
+		}
+	}
+
+	// Remaining changed frames are written in runs of consecutive
+	// frames within a row, the FAR auto-increments.
+	for (i = 0; i < num_frames; i = j) {
+		if (ps->src_of[i] != -1) {
+			j = i+1;
+			continue;
+		}
+		for (j = i+1; j < num_frames && j % xci->frames_per_row
+			&& ps->src_of[j] == -1; j++);
+		if ((rc = write_frame_far(sink, &crc, xci, i))) FAIL(rc);
+		if ((rc = write_cmd(sink, &crc, CMD_WCFG))) FAIL(rc);
+		rc = write_fdri(sink, &crc, &d[i*FRAME_SIZE],
+			(j-i)*FRAME_SIZE, /*pad_frame*/ 1);
 		if (rc) FAIL(rc);
 	}
 
-	// write len to eof at offset len_to_eof_pos
-	if ((eof_pos = ftell(f)) == -1)
-		FAIL(errno);
-	if (fseek(f, len_to_eof_pos, SEEK_SET) == -1)
-		FAIL(errno);
-	u32 = __cpu_to_be32(eof_pos - len_to_eof_pos - sizeof(u32));
-	nwritten = fwrite(&u32, /*size*/ 1, sizeof(u32), f);
-	if (nwritten != sizeof(u32)) FAIL(errno);
-	if (fseek(f, eof_pos, SEEK_SET) == -1)
-		FAIL(errno);
+	// bram and iob data can only be written as one block
+	if (ps->bram_dirty) {
+		struct fpga_config_reg_rw far = { FAR_MAJ };
+
+		far.far[FAR_MAJ_O] = 1 << 12; // block 1
+		if ((rc = write_reg_action(sink, &far, &crc))) FAIL(rc);
+		if ((rc = write_cmd(sink, &crc, CMD_WCFG))) FAIL(rc);
+		rc = write_fdri(sink, &crc, &d[XC_BRAM_DATA_START(xci)],
+			XC_BITS_LEN(xci) - XC_BRAM_DATA_START(xci),
+			/*pad_frame*/ 0);
+		if (rc) FAIL(rc);
+	}
+
+	// No GRESTORE/START, the device keeps running.
+	if ((rc = write_noops(sink, &crc, 4))) FAIL(rc);
+	if ((rc = write_cmd(sink, &crc, CMD_LFRM))) FAIL(rc);
+	if ((rc = write_reg_action(sink, &crc_reg, &crc))) FAIL(rc);
+	if ((rc = write_cmd(sink, &crc, CMD_DESYNC))) FAIL(rc);
+	if ((rc = write_noops(sink, &crc, 16))) FAIL(rc);
+	return 0;
+fail:
+	return rc;
+}
+
+int write_partial_bitstream(struct bit_sink* sink, struct fpga_model* model,
+	const struct fpga_bits* base)
+{
+	const struct xc_info* xci;
+	struct partial_state ps;
+	int* hash_tbl;
+	int num_frames, hash_size, num_dirty, i, j, h, rc;
+
+	ps.bits.d = 0;
+	ps.src_of = 0;
+	hash_tbl = 0;
+	if (!(xci = xc_info(model->idcode))
+	    || xc_info(base->idcode) != xci
+	    || base->len < XC_BITS_LEN(xci))
+		FAIL(EINVAL);
+	num_frames = XC_NUM_FRAMES(xci);
+	// power of 2, at least twice the number of frames
+	for (hash_size = 1; hash_size < 2*num_frames; hash_size <<= 1);
+	ps.bits.idcode = model->idcode;
+	ps.bits.len = XC_BITS_LEN(xci);
+	ps.bits.d = calloc(ps.bits.len, /*elsize*/ 1);
+	ps.src_of = malloc(num_frames*sizeof(*ps.src_of));
+	hash_tbl = malloc(hash_size*sizeof(*hash_tbl));
+	if (!ps.bits.d || !ps.src_of || !hash_tbl) FAIL(ENOMEM);
+	rc = write_model(&ps.bits, model);
+	if (rc) FAIL(rc);
+
+	for (i = 0; i < hash_size; i++)
+		hash_tbl[i] = -1;
+	num_dirty = 0;
+	for (i = 0; i < num_frames; i++) {
+		if (!memcmp(&ps.bits.d[i*FRAME_SIZE], &base->d[i*FRAME_SIZE],
+				FRAME_SIZE)) {
+			ps.src_of[i] = -2;
+			continue;
+		}
+		num_dirty++;
+		ps.src_of[i] = -1;
+		h = frame_hash(&ps.bits.d[i*FRAME_SIZE]);
+		while (hash_tbl[h & (hash_size-1)] != -1) {
+			j = hash_tbl[h & (hash_size-1)];
+			if (!memcmp(&ps.bits.d[i*FRAME_SIZE],
+				    &ps.bits.d[j*FRAME_SIZE], FRAME_SIZE)) {
+				ps.src_of[i] = j;
+				ps.src_of[j] = -3;
+				break;
+			}
+			h++;
+		}
+		if (ps.src_of[i] == -1)
+			hash_tbl[h & (hash_size-1)] = i;
+	}
+	ps.bram_dirty = memcmp(&ps.bits.d[XC_BRAM_DATA_START(xci)],
+		&base->d[XC_BRAM_DATA_START(xci)],
+		XC_BITS_LEN(xci) - XC_BRAM_DATA_START(xci)) != 0;
+	// without any FDRI data the bitstream would not parse
+	if (!num_dirty && !ps.bram_dirty)
+		ps.src_of[0] = -1;
+
+	rc = write_stream(sink, xci, write_partial_body, &ps);
+	if (rc) FAIL(rc);
+
+	free(hash_tbl);
+	free(ps.src_of);
+	free(ps.bits.d);
 	return 0;
 fail:
+	free(hash_tbl);
+	free(ps.src_of);
+	free(ps.bits.d);
 	return rc;
 }
+
+int write_partial_bitfile(FILE* f, struct fpga_model* model,
+	const struct fpga_bits* base)
+{
+	struct bit_sink sink;
+
+	sink_init_file(&sink, f);
+	return write_partial_bitstream(&sink, model, base);
+}
@@ -434,7 +434,7 @@ str16_t fdev_logic_pinstr_i(struct fpga_model* model, pinw_idx_t idx, int ld1_ty
 	int str_i;
 
 	str_i = strarray_find(&model->str, fdev_logic_pinstr(idx, ld1_type));
-	if (OUT_OF_U16(str_i))
+	if (str_i < 0 || str_i > STRIDX_MAX)
 		{ HERE(); return STRIDX_NO_ENTRY; }
 	return str_i;
 }
@@ -1097,21 +1097,13 @@ int fpga_connpt_find(struct fpga_model* model, int y, int x,
 	int i;
 
 	tile = YX_TILE(model, y, x);
-	for (i = 0; i < tile->num_conn_point_names; i++) {
-		if (tile->conn_point_names[i*2+1] == name_i)
-			break;
-	}
-	if (i >= tile->num_conn_point_names)
+	i = connpt_lookup(tile, name_i);
+	if (i == -1)
 		{ HERE(); goto fail; }
-	if (num_dests) {
-		*num_dests = (i < tile->num_conn_point_names-1)
-			? tile->conn_point_names[(i+1)*2]
-				- tile->conn_point_names[i*2]
-			: tile->num_conn_point_dests
-				- tile->conn_point_names[i*2];
-	}
+	if (num_dests)
+		*num_dests = CONNPT_DESTS_END(tile, i) - CONNPT_DESTS_O(tile, i);
 	if (connpt_dests_o)
-		*connpt_dests_o = tile->conn_point_names[i*2];
+		*connpt_dests_o = CONNPT_DESTS_O(tile, i);
 	return i;
 fail:
 	return NO_CONN;
@@ -1128,34 +1120,44 @@ void fpga_conn_dest(struct fpga_model* model, int y, int x,
 		HERE();
 		return;
 	}
-	*dest_x = tile->conn_point_dests[connpt_dest_idx*3];
-	*dest_y = tile->conn_point_dests[connpt_dest_idx*3+1];
-	*str_i = tile->conn_point_dests[connpt_dest_idx*3+2];
+	*dest_x = CONN_DEST_X(tile, connpt_dest_idx);
+	*dest_y = CONN_DEST_Y(tile, connpt_dest_idx);
+	*str_i = CONN_DEST_STR(tile, connpt_dest_idx);
 }
 
 int fpga_find_conn(struct fpga_model* model, int search_y, int search_x,
 	str16_t* pt, int target_y, int target_x, str16_t target_pt)
 {
 	struct fpga_tile* tile;
-	int i, j, dests_end;
+	int j, lo, hi, mid;
 
 	tile = YX_TILE(model, search_y, search_x);
-	for (i = 0; i < tile->num_conn_point_names; i++) {
-		dests_end = (i < tile->num_conn_point_names-1)
-			? tile->conn_point_names[(i+1)*2]
-			: tile->num_conn_point_dests;
-		for (j = tile->conn_point_names[i*2]; j < dests_end; j++) {
-			if (tile->conn_point_dests[j*3] == target_x
-			    && tile->conn_point_dests[j*3+1] == target_y
-			    && tile->conn_point_dests[j*3+2] == target_pt) {
-				*pt = tile->conn_point_names[i*2+1];
-				return 0;
-			}
-		}
+	// Linear scan over the packed dests, see control.h. An index by
+	// target would cost 2 bytes for each of the 2.2M dests.
+	for (j = 0; j < tile->num_conn_point_dests; j++) {
+		if (CONN_DEST_X(tile, j) == target_x
+		    && CONN_DEST_Y(tile, j) == target_y
+		    && CONN_DEST_STR(tile, j) == target_pt)
+			break;
+	}
+	if (j >= tile->num_conn_point_dests) {
+		*pt = STRIDX_NO_ENTRY;
+		return 0;
 	}
-	*pt = STRIDX_NO_ENTRY;
+	// The dests are grouped by connpt in connpt order, so
+	// the owner is the last connpt whose dests start at or
+	// before j.
+	lo = 0;
+	hi = tile->num_conn_point_names-1;
+	while (lo < hi) {
+		mid = (lo+hi+1)/2;
+		if (CONNPT_DESTS_O(tile, mid) <= j)
+			lo = mid;
+		else
+			hi = mid-1;
+	}
+	*pt = tile->conn_point_names[lo*2+1];
 	return 0;
-
 }
 
 swidx_t fpga_switch_first(struct fpga_model* model, int y, int x,
@@ -1167,6 +1169,11 @@ swidx_t fpga_switch_first(struct fpga_model* model, int y, int x,
 	// Finds the first switch either from or to the name given.
 	if (name_i == STRIDX_NO_ENTRY) { HERE(); return NO_SWITCH; }
 	tile = YX_TILE(model, y, x);
+	if (tile->sw_adj) {
+		connpt_o = connpt_lookup(tile, name_i);
+		return (connpt_o == -1) ? NO_SWITCH
+			: SW_ADJ_FIRST(tile, connpt_o, from_to);
+	}
 	for (i = 0; i < tile->num_switches; i++) {
 		connpt_o = SW_I(tile->switches[i], from_to);
 		if (tile->conn_point_names[connpt_o*2+1] == name_i)
@@ -1188,6 +1195,12 @@ static swidx_t fpga_switch_search(struct fpga_model* model, int y, int x,
 		if (connpt_o == NO_CONN) { HERE(); return NO_SWITCH; }
 	} else
 		connpt_o = SW_I(tile->switches[last], from_to);
+	if (tile->sw_adj) {
+		if (!search_beg)
+			return SW_ADJ_FIRST(tile, connpt_o, from_to);
+		if (SW_I(tile->switches[search_beg-1], from_to) == connpt_o)
+			return SW_ADJ_NEXT(tile, search_beg-1, from_to);
+	}
 	name_i = tile->conn_point_names[connpt_o*2+1];
 
 	for (i = search_beg; i < tile->num_switches; i++) {
@@ -1362,7 +1375,7 @@ fail:
 swidx_t fpga_switch_lookup(struct fpga_model* model, int y, int x,
 	str16_t from_str_i, str16_t to_str_i)
 {
-	int from_connpt_o, to_connpt_o, i;
+	int from_connpt_o, to_connpt_o, i, j;
 	struct fpga_tile* tile;
 
 	from_connpt_o = fpga_connpt_find(model, y, x, from_str_i,
@@ -1373,6 +1386,22 @@ swidx_t fpga_switch_lookup(struct fpga_model* model, int y, int x,
 		return NO_SWITCH;
 
 	tile = YX_TILE(model, y, x);
+	if (tile->sw_adj) {
+		// Walks the switches from from_connpt_o and the switches
+		// to to_connpt_o in step, so the cost depends on the
+		// shorter of the two lists.
+		i = SW_ADJ_FIRST(tile, from_connpt_o, SW_FROM);
+		j = SW_ADJ_FIRST(tile, to_connpt_o, SW_TO);
+		while (i != NO_SWITCH && j != NO_SWITCH) {
+			if (SW_TO_I(tile->switches[i]) == to_connpt_o)
+				return i;
+			if (SW_FROM_I(tile->switches[j]) == from_connpt_o)
+				return j;
+			i = SW_ADJ_NEXT(tile, i, SW_FROM);
+			j = SW_ADJ_NEXT(tile, j, SW_TO);
+		}
+		return NO_SWITCH;
+	}
 	for (i = 0; i < tile->num_switches; i++) {
 		if (SW_FROM_I(tile->switches[i]) == from_connpt_o
 		    && SW_TO_I(tile->switches[i]) == to_connpt_o)
@@ -1452,13 +1481,18 @@ int fpga_switch_is_bidir(struct fpga_model* model, int y, int x,
 int fpga_switch_is_used(struct fpga_model* model, int y, int x,
 	swidx_t swidx)
 {
-	return (YX_TILE(model, y, x)->switches[swidx] & SWITCH_USED) != 0;
+	return SW_USED(YX_TILE(model, y, x), swidx);
 }
 
 void fpga_switch_enable(struct fpga_model* model, int y, int x,
 	swidx_t swidx)
 {
-	YX_TILE(model, y, x)->switches[swidx] |= SWITCH_USED;
+	uint32_t* word = &YX_TILE(model, y, x)->used_switches[swidx/32];
+
+	if (!(*word & (1u << (swidx%32)))) {
+		*word |= 1u << (swidx%32);
+		model->num_used_switches++;
+	}
 }
 
 int fpga_switch_set_enable(struct fpga_model* model, int y, int x,
@@ -1473,7 +1507,58 @@ int fpga_switch_set_enable(struct fpga_model* model, int y, int x,
 void fpga_switch_disable(struct fpga_model* model, int y, int x,
 	swidx_t swidx)
 {
-	YX_TILE(model, y, x)->switches[swidx] &= ~SWITCH_USED;
+	uint32_t* word = &YX_TILE(model, y, x)->used_switches[swidx/32];
+
+	if (*word & (1u << (swidx%32))) {
+		*word &= ~(1u << (swidx%32));
+		model->num_used_switches--;
+	}
+}
+
+swidx_t fpga_switch_used_first(struct fpga_model* model, int y, int x)
+{
+	return fpga_switch_used_next(model, y, x, NO_SWITCH);
+}
+
+swidx_t fpga_switch_used_next(struct fpga_model* model, int y, int x,
+	swidx_t last)
+{
+	struct fpga_tile* tile;
+	int word, num_words;
+	uint32_t bits;
+
+	tile = YX_TILE(model, y, x);
+	num_words = SW_USED_WORDS(tile->num_switches);
+	word = (last+1)/32;
+	if (word >= num_words)
+		return NO_SWITCH;
+	// bits past num_switches are never set
+	bits = tile->used_switches[word] & (~0u << ((last+1)%32));
+	while (!bits) {
+		if (++word >= num_words)
+			return NO_SWITCH;
+		bits = tile->used_switches[word];
+	}
+	return word*32 + __builtin_ctz(bits);
+}
+
+int fpga_switch_num_used(struct fpga_model* model, int y, int x)
+{
+	struct fpga_tile* tile;
+	int i, num_used;
+
+	if (!model->num_used_switches)
+		return 0;
+	tile = YX_TILE(model, y, x);
+	num_used = 0;
+	for (i = 0; i < SW_USED_WORDS(tile->num_switches); i++)
+		num_used += __builtin_popcount(tile->used_switches[i]);
+	return num_used;
+}
+
+int fpga_num_used_switches(struct fpga_model* model)
+{
+	return model->num_used_switches;
 }
 
 #define SW_BUF_SIZE	256
@@ -1803,7 +1888,8 @@ void destruct_sw_conns(struct sw_conns* conns)
 
 int fpga_switch_conns(struct sw_conns* conns)
 {
-	str16_t end_of_chain_str;
+	struct fpga_tile* tile;
+	int end_of_chain_o;
 
 	if (!conns->chain.set.len) { HERE(); goto internal_error; }
 
@@ -1812,16 +1898,16 @@ int fpga_switch_conns(struct sw_conns* conns)
 		fpga_switch_chain(&conns->chain);
 		if (conns->chain.set.len == 0)
 			return NO_CONN;
-		end_of_chain_str = fpga_switch_str_i(conns->chain.model,
-			conns->chain.y, conns->chain.x,
-			conns->chain.set.sw[conns->chain.set.len-1],
-			!conns->chain.from_to);
-		if (end_of_chain_str == STRIDX_NO_ENTRY)
-			{ HERE(); goto internal_error; }
+		// The connpt at the end of the chain is in the switch
+		// itself, its dests follow without any search.
+		tile = YX_TILE(conns->chain.model, conns->chain.y,
+			conns->chain.x);
+		end_of_chain_o = SW_I(tile->switches[conns->chain.set.sw[
+			conns->chain.set.len-1]], !conns->chain.from_to);
 		conns->dest_i = 0;
-		fpga_connpt_find(conns->chain.model, conns->chain.y,
-			conns->chain.x, end_of_chain_str,
-			&conns->connpt_dest_start, &conns->num_dests);
+		conns->connpt_dest_start = CONNPT_DESTS_O(tile, end_of_chain_o);
+		conns->num_dests = CONNPT_DESTS_END(tile, end_of_chain_o)
+			- conns->connpt_dest_start;
 		if (conns->num_dests)
 			break;
 	}
@@ -1985,6 +2071,7 @@ void printf_switch_to_rel_result(struct switch_to_rel* p)
 }
 
 #define NET_ALLOC_INCREMENT 64
+#define NET_EL_MIN_POOL 256
 
 static int fnet_useidx(struct fpga_model* model, net_idx_t new_idx)
 {
@@ -2001,7 +2088,7 @@ static int fnet_useidx(struct fpga_model* model, net_idx_t new_idx)
 	new_array_size = ((new_idx-1)/NET_ALLOC_INCREMENT+1)*NET_ALLOC_INCREMENT;
 	new_ptr = realloc(model->nets, new_array_size*sizeof(*model->nets));
 	if (!new_ptr) FAIL(ENOMEM);
-	// the memset will set the 'len' of each new net to 0
+	// the memset will set the 'len' and 'el' of each new net to 0
 	memset(new_ptr + model->nets_array_size*sizeof(*model->nets), 0,
 		(new_array_size - model->nets_array_size)*sizeof(*model->nets));
 
@@ -2012,6 +2099,76 @@ fail:
 	return rc;
 }
 
+// Copies the regions of all nets, in net order and without the
+// holes, into a new pool that has room for at least min_free more
+// elements.
+static int fnet_repack(struct fpga_model* model, int min_free)
+{
+	struct net_el* new_els;
+	int live, new_size, pos, i;
+
+	live = model->net_els_len - model->net_els_holes;
+	new_size = 2*(live + min_free);
+	if (new_size < NET_EL_MIN_POOL)
+		new_size = NET_EL_MIN_POOL;
+	new_els = malloc(new_size*sizeof(*new_els));
+	if (!new_els) return ENOMEM;
+	pos = 0;
+	for (i = 0; i < model->highest_used_net; i++) {
+		if (!model->nets[i].size)
+			continue;
+		memcpy(&new_els[pos], model->nets[i].el,
+			model->nets[i].len*sizeof(*new_els));
+		model->nets[i].el = &new_els[pos];
+		pos += model->nets[i].size;
+	}
+	free(model->net_els);
+	model->net_els = new_els;
+	model->net_els_size = new_size;
+	model->net_els_len = pos;
+	model->net_els_holes = 0;
+	return 0;
+}
+
+// Makes room for num_add more elements in net. A net whose region
+// is at the end of the pool grows in place, others move to the end
+// and leave a hole that is reclaimed by the next fnet_repack().
+// The new elements are not cleared, callers set all fields.
+static int fnet_reserve(struct fpga_model* model, struct fpga_net* net,
+	int num_add)
+{
+	int new_size, at_end, grow, rc;
+
+	if (net->len + num_add <= net->size)
+		return 0;
+	new_size = net->size ? net->size*2 : 4;
+	if (new_size < net->len + num_add)
+		new_size = net->len + num_add;
+	at_end = net->size
+		&& net->el + net->size == model->net_els + model->net_els_len;
+	grow = at_end ? new_size - net->size : new_size;
+	if (model->net_els_len + grow > model->net_els_size) {
+		rc = fnet_repack(model, new_size);
+		if (rc) FAIL(rc);
+		// after repacking, the last net with elements is at the end
+		at_end = net->size
+			&& net->el + net->size == model->net_els + model->net_els_len;
+		grow = at_end ? new_size - net->size : new_size;
+	}
+	if (!at_end) {
+		if (net->len)
+			memcpy(&model->net_els[model->net_els_len], net->el,
+				net->len*sizeof(*net->el));
+		model->net_els_holes += net->size;
+		net->el = &model->net_els[model->net_els_len];
+	}
+	model->net_els_len += grow;
+	net->size = new_size;
+	return 0;
+fail:
+	return rc;
+}
+
 int fnet_new(struct fpga_model* model, net_idx_t* new_idx)
 {
 	int rc;
@@ -2023,6 +2180,84 @@ int fnet_new(struct fpga_model* model, net_idx_t* new_idx)
 	return 0;
 }
 
+static struct net_tile* get_net_tile(struct fpga_model* model, int y, int x)
+{
+	if (!model->net_tiles) {
+		model->net_tiles = calloc(model->x_width*model->y_height,
+			sizeof(*model->net_tiles));
+		if (!model->net_tiles) return 0;
+	}
+	return &model->net_tiles[y*model->x_width + x];
+}
+
+// sw is the switch index, or -1 for a pin
+static int net_tile_add(struct fpga_model* model, int y, int x,
+	net_idx_t net_i, int sw)
+{
+	struct net_tile* nt;
+	void* new_ptr;
+	int new_size, i, rc;
+
+	nt = get_net_tile(model, y, x);
+	if (!nt) FAIL(ENOMEM);
+	for (i = nt->num_nets-1; i >= 0; i--) {
+		if (nt->nets[i] == net_i)
+			break;
+	}
+	if (i >= 0)
+		nt->num_el[i]++;
+	else {
+		if (nt->num_nets >= nt->nets_size) {
+			new_size = nt->nets_size ? nt->nets_size*2 : 4;
+			new_ptr = realloc(nt->nets, new_size*sizeof(*nt->nets));
+			if (!new_ptr) FAIL(ENOMEM);
+			nt->nets = new_ptr;
+			new_ptr = realloc(nt->num_el, new_size*sizeof(*nt->num_el));
+			if (!new_ptr) FAIL(ENOMEM);
+			nt->num_el = new_ptr;
+			nt->nets_size = new_size;
+		}
+		nt->nets[nt->num_nets] = net_i;
+		nt->num_el[nt->num_nets] = 1;
+		nt->num_nets++;
+	}
+	if (sw != -1) {
+		if (!nt->sw_net) {
+			nt->sw_net = calloc(YX_TILE(model, y, x)->num_switches,
+				sizeof(*nt->sw_net));
+			if (!nt->sw_net) FAIL(ENOMEM);
+		}
+		nt->sw_net[sw] = net_i;
+	}
+	return 0;
+fail:
+	return rc;
+}
+
+static void net_tile_remove(struct fpga_model* model, int y, int x,
+	net_idx_t net_i, int sw)
+{
+	struct net_tile* nt;
+	int i;
+
+	nt = get_net_tile(model, y, x);
+	if (!nt) { HERE(); return; }
+	if (sw != -1 && nt->sw_net)
+		nt->sw_net[sw] = NO_NET;
+	for (i = nt->num_nets-1; i >= 0; i--) {
+		if (nt->nets[i] == net_i)
+			break;
+	}
+	if (i < 0) { HERE(); return; }
+	if (--nt->num_el[i])
+		return;
+	memmove(&nt->nets[i], &nt->nets[i+1],
+		(nt->num_nets-i-1)*sizeof(*nt->nets));
+	memmove(&nt->num_el[i], &nt->num_el[i+1],
+		(nt->num_nets-i-1)*sizeof(*nt->num_el));
+	nt->num_nets--;
+}
+
 void fnet_delete(struct fpga_model* model, net_idx_t net_idx)
 {
 	struct fpga_net* net;
@@ -2030,17 +2265,35 @@ void fnet_delete(struct fpga_model* model, net_idx_t net_idx)
 
 	net = &model->nets[net_idx-1];
 	for (i = 0; i < net->len; i++) {
-		if (net->el[i].idx & NET_IDX_IS_PINW)
+		if (net->el[i].idx & NET_IDX_IS_PINW) {
+			net_tile_remove(model, net->el[i].y, net->el[i].x,
+				net_idx, -1);
 			continue;
+		}
 		if (!fpga_switch_is_used(model, net->el[i].y, net->el[i].x,
 			net->el[i].idx))
 			HERE();
 		fpga_switch_disable(model, net->el[i].y, net->el[i].x,
 			net->el[i].idx);
+		net_tile_remove(model, net->el[i].y, net->el[i].x,
+			net_idx, net->el[i].idx);
+	}
+	if (net->size) {
+		if (net->el + net->size == model->net_els + model->net_els_len)
+			model->net_els_len -= net->size;
+		else
+			model->net_els_holes += net->size;
 	}
-	model->nets[net_idx-1].len = 0;
+	net->len = 0;
+	net->size = 0;
+	net->el = 0;
 	if (model->highest_used_net == net_idx)
 		model->highest_used_net--;
+
+	if (model->net_els_holes > NET_EL_MIN_POOL
+	    && model->net_els_holes > model->net_els_len/2
+	    && fnet_repack(model, 0))
+		HERE();
 }
 
 int fnet_enum(struct fpga_model* model, net_idx_t last, net_idx_t* next)
@@ -2080,13 +2333,15 @@ int fnet_add_port(struct fpga_model* model, net_idx_t net_i,
 	if (rc) FAIL(rc);
 	
 	net = &model->nets[net_i-1];
-	if (net->len >= MAX_NET_LEN)
-		FAIL(EINVAL);
+	rc = fnet_reserve(model, net, 1);
+	if (rc) FAIL(rc);
 	net->el[net->len].y = y;
 	net->el[net->len].x = x;
 	net->el[net->len].idx = pinw_idx | NET_IDX_IS_PINW;
 	net->el[net->len].dev_idx = fpga_dev_idx(model, y, x, type, type_idx);
 	if (net->el[net->len].dev_idx == NO_DEV) FAIL(EINVAL);
+	rc = net_tile_add(model, y, x, net_i, -1);
+	if (rc) FAIL(rc);
 	net->len++;
 	return 0;
 fail:
@@ -2103,16 +2358,20 @@ int fnet_add_sw(struct fpga_model* model, net_idx_t net_i,
 	if (rc) FAIL(rc);
 
 	net = &model->nets[net_i-1];
-	if (net->len+num_sw > MAX_NET_LEN)
-		FAIL(EINVAL);
+	rc = fnet_reserve(model, net, num_sw);
+	if (rc) FAIL(rc);
 	for (i = 0; i < num_sw; i++) {
-		net->el[net->len].y = y;
-		net->el[net->len].x = x;
 		if (OUT_OF_U16(switches[i])) FAIL(EINVAL);
 		if (fpga_switch_is_used(model, y, x, switches[i]))
 			HERE();
 		fpga_switch_enable(model, y, x, switches[i]);
+		rc = net_tile_add(model, y, x, net_i, switches[i]);
+		if (rc) FAIL(rc);
+		// elements in the pool are not cleared, set all fields
+		net->el[net->len].y = y;
+		net->el[net->len].x = x;
 		net->el[net->len].idx = switches[i];
+		net->el[net->len].dev_idx = 0;
 		net->len++;
 	}
 	return 0;
@@ -2149,6 +2408,7 @@ int fnet_remove_sw(struct fpga_model* model, net_idx_t net_i,
 		if (!fpga_switch_is_used(model, y, x, switches[i]))
 			HERE();
 		fpga_switch_disable(model, y, x, switches[i]);
+		net_tile_remove(model, y, x, net_i, switches[i]);
 		if (net->len > j+1)
 			memmove(&net->el[j], &net->el[j+1],
 				(net->len-j-1)*sizeof(net->el[0]));
@@ -2161,10 +2421,50 @@ fail:
 
 void fnet_free_all(struct fpga_model* model)
 {
+	int i;
+
 	free(model->nets);
 	model->nets = 0;
 	model->nets_array_size = 0;
 	model->highest_used_net = 0;
+	free(model->net_els);
+	model->net_els = 0;
+	model->net_els_size = 0;
+	model->net_els_len = 0;
+	model->net_els_holes = 0;
+	if (model->net_tiles) {
+		for (i = 0; i < model->x_width*model->y_height; i++) {
+			free(model->net_tiles[i].nets);
+			free(model->net_tiles[i].num_el);
+			free(model->net_tiles[i].sw_net);
+		}
+		free(model->net_tiles);
+		model->net_tiles = 0;
+	}
+}
+
+const net_idx_t* fnet_tile_nets(struct fpga_model* model, int y, int x,
+	int* num_nets)
+{
+	struct net_tile* nt;
+
+	if (!model->net_tiles) {
+		*num_nets = 0;
+		return 0;
+	}
+	nt = &model->net_tiles[y*model->x_width + x];
+	*num_nets = nt->num_nets;
+	return nt->nets;
+}
+
+net_idx_t fnet_sw_net(struct fpga_model* model, int y, int x, swidx_t sw)
+{
+	struct net_tile* nt;
+
+	if (!model->net_tiles) return NO_NET;
+	nt = &model->net_tiles[y*model->x_width + x];
+	if (!nt->sw_net) return NO_NET;
+	return nt->sw_net[sw];
 }
 
 static void fprintf_inout_pin(FILE* f, struct fpga_model* model,
@@ -2220,41 +2520,20 @@ void fnet_printf(FILE* f, struct fpga_model* model, net_idx_t net_i)
 	}
 }
 
-int fnet_autoroute(struct fpga_model* model, net_idx_t net_i)
+// Routes the switches between one IOB and one logic pin along the
+// known ilogic/ologic paths.
+static int fnet_route_iob_logic(struct fpga_model* model, net_idx_t net_i,
+	int out_i, int in_i)
 {
 	struct fpga_net* net_p;
-	struct fpga_device* dev_p, *out_dev, *in_dev;
+	struct fpga_device* out_dev, *in_dev;
 	struct switch_to_yx switch_to;
 	struct sw_set logic_route_set, iologic_route_set;
 	struct switch_to_rel switch_to_rel;
-	int i, out_i, in_i, rc;
-
-	// todo: gnd and vcc nets are special and have no outpin
-	//       but lots of inpins
+	int rc;
 
 	net_p = fnet_get(model, net_i);
 	if (!net_p) FAIL(EINVAL);
-	out_i = -1;
-	in_i = -1;
-	for (i = 0; i < net_p->len; i++) {
-		if (!(net_p->el[i].idx & NET_IDX_IS_PINW)) {
-			// net already routed?
-			FAIL(EINVAL);
-		}
-		dev_p = FPGA_DEV(model, net_p->el[i].y,
-			net_p->el[i].x, net_p->el[i].dev_idx);
-		if ((net_p->el[i].idx & NET_IDX_MASK) < dev_p->num_pinw_in) {
-			// todo: right now we only support 1 inpin
-			if (in_i != -1) FAIL(ENOTSUP);
-			in_i = i;
-			continue;
-		}
-		if (out_i != -1) FAIL(EINVAL); // at most 1 outpin
-		out_i = i;
-	}
-	// todo: vcc and gnd have no outpin?
-	if (out_i == -1 || in_i == -1)
-		FAIL(EINVAL);
 	out_dev = FPGA_DEV(model, net_p->el[out_i].y,
 			net_p->el[out_i].x, net_p->el[out_i].dev_idx);
 	in_dev = FPGA_DEV(model, net_p->el[in_i].y,
@@ -2398,6 +2677,118 @@ fail:
 	return rc;
 }
 
+// Checks that net_i has pins but no switches, and returns whether it
+// is a single iob-logic connection that fnet_route_iob_logic() routes.
+static int autoroute_check(struct fpga_model* model, net_idx_t net_i,
+	int* out_i, int* in_i, int* iob_logic)
+{
+	struct fpga_net* net_p;
+	struct fpga_device* dev_p, *out_dev, *in_dev;
+	int i, num_in, rc;
+
+	// todo: gnd and vcc nets are special and have no outpin
+	//       but lots of inpins
+
+	net_p = fnet_get(model, net_i);
+	if (!net_p) FAIL(EINVAL);
+	*out_i = -1;
+	*in_i = -1;
+	num_in = 0;
+	for (i = 0; i < net_p->len; i++) {
+		if (!(net_p->el[i].idx & NET_IDX_IS_PINW)) {
+			// net already routed?
+			FAIL(EINVAL);
+		}
+		dev_p = FPGA_DEV(model, net_p->el[i].y,
+			net_p->el[i].x, net_p->el[i].dev_idx);
+		if ((net_p->el[i].idx & NET_IDX_MASK) < dev_p->num_pinw_in) {
+			*in_i = i;
+			num_in++;
+			continue;
+		}
+		if (*out_i != -1) FAIL(EINVAL); // at most 1 outpin
+		*out_i = i;
+	}
+	// todo: vcc and gnd have no outpin?
+	if (*out_i == -1 || *in_i == -1)
+		FAIL(EINVAL);
+	out_dev = FPGA_DEV(model, net_p->el[*out_i].y,
+			net_p->el[*out_i].x, net_p->el[*out_i].dev_idx);
+	in_dev = FPGA_DEV(model, net_p->el[*in_i].y,
+			net_p->el[*in_i].x, net_p->el[*in_i].dev_idx);
+	*iob_logic = num_in == 1
+	    && ((out_dev->type == DEV_IOB && in_dev->type == DEV_LOGIC)
+		|| (out_dev->type == DEV_LOGIC && in_dev->type == DEV_IOB));
+	return 0;
+fail:
+	return rc;
+}
+
+int fnet_autoroute(struct fpga_model* model, net_idx_t net_i)
+{
+	struct fpga_net* net_p;
+	struct froute route;
+	net_idx_t* nets;
+	net_idx_t last;
+	int i, out_i, in_i, iob_logic, num_nets, rc;
+
+	nets = 0;
+	if (net_i != NO_NET) {
+		rc = autoroute_check(model, net_i, &out_i, &in_i, &iob_logic);
+		if (rc) FAIL(rc);
+		if (iob_logic)
+			return fnet_route_iob_logic(model, net_i, out_i, in_i);
+		nets = &net_i;
+		num_nets = 1;
+	} else {
+		// all nets with pins but no switches yet
+		nets = malloc(model->highest_used_net * sizeof(*nets));
+		if (model->highest_used_net && !nets) FAIL(ENOMEM);
+		num_nets = 0;
+		last = NO_NET;
+		while (1) {
+			rc = fnet_enum(model, last, &last);
+			if (rc) FAIL(rc);
+			if (last == NO_NET) break;
+			net_p = fnet_get(model, last);
+			for (i = 0; i < net_p->len; i++) {
+				if (!(net_p->el[i].idx & NET_IDX_IS_PINW))
+					break;
+			}
+			if (i < net_p->len)
+				continue;
+			rc = autoroute_check(model, last, &out_i, &in_i,
+				&iob_logic);
+			if (rc) FAIL(rc);
+			if (iob_logic) {
+				rc = fnet_route_iob_logic(model, last,
+					out_i, in_i);
+				if (rc) FAIL(rc);
+				continue;
+			}
+			nets[num_nets++] = last;
+		}
+	}
+
+	// everything else goes through the general router, in one
+	// call so that the nets negotiate the wires they share
+	if (num_nets) {
+		memset(&route, 0, sizeof(route));
+		route.model = model;
+		route.nets = nets;
+		route.num_nets = num_nets;
+		rc = froute_nets(&route);
+		if (rc) FAIL(rc);
+	}
+	if (nets != &net_i)
+		free(nets);
+	return 0;
+fail:
+	if (nets != &net_i)
+		free(nets);
+	return rc;
+}
+
 int fnet_route_to_inpins(struct fpga_model* model, net_idx_t net_i,
 	const char* from)
 {
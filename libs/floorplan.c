@@ -6,6 +6,7 @@
 //
 
 #include <stdarg.h>
+#include <pthread.h>
 
 #include "model.h"
 #include "control.h"
@@ -956,11 +957,8 @@ int printf_ports(FILE* f, struct fpga_model* model)
 
 			first_port_printed = 0;
 			for (i = 0; i < tile->num_conn_point_names; i++) {
-				conn_point_dests_o = tile->conn_point_names[i*2];
-				if (i < tile->num_conn_point_names-1)
-					num_dests_for_this_conn_point = tile->conn_point_names[(i+1)*2] - conn_point_dests_o;
-				else
-					num_dests_for_this_conn_point = tile->num_conn_point_dests - conn_point_dests_o;
+				conn_point_dests_o = CONNPT_DESTS_O(tile, i);
+				num_dests_for_this_conn_point = CONNPT_DESTS_END(tile, i) - conn_point_dests_o;
 				if (num_dests_for_this_conn_point)
 					// ports is only for connection-less endpoints
 					continue;
@@ -987,7 +985,7 @@ int printf_conns(FILE* f, struct fpga_model* model)
 	struct fpga_tile* tile;
 	char tmp_line[512];
 	const char* conn_point_name_src, *other_tile_connpt_str;
-	uint16_t other_tile_connpt_str_i;
+	str16_t other_tile_connpt_str_i;
 	int x, y, i, j, k, conn_point_dests_o, num_dests_for_this_conn_point;
 	int other_tile_x, other_tile_y, first_conn_printed;
 
@@ -997,11 +995,8 @@ int printf_conns(FILE* f, struct fpga_model* model)
 
 			first_conn_printed = 0;
 			for (i = 0; i < tile->num_conn_point_names; i++) {
-				conn_point_dests_o = tile->conn_point_names[i*2];
-				if (i < tile->num_conn_point_names-1)
-					num_dests_for_this_conn_point = tile->conn_point_names[(i+1)*2] - conn_point_dests_o;
-				else
-					num_dests_for_this_conn_point = tile->num_conn_point_dests - conn_point_dests_o;
+				conn_point_dests_o = CONNPT_DESTS_O(tile, i);
+				num_dests_for_this_conn_point = CONNPT_DESTS_END(tile, i) - conn_point_dests_o;
 				if (!num_dests_for_this_conn_point)
 					continue;
 				conn_point_name_src = strarray_lookup(&model->str, tile->conn_point_names[i*2+1]);
@@ -1011,9 +1006,9 @@ int printf_conns(FILE* f, struct fpga_model* model)
 					continue;
 				}
 				for (j = 0; j < num_dests_for_this_conn_point; j++) {
-					other_tile_x = tile->conn_point_dests[(conn_point_dests_o+j)*3];
-					other_tile_y = tile->conn_point_dests[(conn_point_dests_o+j)*3+1];
-					other_tile_connpt_str_i = tile->conn_point_dests[(conn_point_dests_o+j)*3+2];
+					other_tile_x = CONN_DEST_X(tile, conn_point_dests_o+j);
+					other_tile_y = CONN_DEST_Y(tile, conn_point_dests_o+j);
+					other_tile_connpt_str_i = CONN_DEST_STR(tile, conn_point_dests_o+j);
 
 					other_tile_connpt_str = strarray_lookup(&model->str, other_tile_connpt_str_i);
 					if (!other_tile_connpt_str) {
@@ -1077,144 +1072,193 @@ fail:
 	return rc;
 }
 
-static int coord(const char* s, int start, int* end, int* y, int* x)
+//
+// read_floorplan() maps or reads the whole file and parses it in two
+// passes. The first pass splits the text into lines and resolves the
+// net lines into records - wire names are found in model->str and
+// switches looked up in their tile. Large files are split into chunks
+// at line starts, one chunk per thread. The second pass applies the
+// records and dev lines to the model in file order, so the result and
+// the order of error messages do not depend on the number of threads.
+//
+
+#define FP_MAX_THREADS		64
+#define FP_MIN_CHUNK		(256*1024) // bytes per thread, at least
+#define FP_RECS_INCREMENT	1024
+
+enum fp_rec_type { FP_REC_ERR = 1, FP_REC_SW, FP_REC_PORT, FP_REC_DEV };
+
+struct fp_rec
+{
+	enum fp_rec_type type;
+	int line_o, line_len; // the line in the file, without '\n'
+	int line_no; // 0-based, within the chunk
+	int word_end; // FP_REC_DEV: end of the 'dev' keyword
+	net_idx_t net_i;
+	int y, x;
+	union {
+		const char* err; // FP_REC_ERR
+		swidx_t sw; // FP_REC_SW
+		struct {
+			enum fpgadev_type type;
+			dev_type_idx_t type_idx;
+			pinw_idx_t pinw_idx;
+		} port; // FP_REC_PORT
+	} u;
+};
+
+struct fp_chunk
+{
+	struct fpga_model* model;
+	const char* d;
+	int start, end; // byte offsets into d, end is exclusive
+	int num_lines;
+	struct fp_rec* recs;
+	int num_recs;
+	int rc;
+};
+
+static void fp_error(int line_no, const char* fmt, ...)
 {
-	int y_beg, y_end, x_beg, x_end, rc;
+	va_list list;
+
+	fprintf(stderr, "#E floorplan line %i: ", line_no);
+	va_start(list, fmt);
+	vfprintf(stderr, fmt, list);
+	va_end(list);
+	fprintf(stderr, "\n");
+}
 
-	next_word(s, start, &y_beg, &y_end);
-	next_word(s, y_end, &x_beg, &x_end);
+// Same as next_word(), but stops at len instead of 0-termination.
+static void line_word(const char* s, int len, int start, int* beg, int* end)
+{
+	int i = start;
+	while (i < len && (s[i] == ' ' || s[i] == '\t' || s[i] == '\r')) i++;
+	*beg = i;
+	while (i < len && s[i] != ' ' && s[i] != '\t' && s[i] != '\r') i++;
+	*end = i;
+}
+
+static int coord(struct fpga_model* model, const char* s, int len,
+	int start, int* end, int* y, int* x)
+{
+	int y_beg, y_end, x_beg, x_end;
+
+	line_word(s, len, start, &y_beg, &y_end);
+	line_word(s, len, y_end, &x_beg, &x_end);
 	if (y_end < y_beg+2 || x_end < x_beg+2
 	    || s[y_beg] != 'y' || s[x_beg] != 'x'
 	    || !all_digits(&s[y_beg+1], y_end-y_beg-1)
-	    || !all_digits(&s[x_beg+1], x_end-x_beg-1)) {
-		FAIL(EINVAL);
-	}
+	    || !all_digits(&s[x_beg+1], x_end-x_beg-1))
+		return EINVAL;
 	*y = to_i(&s[y_beg+1], y_end-y_beg-1);
 	*x = to_i(&s[x_beg+1], x_end-x_beg-1);
+	if (*y >= model->y_height || *x >= model->x_width)
+		return EINVAL;
 	*end = x_end;
 	return 0;
-fail:
-	return rc;
 }
 
-static void read_net_line(struct fpga_model* model, const char* line, int start)
+// Returns 0 with rec filled in, or an error message.
+static const char* parse_net_line(struct fpga_model* model,
+	const char* line, int len, int start, struct fp_rec* rec)
 {
-	int coord_end, y_coord, x_coord;
-	int from_beg, from_end, from_str_i;
+	int coord_end, from_beg, from_end, from_str_i;
 	int direction_beg, direction_end, is_bidir;
 	int to_beg, to_end, to_str_i;
 	int net_idx_beg, net_idx_end, el_type_beg, el_type_end;
 	int dev_str_beg, dev_str_end, dev_type_idx_str_beg, dev_type_idx_str_end;
 	int pin_str_beg, pin_str_end, pin_name_beg, pin_name_end;
-	enum fpgadev_type dev_type;
-	char buf[1024];
-	net_idx_t net_idx;
-	pinw_idx_t pinw_idx;
-	int sw_is_bidir;
 
 	// net lines will be one of the following three types:
 	// in-port:  net 1 in y68 x13 LOGIC 1 pin D3
 	// out-port: net 1 out y72 x12 IOB 0 pin I
 	// switch:   net 1 sw y72 x12 BIOB_IBUF0_PINW -> BIOB_IBUF0
 
-	next_word(line, start, &net_idx_beg, &net_idx_end);
+	line_word(line, len, start, &net_idx_beg, &net_idx_end);
 	if (net_idx_end == net_idx_beg
 	    || !all_digits(&line[net_idx_beg], net_idx_end-net_idx_beg))
-		{ HERE(); return; }
-	net_idx = to_i(&line[net_idx_beg], net_idx_end-net_idx_beg);
-	if (net_idx < 1)
-		{ HERE(); return; }
+		return "invalid net index";
+	rec->net_i = to_i(&line[net_idx_beg], net_idx_end-net_idx_beg);
+	if (rec->net_i < 1)
+		return "invalid net index";
 
-	next_word(line, net_idx_end, &el_type_beg, &el_type_end);
+	line_word(line, len, net_idx_end, &el_type_beg, &el_type_end);
 	if (!str_cmp(&line[el_type_beg], el_type_end-el_type_beg, "sw", 2)) {
-		struct sw_set sw;
-
-		if (coord(line, el_type_end, &coord_end, &y_coord, &x_coord))
-			return;
-
-		next_word(line, coord_end, &from_beg, &from_end);
-		next_word(line, from_end, &direction_beg, &direction_end);
-		next_word(line, direction_end, &to_beg, &to_end);
+		if (coord(model, line, len, el_type_end, &coord_end,
+				&rec->y, &rec->x))
+			return "invalid coordinates";
 
+		line_word(line, len, coord_end, &from_beg, &from_end);
+		line_word(line, len, from_end, &direction_beg, &direction_end);
+		line_word(line, len, direction_end, &to_beg, &to_end);
 		if (from_end <= from_beg || direction_end <= direction_beg
-		    || to_end <= to_beg) {
-			HERE();
-			return;
-		}
-		memcpy(buf, &line[from_beg], from_end-from_beg);
-		buf[from_end-from_beg] = 0;
-		from_str_i = strarray_find(&model->str, buf);
-		if (from_str_i == STRIDX_NO_ENTRY) {
-			HERE();
-			return;
-		}
+		    || to_end <= to_beg)
+			return "expected <from> -> <to>";
+
+		from_str_i = strarray_find_len(&model->str, &line[from_beg],
+			from_end-from_beg);
+		if (from_str_i == STRIDX_NO_ENTRY)
+			return "unknown wire";
 		if (!str_cmp(&line[direction_beg], direction_end-direction_beg,
 			"->", 2))
 			is_bidir = 0;
 		else if (!str_cmp(&line[direction_beg], direction_end-direction_beg,
 			"<->", 3))
 			is_bidir = 1;
-		else {
-			HERE();
-			return;
-		}
-		memcpy(buf, &line[to_beg], to_end-to_beg);
-		buf[to_end-to_beg] = 0;
-		to_str_i = strarray_find(&model->str, buf);
-		if (to_str_i == STRIDX_NO_ENTRY) {
-			HERE();
-			return;
-		}
-
-		sw.sw[0] = fpga_switch_lookup(model, y_coord, x_coord, from_str_i, to_str_i);
-		if (sw.sw[0] == NO_SWITCH) {
-			HERE();
-			return;
-		}
-		sw_is_bidir = fpga_switch_is_bidir(model, y_coord, x_coord, sw.sw[0]);
-		if ((is_bidir && !sw_is_bidir)
-		    || (!is_bidir && sw_is_bidir)) {
-			HERE();
-			return;
-		}
-		if (fpga_switch_is_used(model, y_coord, x_coord, sw.sw[0]))
-			HERE();
-		sw.len = 1;
-		if (fnet_add_sw(model, net_idx, y_coord, x_coord, sw.sw, sw.len))
-			HERE();
-		return;
+		else
+			return "expected -> or <->";
+		to_str_i = strarray_find_len(&model->str, &line[to_beg],
+			to_end-to_beg);
+		if (to_str_i == STRIDX_NO_ENTRY)
+			return "unknown wire";
+
+		rec->u.sw = fpga_switch_lookup(model, rec->y, rec->x,
+			from_str_i, to_str_i);
+		if (rec->u.sw == NO_SWITCH)
+			return "no such switch";
+		if (is_bidir != fpga_switch_is_bidir(model, rec->y, rec->x,
+				rec->u.sw))
+			return "switch direction mismatch";
+		rec->type = FP_REC_SW;
+		return 0;
 	}
 
 	if (str_cmp(&line[el_type_beg], el_type_end-el_type_beg, "in", 2)
 	    && str_cmp(&line[el_type_beg], el_type_end-el_type_beg, "out", 3))
-		{ HERE(); return; }
+		return "expected sw, in or out";
 
-	if (coord(line, el_type_end, &coord_end, &y_coord, &x_coord))
-		return;
+	if (coord(model, line, len, el_type_end, &coord_end, &rec->y, &rec->x))
+		return "invalid coordinates";
 
-	next_word(line, coord_end, &dev_str_beg, &dev_str_end);
-	next_word(line, dev_str_end, &dev_type_idx_str_beg, &dev_type_idx_str_end);
-	next_word(line, dev_type_idx_str_end, &pin_str_beg, &pin_str_end);
-	next_word(line, pin_str_end, &pin_name_beg, &pin_name_end);
+	line_word(line, len, coord_end, &dev_str_beg, &dev_str_end);
+	line_word(line, len, dev_str_end, &dev_type_idx_str_beg,
+		&dev_type_idx_str_end);
+	line_word(line, len, dev_type_idx_str_end, &pin_str_beg, &pin_str_end);
+	line_word(line, len, pin_str_end, &pin_name_beg, &pin_name_end);
 	if (dev_str_end <= dev_str_beg
 	    || dev_type_idx_str_end <= dev_type_idx_str_beg
 	    || pin_str_end <= pin_str_beg
 	    || pin_name_end <= pin_name_beg
 	    || !all_digits(&line[dev_type_idx_str_beg], dev_type_idx_str_end-dev_type_idx_str_beg)
 	    || str_cmp(&line[pin_str_beg], pin_str_end-pin_str_beg, "pin", 3))
-		{ HERE(); return; }
-	dev_type = fdev_str2type(&line[dev_str_beg], dev_str_end-dev_str_beg);
-	if (dev_type == DEV_NONE) { HERE(); return; }
-	pinw_idx = fdev_pinw_str2idx(dev_type, &line[pin_name_beg],
-		pin_name_end-pin_name_beg);
-	if (pinw_idx == PINW_NO_IDX) { HERE(); return; }
-	if (fnet_add_port(model, net_idx, y_coord, x_coord, dev_type,
-		to_i(&line[dev_type_idx_str_beg], dev_type_idx_str_end
-			-dev_type_idx_str_beg), pinw_idx))
-		HERE();
+		return "expected <dev> <idx> pin <pin>";
+	rec->u.port.type = fdev_str2type(&line[dev_str_beg],
+		dev_str_end-dev_str_beg);
+	if (rec->u.port.type == DEV_NONE)
+		return "unknown device type";
+	rec->u.port.type_idx = to_i(&line[dev_type_idx_str_beg],
+		dev_type_idx_str_end-dev_type_idx_str_beg);
+	rec->u.port.pinw_idx = fdev_pinw_str2idx(rec->u.port.type,
+		&line[pin_name_beg], pin_name_end-pin_name_beg);
+	if (rec->u.port.pinw_idx == PINW_NO_IDX)
+		return "unknown pin";
+	rec->type = FP_REC_PORT;
+	return 0;
 }
 
-static void read_dev_line(struct fpga_model* model, const char* line, int start)
+static void read_dev_line(struct fpga_model* model, const char* line,
+	int len, int start, int line_no)
 {
 	int coord_end, y_coord, x_coord;
 	int type_beg, type_end, idx_beg, idx_end;
@@ -1223,33 +1267,32 @@ static void read_dev_line(struct fpga_model* model, const char* line, int start)
 	struct fpga_device* dev_ptr;
 	int next_beg, next_end, second_beg, second_end;
 
-	if (coord(line, start, &coord_end, &y_coord, &x_coord))
+	if (coord(model, line, len, start, &coord_end, &y_coord, &x_coord)) {
+		fp_error(line_no, "invalid coordinates: %.*s", len, line);
 		return;
+	}
 
-	next_word(line, coord_end, &type_beg, &type_end);
-	next_word(line, type_end, &idx_beg, &idx_end);
+	line_word(line, len, coord_end, &type_beg, &type_end);
+	line_word(line, len, type_end, &idx_beg, &idx_end);
 
 	if (type_end == type_beg || idx_end == idx_beg
 	    || !all_digits(&line[idx_beg], idx_end-idx_beg)) {
-		HERE();
+		fp_error(line_no, "expected <dev> <idx>: %.*s", len, line);
 		return;
 	}
 	dev_type = fdev_str2type(&line[type_beg], type_end-type_beg);
 	dev_type_idx = to_i(&line[idx_beg], idx_end-idx_beg);
 	dev_idx = fpga_dev_idx(model, y_coord, x_coord, dev_type, dev_type_idx);
 	if (dev_idx == NO_DEV) {
-		fprintf(stderr, "%s:%i y%02i x%02i dev_type %i "
-			"dev_type_idx %i dev_idx %i\n",
-			__FILE__, __LINE__, y_coord, x_coord, dev_type,
-			dev_type_idx, dev_idx);
+		fp_error(line_no, "no such device: %.*s", len, line);
 		return;
 	}
 	dev_ptr = FPGA_DEV(model, y_coord, x_coord, dev_idx);
 
 	next_end = idx_end;
-	while (next_word(line, next_end, &next_beg, &next_end),
+	while (line_word(line, len, next_end, &next_beg, &next_end),
 		next_end > next_beg) {
-		next_word(line, next_end, &second_beg, &second_end);
+		line_word(line, len, next_end, &second_beg, &second_end);
 		switch (dev_type) {
 			case DEV_IOB:
 				words_consumed = read_IOB_attr(model, dev_ptr,
@@ -1283,37 +1326,185 @@ static void read_dev_line(struct fpga_model* model, const char* line, int start)
 					second_end-second_beg);
 				break;
 			default:
-				fprintf(stderr, "error %i: %s", __LINE__, line);
+				fp_error(line_no, "unsupported device type: %.*s",
+					len, line);
 				return;
 		}
 		if (!words_consumed)
-			fprintf(stderr, "error %i w1 %.*s w2 %.*s: %s",
-				__LINE__, next_end-next_beg, &line[next_beg],
-				second_end-second_beg, &line[second_beg], line);
+			fp_error(line_no, "invalid attribute %.*s %.*s",
+				next_end-next_beg, &line[next_beg],
+				second_end-second_beg, &line[second_beg]);
 		else if (words_consumed == 2)
 			next_end = second_end;
 	}
 }
 
-int read_floorplan(struct fpga_model* model, FILE* f)
+static int add_rec(struct fp_chunk* c, enum fp_rec_type type,
+	int line_o, int line_len, struct fp_rec** rec)
 {
-	char line[1024];
-	int beg, end;
+	void* new_ptr;
+
+	if (!(c->num_recs % FP_RECS_INCREMENT)) {
+		new_ptr = realloc(c->recs, (c->num_recs+FP_RECS_INCREMENT)
+			* sizeof(*c->recs));
+		if (!new_ptr) {
+			OUT_OF_MEM();
+			return ENOMEM;
+		}
+		c->recs = new_ptr;
+	}
+	*rec = &c->recs[c->num_recs++];
+	(*rec)->type = type;
+	(*rec)->line_o = line_o;
+	(*rec)->line_len = line_len;
+	(*rec)->line_no = c->num_lines-1;
+	return 0;
+}
 
-	while (fgets(line, sizeof(line), f)) {
-		next_word(line, 0, &beg, &end);
-		if (end == beg) continue;
+static void* parse_chunk(void* arg)
+{
+	struct fp_chunk* c = arg;
+	struct fp_rec* rec;
+	const char* line, *nl;
+	const char* err;
+	int o, len, beg, end;
+
+	for (o = c->start; o < c->end; o += len+1) {
+		line = &c->d[o];
+		nl = memchr(line, '\n', c->end-o);
+		len = nl ? nl-line : c->end-o;
+		c->num_lines++;
+
+		line_word(line, len, 0, &beg, &end);
+		if (end-beg != 3)
+			continue;
+		if (!str_cmp(&line[beg], 3, "net", 3)) {
+			if ((c->rc = add_rec(c, FP_REC_SW, o, len, &rec)))
+				return 0;
+			if ((err = parse_net_line(c->model, line, len,
+					end, rec))) {
+				rec->type = FP_REC_ERR;
+				rec->u.err = err;
+			}
+		} else if (!str_cmp(&line[beg], 3, "dev", 3)) {
+			if ((c->rc = add_rec(c, FP_REC_DEV, o, len, &rec)))
+				return 0;
+			rec->word_end = end;
+		}
+	}
+	return 0;
+}
 
-		if (end-beg == 3
-		    && !str_cmp(&line[beg], 3, "net", 3)) {
-			read_net_line(model, line, end);
+static void apply_chunk(struct fpga_model* model, struct fp_chunk* c,
+	int first_line_no)
+{
+	struct fp_rec* rec;
+	const char* line;
+	int line_no, i;
+
+	for (i = 0; i < c->num_recs; i++) {
+		rec = &c->recs[i];
+		line = &c->d[rec->line_o];
+		line_no = first_line_no + rec->line_no;
+		switch (rec->type) {
+			case FP_REC_ERR:
+				fp_error(line_no, "%s: %.*s", rec->u.err,
+					rec->line_len, line);
+				break;
+			case FP_REC_SW:
+				if (fpga_switch_is_used(model, rec->y, rec->x,
+						rec->u.sw)) {
+					fp_error(line_no, "switch already in "
+						"use: %.*s", rec->line_len, line);
+					break;
+				}
+				if (fnet_add_sw(model, rec->net_i, rec->y,
+						rec->x, &rec->u.sw, 1))
+					fp_error(line_no, "cannot add switch: "
+						"%.*s", rec->line_len, line);
+				break;
+			case FP_REC_PORT:
+				if (fnet_add_port(model, rec->net_i, rec->y,
+						rec->x, rec->u.port.type,
+						rec->u.port.type_idx,
+						rec->u.port.pinw_idx))
+					fp_error(line_no, "cannot add port: "
+						"%.*s", rec->line_len, line);
+				break;
+			case FP_REC_DEV:
+				read_dev_line(model, line, rec->line_len,
+					rec->word_end, line_no);
+				break;
 		}
-		if (end-beg == 3
-		    && !str_cmp(&line[beg], 3, "dev", 3)) {
-			read_dev_line(model, line, end);
+	}
+}
+
+int read_floorplan(struct fpga_model* model, FILE* f)
+{
+	struct fp_chunk chunks[FP_MAX_THREADS];
+	pthread_t threads[FP_MAX_THREADS];
+	uint8_t* data;
+	const char* nl;
+	int len, mapped, num_chunks, num_threads, line_no, i, rc;
+
+	rc = map_file(f, &data, &len, &mapped);
+	if (rc) FAIL(rc);
+	if (is_floorplan_bin(data, len)) {
+		rc = parse_floorplan_bin(model, data, len);
+		unmap_file(data, len, mapped);
+		return rc;
+	}
+
+	num_chunks = model_threads();
+	if (num_chunks > FP_MAX_THREADS)
+		num_chunks = FP_MAX_THREADS;
+	if (num_chunks > len/FP_MIN_CHUNK)
+		num_chunks = len/FP_MIN_CHUNK;
+	if (num_chunks < 1)
+		num_chunks = 1;
+	memset(chunks, 0, num_chunks*sizeof(*chunks));
+	for (i = 0; i < num_chunks; i++) {
+		chunks[i].model = model;
+		chunks[i].d = (const char*) data;
+		chunks[i].end = len;
+		if (!i) continue;
+		// chunks start after the first '\n' past their share
+		chunks[i].start = (int64_t) len*i/num_chunks;
+		if (chunks[i].start < chunks[i-1].start)
+			chunks[i].start = chunks[i-1].start;
+		nl = memchr(&data[chunks[i].start], '\n',
+			len-chunks[i].start);
+		chunks[i].start = nl ? nl-(const char*) data+1 : len;
+		chunks[i-1].end = chunks[i].start;
+	}
+
+	num_threads = 0;
+	if (num_chunks > 1) {
+		for (; num_threads < num_chunks; num_threads++) {
+			if (pthread_create(&threads[num_threads], 0,
+					parse_chunk, &chunks[num_threads]))
+				break;
 		}
 	}
-	return 0;
+	for (i = num_threads; i < num_chunks; i++)
+		parse_chunk(&chunks[i]);
+	for (i = 0; i < num_threads; i++)
+		pthread_join(threads[i], 0);
+
+	rc = 0;
+	line_no = 1;
+	for (i = 0; i < num_chunks; i++) {
+		if (!rc && chunks[i].rc)
+			rc = chunks[i].rc;
+		if (!rc)
+			apply_chunk(model, &chunks[i], line_no);
+		line_no += chunks[i].num_lines;
+		free(chunks[i].recs);
+	}
+	unmap_file(data, len, mapped);
+	return rc;
+fail:
+	return rc;
 }
 
 int write_floorplan(FILE* f, struct fpga_model* model, int flags)
@@ -24,11 +24,25 @@
 // - lines should typically not exceed 80 characters
 //
 
+// read_floorplan() reports invalid lines with their line number
+// and skips them, it only fails if f cannot be read or is an
+// invalid binary floorplan.
+// FPGATOOLS_THREADS sets the number of threads for large files.
 int read_floorplan(struct fpga_model* model, FILE* f);
 #define FP_DEFAULT	0x0000
 #define FP_NO_HEADER	0x0001
 int write_floorplan(FILE* f, struct fpga_model* model, int flags);
 
+// Binary floorplans (.fpb) hold the device configs and nets of a
+// model as records with a string table, see floorplan_bin.c.
+// They can only be read into a model of the same part and layout
+// as the one they were written from. read_floorplan() also
+// accepts them.
+int read_floorplan_bin(struct fpga_model* model, FILE* f);
+int write_floorplan_bin(FILE* f, struct fpga_model* model);
+int is_floorplan_bin(const uint8_t* d, int len);
+int parse_floorplan_bin(struct fpga_model* model, const uint8_t* d, int len);
+
 void printf_version(FILE* f);
 int printf_tiles(FILE* f, struct fpga_model* model);
 int printf_devices(FILE* f, struct fpga_model* model, int config_only);
@@ -0,0 +1,527 @@
+//
+// Author: Wolfgang Spraul
+//
+// This is free and unencumbered software released into the public domain.
+// For details see the UNLICENSE file at the root of the source tree.
+//
+
+#include <stddef.h>
+#include "model.h"
+#include "control.h"
+#include "floorplan.h"
+
+//
+// A binary floorplan (.fpb) has the following layout, all in
+// host byte order:
+//
+//   struct fpb_hdr
+//   string table: zero-terminated strings, padded to 4 bytes
+//   struct fpb_dev[num_devs]
+//   struct fpb_attr[num_attrs]: the attributes of each device,
+//          num_attrs of them per device, in device order
+//   num_nets times a struct fpb_net followed by its num_els
+//          struct net_el
+//
+// Attributes are (id, lut, value) triples, id is the index into
+// s_attrs[] and value either the int value of the field or the
+// offset of a string in the string table. Net elements are copied
+// from the model, switches are stored as index into the switches
+// of their tile. Since those indices depend on how the model was
+// built, the header carries a signature of the tile layout and
+// the reader refuses files with a different one.
+// Bump FPB_VERSION whenever the layout or s_attrs[] change.
+//
+
+#define FPB_MAGIC	"FPB\n"
+#define FPB_VERSION	1
+#define FPB_BYTE_ORDER	0x01020304
+
+struct fpb_hdr
+{
+	char magic[4];
+	uint32_t byte_order;
+	uint32_t version;
+	uint32_t idcode;
+	uint32_t model_sig;
+	uint32_t strs_len;
+	uint32_t num_devs, num_attrs;
+	uint32_t num_nets, num_net_els;
+};
+
+struct fpb_dev
+{
+	uint16_t y, x;
+	uint8_t type, type_idx;
+	uint16_t num_attrs;
+};
+
+struct fpb_attr
+{
+	uint16_t id;
+	uint16_t lut; // LUT_A..LUT_D for per-lut attributes, or 0
+	uint32_t val;
+};
+
+struct fpb_net
+{
+	uint32_t net_i;
+	uint32_t num_els;
+};
+
+enum { FPB_INT = 1, FPB_IOSTD, FPB_LUT5, FPB_LUT6 };
+
+struct fpb_attr_def
+{
+	enum fpgadev_type type;
+	int kind;
+	int per_lut; // offset is into a2d[0]
+	int offset;
+};
+
+#define DEV_ATTR(type, kind, field) \
+	{ type, kind, 0, offsetof(struct fpga_device, u.field) }
+#define A2D_ATTR(kind, field) \
+	{ DEV_LOGIC, kind, 1, offsetof(struct fpga_device, u.logic.a2d[0].field) }
+
+static const struct fpb_attr_def s_attrs[] =
+{
+	DEV_ATTR(DEV_IOB, FPB_IOSTD, iob.istandard),
+	DEV_ATTR(DEV_IOB, FPB_IOSTD, iob.ostandard),
+	DEV_ATTR(DEV_IOB, FPB_INT, iob.bypass_mux),
+	DEV_ATTR(DEV_IOB, FPB_INT, iob.I_mux),
+	DEV_ATTR(DEV_IOB, FPB_INT, iob.drive_strength),
+	DEV_ATTR(DEV_IOB, FPB_INT, iob.slew),
+	DEV_ATTR(DEV_IOB, FPB_INT, iob.O_used),
+	DEV_ATTR(DEV_IOB, FPB_INT, iob.suspend),
+	DEV_ATTR(DEV_IOB, FPB_INT, iob.in_term),
+	DEV_ATTR(DEV_IOB, FPB_INT, iob.out_term),
+
+	A2D_ATTR(FPB_LUT6, lut6),
+	A2D_ATTR(FPB_LUT5, lut5),
+	A2D_ATTR(FPB_INT, out_used),
+	A2D_ATTR(FPB_INT, ff_mux),
+	A2D_ATTR(FPB_INT, ff_srinit),
+	A2D_ATTR(FPB_INT, ff5_srinit),
+	A2D_ATTR(FPB_INT, out_mux),
+	A2D_ATTR(FPB_INT, ff),
+	A2D_ATTR(FPB_INT, cy0),
+	DEV_ATTR(DEV_LOGIC, FPB_INT, logic.clk_inv),
+	DEV_ATTR(DEV_LOGIC, FPB_INT, logic.sync_attr),
+	DEV_ATTR(DEV_LOGIC, FPB_INT, logic.ce_used),
+	DEV_ATTR(DEV_LOGIC, FPB_INT, logic.sr_used),
+	DEV_ATTR(DEV_LOGIC, FPB_INT, logic.we_mux),
+	DEV_ATTR(DEV_LOGIC, FPB_INT, logic.cout_used),
+	DEV_ATTR(DEV_LOGIC, FPB_INT, logic.precyinit),
+
+	DEV_ATTR(DEV_BUFGMUX, FPB_INT, bufgmux.clk),
+	DEV_ATTR(DEV_BUFGMUX, FPB_INT, bufgmux.disable_attr),
+	DEV_ATTR(DEV_BUFGMUX, FPB_INT, bufgmux.s_inv),
+
+	DEV_ATTR(DEV_BUFIO, FPB_INT, bufio.divide),
+	DEV_ATTR(DEV_BUFIO, FPB_INT, bufio.divide_bypass),
+	DEV_ATTR(DEV_BUFIO, FPB_INT, bufio.i_inv),
+
+	DEV_ATTR(DEV_BSCAN, FPB_INT, bscan.jtag_chain),
+	DEV_ATTR(DEV_BSCAN, FPB_INT, bscan.jtag_test),
+};
+
+#define NUM_ATTRS	(sizeof(s_attrs)/sizeof(*s_attrs))
+
+// The signature covers what switch, device and pinw indices
+// depend on.
+static uint32_t model_sig(struct fpga_model* model)
+{
+	struct fpga_tile* tile;
+	uint32_t sig;
+	int i;
+
+	sig = 2166136261u;
+	for (i = 0; i < model->x_width*model->y_height; i++) {
+		tile = &model->tiles[i];
+		sig = (sig ^ tile->type) * 16777619u;
+		sig = (sig ^ tile->num_switches) * 16777619u;
+		sig = (sig ^ tile->num_conn_point_names) * 16777619u;
+		sig = (sig ^ tile->num_devs) * 16777619u;
+	}
+	return sig;
+}
+
+//
+// writing
+//
+
+struct fpb_buf
+{
+	void* d;
+	int len, size;
+};
+
+static void* buf_add(struct fpb_buf* buf, int len)
+{
+	void* new_ptr;
+	int new_size;
+
+	if (buf->len + len > buf->size) {
+		new_size = buf->size ? buf->size*2 : 4096;
+		while (new_size < buf->len + len)
+			new_size *= 2;
+		new_ptr = realloc(buf->d, new_size);
+		if (!new_ptr) {
+			OUT_OF_MEM();
+			return 0;
+		}
+		buf->d = new_ptr;
+		buf->size = new_size;
+	}
+	buf->len += len;
+	return (char*) buf->d + buf->len - len;
+}
+
+struct fpb_writer
+{
+	struct fpb_buf strs, devs, attrs;
+	// each string is stored once, str_o maps the index
+	// in str to the offset in strs, plus 1
+	struct hashed_strarray str;
+	int* str_o;
+	int num_devs, num_attrs;
+};
+
+static int add_str(struct fpb_writer* w, const char* s, uint32_t* o)
+{
+	char* d;
+	int idx, len, rc;
+
+	rc = strarray_add(&w->str, s, &idx);
+	if (rc) FAIL(rc);
+	if (!w->str_o[idx]) {
+		len = strlen(s)+1;
+		d = buf_add(&w->strs, len);
+		if (!d) FAIL(ENOMEM);
+		memcpy(d, s, len);
+		w->str_o[idx] = w->strs.len - len + 1;
+	}
+	*o = w->str_o[idx] - 1;
+	return 0;
+fail:
+	return rc;
+}
+
+static int add_attr(struct fpb_writer* w, int id, int lut, uint32_t val)
+{
+	struct fpb_attr* attr;
+
+	attr = buf_add(&w->attrs, sizeof(*attr));
+	if (!attr) return ENOMEM;
+	attr->id = id;
+	attr->lut = lut;
+	attr->val = val;
+	w->num_attrs++;
+	return 0;
+}
+
+static int add_dev(struct fpb_writer* w, int y, int x,
+	struct fpga_device* dev, int type_idx)
+{
+	struct fpb_dev* rec;
+	const char* s;
+	char* field;
+	uint32_t val;
+	int num_attrs, num_luts, id, lut, rc;
+
+	num_attrs = w->num_attrs;
+	for (id = 0; id < NUM_ATTRS; id++) {
+		if (s_attrs[id].type != dev->type)
+			continue;
+		num_luts = s_attrs[id].per_lut ? NUM_LUTS : 1;
+		for (lut = 0; lut < num_luts; lut++) {
+			field = (char*) dev + s_attrs[id].offset
+				+ lut*sizeof(struct fpgadev_logic_a2d);
+			switch (s_attrs[id].kind) {
+				case FPB_INT:
+					if (!*(int*) field) continue;
+					val = *(int*) field;
+					break;
+				case FPB_IOSTD:
+				case FPB_LUT5:
+				case FPB_LUT6:
+					s = (s_attrs[id].kind == FPB_IOSTD)
+						? field : *(char**) field;
+					if (!s || !s[0]) continue;
+					rc = add_str(w, s, &val);
+					if (rc) FAIL(rc);
+					break;
+				default: FAIL(EINVAL);
+			}
+			rc = add_attr(w, id, lut, val);
+			if (rc) FAIL(rc);
+		}
+	}
+	rec = buf_add(&w->devs, sizeof(*rec));
+	if (!rec) FAIL(ENOMEM);
+	rec->y = y;
+	rec->x = x;
+	rec->type = dev->type;
+	rec->type_idx = type_idx;
+	rec->num_attrs = w->num_attrs - num_attrs;
+	w->num_devs++;
+	return 0;
+fail:
+	return rc;
+}
+
+int write_floorplan_bin(FILE* f, struct fpga_model* model)
+{
+	struct fpb_writer w;
+	struct fpb_hdr hdr;
+	struct fpb_net net_rec;
+	struct fpga_tile* tile;
+	struct fpga_net* net;
+	net_idx_t net_i;
+	char* d;
+	int y, x, i, pad, rc;
+
+	memset(&w, 0, sizeof(w));
+	if (model->rc) FAIL(model->rc);
+	rc = strarray_init(&w.str, STRIDX_64K);
+	if (rc) FAIL(rc);
+	w.str_o = calloc(STRIDX_64K+1, sizeof(*w.str_o));
+	if (!w.str_o) FAIL(ENOMEM);
+
+	for (y = 0; y < model->y_height; y++) {
+		for (x = 0; x < model->x_width; x++) {
+			tile = YX_TILE(model, y, x);
+			for (i = 0; i < tile->num_devs; i++) {
+				if (!tile->devs[i].instantiated)
+					continue;
+				rc = add_dev(&w, y, x, &tile->devs[i],
+					fdev_typeidx(model, y, x, i));
+				if (rc) FAIL(rc);
+			}
+		}
+	}
+	if (w.strs.len % 4) {
+		pad = 4 - w.strs.len%4;
+		if (!(d = buf_add(&w.strs, pad))) FAIL(ENOMEM);
+		memset(d, 0, pad);
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, FPB_MAGIC, sizeof(hdr.magic));
+	hdr.byte_order = FPB_BYTE_ORDER;
+	hdr.version = FPB_VERSION;
+	hdr.idcode = model->idcode;
+	hdr.model_sig = model_sig(model);
+	hdr.strs_len = w.strs.len;
+	hdr.num_devs = w.num_devs;
+	hdr.num_attrs = w.num_attrs;
+	net_i = NO_NET;
+	while (!(rc = fnet_enum(model, net_i, &net_i)) && net_i != NO_NET) {
+		hdr.num_nets++;
+		hdr.num_net_els += model->nets[net_i-1].len;
+	}
+	if (rc) FAIL(rc);
+
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1
+	    || (w.strs.len && fwrite(w.strs.d, w.strs.len, 1, f) != 1)
+	    || (w.devs.len && fwrite(w.devs.d, w.devs.len, 1, f) != 1)
+	    || (w.attrs.len && fwrite(w.attrs.d, w.attrs.len, 1, f) != 1))
+		FAIL(EIO);
+	net_i = NO_NET;
+	while (!(rc = fnet_enum(model, net_i, &net_i)) && net_i != NO_NET) {
+		net = &model->nets[net_i-1];
+		net_rec.net_i = net_i;
+		net_rec.num_els = net->len;
+		if (fwrite(&net_rec, sizeof(net_rec), 1, f) != 1
+		    || fwrite(net->el, sizeof(*net->el), net->len, f)
+				!= net->len)
+			FAIL(EIO);
+	}
+	if (rc) FAIL(rc);
+	rc = 0;
+fail:
+	strarray_free(&w.str);
+	free(w.str_o);
+	free(w.strs.d);
+	free(w.devs.d);
+	free(w.attrs.d);
+	return rc;
+}
+
+//
+// reading
+//
+
+int is_floorplan_bin(const uint8_t* d, int len)
+{
+	return len >= sizeof(struct fpb_hdr)
+		&& !memcmp(d, FPB_MAGIC, sizeof(FPB_MAGIC)-1);
+}
+
+static int read_dev(struct fpga_model* model, const struct fpb_dev* rec,
+	const struct fpb_attr* attrs, const char* strs, int strs_len)
+{
+	const struct fpb_attr_def* def;
+	struct fpga_device* dev;
+	const char* s;
+	char* field;
+	int dev_idx, i, rc;
+
+	if (rec->y >= model->y_height || rec->x >= model->x_width)
+		FAIL(EINVAL);
+	dev_idx = fpga_dev_idx(model, rec->y, rec->x, rec->type,
+		rec->type_idx);
+	if (dev_idx == NO_DEV) FAIL(EINVAL);
+	dev = FPGA_DEV(model, rec->y, rec->x, dev_idx);
+
+	for (i = 0; i < rec->num_attrs; i++) {
+		if (attrs[i].id >= NUM_ATTRS) FAIL(EINVAL);
+		def = &s_attrs[attrs[i].id];
+		if (def->type != dev->type
+		    || attrs[i].lut >= (def->per_lut ? NUM_LUTS : 1))
+			FAIL(EINVAL);
+		field = (char*) dev + def->offset
+			+ attrs[i].lut*sizeof(struct fpgadev_logic_a2d);
+		if (def->kind == FPB_INT) {
+			*(int*) field = attrs[i].val;
+			continue;
+		}
+		if (attrs[i].val >= strs_len) FAIL(EINVAL);
+		s = &strs[attrs[i].val];
+		if (def->kind == FPB_IOSTD) {
+			if (strlen(s) >= sizeof(IOSTANDARD)) FAIL(EINVAL);
+			strcpy(field, s);
+			continue;
+		}
+		if (strlen(s) >= MAX_LUT_LEN) FAIL(EINVAL);
+		rc = fdev_logic_a2d_lut(model, rec->y, rec->x, rec->type_idx,
+			attrs[i].lut, def->kind == FPB_LUT5 ? 5 : 6, s, ZTERM);
+		if (rc) FAIL(rc);
+	}
+	dev->instantiated = 1;
+	return 0;
+fail:
+	fprintf(stderr, "#E fpb: invalid device y%i x%i type %i/%i\n",
+		rec->y, rec->x, rec->type, rec->type_idx);
+	return rc;
+}
+
+#define FPB_SW_BATCH	64
+
+// Adds the elements of one net, runs of switches in the same
+// tile go to fnet_add_sw() together.
+static int read_net(struct fpga_model* model, net_idx_t net_i,
+	const struct net_el* els, int num_els)
+{
+	swidx_t sw[FPB_SW_BATCH];
+	struct fpga_tile* tile;
+	int num_sw, i, rc;
+
+	if (net_i <= NO_NET) FAIL(EINVAL);
+	num_sw = 0;
+	for (i = 0; i < num_els; i++) {
+		if (els[i].y >= model->y_height || els[i].x >= model->x_width)
+			FAIL(EINVAL);
+		tile = YX_TILE(model, els[i].y, els[i].x);
+		if (els[i].idx & NET_IDX_IS_PINW) {
+			if (els[i].dev_idx >= tile->num_devs
+			    || (els[i].idx & NET_IDX_MASK)
+				>= tile->devs[els[i].dev_idx].num_pinw_total)
+				FAIL(EINVAL);
+			rc = fnet_add_port(model, net_i, els[i].y, els[i].x,
+				tile->devs[els[i].dev_idx].type,
+				fdev_typeidx(model, els[i].y, els[i].x,
+					els[i].dev_idx),
+				els[i].idx & NET_IDX_MASK);
+			if (rc) FAIL(rc);
+			continue;
+		}
+		if (els[i].idx >= tile->num_switches) FAIL(EINVAL);
+		sw[num_sw++] = els[i].idx;
+		if (num_sw < FPB_SW_BATCH && i+1 < num_els
+		    && !(els[i+1].idx & NET_IDX_IS_PINW)
+		    && els[i+1].y == els[i].y && els[i+1].x == els[i].x)
+			continue;
+		rc = fnet_add_sw(model, net_i, els[i].y, els[i].x, sw, num_sw);
+		if (rc) FAIL(rc);
+		num_sw = 0;
+	}
+	return 0;
+fail:
+	fprintf(stderr, "#E fpb: invalid net %i\n", net_i);
+	return rc;
+}
+
+int parse_floorplan_bin(struct fpga_model* model, const uint8_t* d, int len)
+{
+	const struct fpb_hdr* hdr;
+	const struct fpb_dev* devs;
+	const struct fpb_attr* attrs, *attrs_end;
+	const struct fpb_net* net;
+	const char* strs;
+	uint64_t o, end;
+	int i, rc;
+
+	if (!is_floorplan_bin(d, len)) FAIL(EINVAL);
+	hdr = (const struct fpb_hdr*) d;
+	if (hdr->byte_order != FPB_BYTE_ORDER || hdr->version != FPB_VERSION) {
+		fprintf(stderr, "#E fpb: unsupported version or byte order\n");
+		FAIL(EINVAL);
+	}
+	if (hdr->idcode != model->idcode || hdr->model_sig != model_sig(model)) {
+		fprintf(stderr, "#E fpb: written for a different part or "
+			"model layout\n");
+		FAIL(EINVAL);
+	}
+	o = sizeof(*hdr);
+	strs = (const char*) &d[o];
+	o += hdr->strs_len;
+	devs = (const struct fpb_dev*) &d[o];
+	o += (uint64_t) hdr->num_devs*sizeof(*devs);
+	attrs = (const struct fpb_attr*) &d[o];
+	o += (uint64_t) hdr->num_attrs*sizeof(*attrs);
+	attrs_end = (const struct fpb_attr*) &d[o];
+	end = o + hdr->num_nets*(uint64_t) sizeof(*net)
+		+ hdr->num_net_els*(uint64_t) sizeof(struct net_el);
+	if ((hdr->strs_len % 4) || end != len
+	    || (hdr->strs_len && strs[hdr->strs_len-1]))
+		FAIL(EINVAL);
+
+	for (i = 0; i < hdr->num_devs; i++) {
+		if (devs[i].num_attrs > attrs_end - attrs) FAIL(EINVAL);
+		rc = read_dev(model, &devs[i], attrs, strs, hdr->strs_len);
+		if (rc) FAIL(rc);
+		attrs += devs[i].num_attrs;
+	}
+	for (i = 0; i < hdr->num_nets; i++) {
+		net = (const struct fpb_net*) &d[o];
+		if (o + sizeof(*net) > len
+		    || net->num_els > (len - o - sizeof(*net))
+			/ sizeof(struct net_el))
+			FAIL(EINVAL);
+		rc = read_net(model, net->net_i,
+			(const struct net_el*) &d[o + sizeof(*net)],
+			net->num_els);
+		if (rc) FAIL(rc);
+		o += sizeof(*net) + net->num_els*sizeof(struct net_el);
+	}
+	if (o != len) FAIL(EINVAL);
+	return 0;
+fail:
+	return rc;
+}
+
+int read_floorplan_bin(struct fpga_model* model, FILE* f)
+{
+	uint8_t* data;
+	int len, mapped, rc;
+
+	rc = map_file(f, &data, &len, &mapped);
+	if (rc) FAIL(rc);
+	rc = parse_floorplan_bin(model, data, len);
+	unmap_file(data, len, mapped);
+	if (rc) FAIL(rc);
+	return 0;
+fail:
+	return rc;
+}
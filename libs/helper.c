@@ -7,6 +7,8 @@
 
 #include <stdarg.h>
 #include <errno.h>
+#include <limits.h>
+#include <sys/mman.h>
 #include "model.h"
 #include "parts.h"
 
@@ -743,6 +745,69 @@ int get_random(void)
 	return random_num;
 }
 
+#define READ_ALL_PAGESIZE	4096
+
+// Reads until eof, for input that cannot be mapped such as pipes.
+static int read_all(FILE* f, uint8_t** data, int* len)
+{
+	uint8_t* new_data;
+	int size, num_read, rc;
+
+	*data = 0;
+	*len = 0;
+	size = 0;
+	while (1) {
+		if (*len + READ_ALL_PAGESIZE > size) {
+			size = size ? size*2 : 64*READ_ALL_PAGESIZE;
+			new_data = realloc(*data, size);
+			if (!new_data) FAIL(ENOMEM);
+			*data = new_data;
+		}
+		num_read = fread(&(*data)[*len], sizeof(uint8_t),
+			READ_ALL_PAGESIZE, f);
+		*len += num_read;
+		if (num_read != READ_ALL_PAGESIZE)
+			break;
+	}
+	if (ferror(f)) FAIL(EIO);
+	return 0;
+fail:
+	free(*data);
+	*data = 0;
+	*len = 0;
+	return rc;
+}
+
+int map_file(FILE* f, uint8_t** data, int* len, int* mapped)
+{
+	struct stat st;
+
+	*data = 0;
+	*len = 0;
+	*mapped = 0;
+	if (!fstat(fileno(f), &st) && S_ISREG(st.st_mode)
+	    && st.st_size > 0 && st.st_size <= INT_MAX
+	    && !ftell(f)) {
+		*data = mmap(/*addr*/ 0, st.st_size, PROT_READ,
+			MAP_PRIVATE, fileno(f), /*offset*/ 0);
+		if (*data != MAP_FAILED) {
+			*mapped = 1;
+			*len = st.st_size;
+			return 0;
+		}
+		*data = 0;
+	}
+	return read_all(f, data, len);
+}
+
+void unmap_file(uint8_t* data, int len, int mapped)
+{
+	if (mapped)
+		munmap(data, len);
+	else
+		free(data);
+}
+
 int compare_with_number(const char* a, const char* b)
 {
 	int i, a_i, b_i, non_numeric_result, a_num, b_num;
@@ -884,10 +949,28 @@ uint32_t hash_djb2(const unsigned char* str)
 // is at off-2, the index at off-6. offset0 can thus be
 // used as a special value to signal 'no entry'.
 //
+// Bins are fixed-size chunks that are filled in order and
+// never move, so string pointers stay valid while other
+// threads add strings. Entries do not cross bins.
+//
+// strarray_add() is lock-free:
+// 1. claim a free index with a CAS on bin_offsets (BIN_RESERVED)
+// 2. reserve space with a CAS on str_end, store the entry
+// 3. publish index_to_bin and bin_offsets
+// 4. publish hash and index with a CAS on the first empty slot
+//    in find_slots
+// If two threads add the same string, one of them finds the
+// other's slot in step 4, releases its index and returns the
+// other one. Its entry stays behind in the bin, unreferenced.
+//
 
 #define BIN_STR_HEADER	(4+2)
 #define BIN_MIN_OFFSET	BIN_STR_HEADER
 #define BIN_INCREMENT	32768
+#define BIN_RESERVED	1 // index claimed, string not stored yet
+
+#define SLOT_HASH(slot)	((uint32_t) ((slot) >> 32))
+#define SLOT_IDX(slot)	((int) ((slot) & 0xFFFFFFFF))
 
 const char* strarray_lookup(struct hashed_strarray* array, int idx)
 {
@@ -896,15 +979,15 @@ const char* strarray_lookup(struct hashed_strarray* array, int idx)
 	if (!array->index_to_bin || !array->bin_offsets || idx==STRIDX_NO_ENTRY)
 		return 0;
 
+	offset = __atomic_load_n(&array->bin_offsets[idx-1], __ATOMIC_ACQUIRE);
 	bin = array->index_to_bin[idx-1];
-	offset = array->bin_offsets[idx-1];
 
 	// bin 0 offset 0 is a special value that signals 'no
 	// entry'. Normal offsets cannot be less than BIN_MIN_OFFSET.
 	if (!bin && !offset) return 0;
 
-	if (!array->bin_strings[bin] || offset >= array->bin_len[bin]
-	    || offset < BIN_MIN_OFFSET) {
+	if (bin >= array->num_bins || !array->bin_strings[bin]
+	    || offset >= BIN_INCREMENT || offset < BIN_MIN_OFFSET) {
 		// This really should never happen and is an internal error.
 		fprintf(stderr, "Internal error.\n");
 		return 0;
@@ -913,42 +996,156 @@ const char* strarray_lookup(struct hashed_strarray* array, int idx)
 	return &array->bin_strings[bin][offset];
 }
 
+// same as hash_djb2(), also returns the string length
+static inline uint32_t s_hash_len(const char* str, int* len)
+{
+	const unsigned char* p = (const unsigned char*) str;
+	uint32_t hash = 5381;
+
+	while (*p)
+		hash = ((hash << 5) + hash) + *p++;
+	*len = p - (const unsigned char*) str;
+	return hash;
+}
+
+static int s_slot_matches(struct hashed_strarray* array, uint64_t slot,
+	uint32_t hash, const char* str, int len)
+{
+	const char* entry;
+	int idx;
+
+	if (SLOT_HASH(slot) != hash)
+		return 0;
+	idx = SLOT_IDX(slot);
+	entry = &array->bin_strings[array->index_to_bin[idx-1]]
+		[array->bin_offsets[idx-1]];
+	// the entry len at entry-2 includes the header
+	return *(uint16_t*)(entry-2) == BIN_STR_HEADER+len+1
+		&& !memcmp(entry, str, len);
+}
+
+static int s_find(struct hashed_strarray* array, uint32_t hash,
+	const char* str, int len)
+{
+	uint64_t slot;
+	int i;
+
+	for (i = hash & (array->find_size-1);
+	     (slot = __atomic_load_n(&array->find_slots[i], __ATOMIC_ACQUIRE));
+	     i = (i+1) & (array->find_size-1)) {
+		if (s_slot_matches(array, slot, hash, str, len))
+			return SLOT_IDX(slot);
+	}
+	return STRIDX_NO_ENTRY;
+}
+
 int strarray_find(struct hashed_strarray* array, const char* str)
 {
-	int bin, search_off, i;
 	uint32_t hash;
+	int len;
 
-	hash = hash_djb2((const unsigned char*) str);
-	bin = hash % array->num_bins;
-	// iterate over strings in bin to find match
-	if (array->bin_strings[bin]) {
-		search_off = BIN_MIN_OFFSET;
-		while (search_off < array->bin_len[bin]) {
-			if (!strcmp(&array->bin_strings[bin][search_off], str)) {
-				i = *(uint32_t*)&array->bin_strings[bin][search_off-6];
-				if (!i) {
-					fprintf(stderr, "Internal error - index 0.\n");
-					return STRIDX_NO_ENTRY;
-				}
-				return i+1;
-			}
-			search_off += *(uint16_t*)&array->bin_strings[bin][search_off-2];
+	hash = s_hash_len(str, &len);
+	return s_find(array, hash, str, len);
+}
+
+int strarray_find_len(struct hashed_strarray* array, const char* str, int len)
+{
+	uint32_t hash;
+	int i;
+
+	hash = 5381;
+	for (i = 0; i < len; i++)
+		hash = ((hash << 5) + hash) + (unsigned char) str[i];
+	return s_find(array, hash, str, len);
+}
+
+// Publishes idx (1-based) in find_slots. Returns idx, or the index
+// of an equal string that was published first by another thread.
+static int s_index_add(struct hashed_strarray* array, uint32_t hash,
+	int idx, const char* str, int len)
+{
+	uint64_t new_slot, slot;
+	int i;
+
+	new_slot = (uint64_t) hash << 32 | idx;
+	i = hash & (array->find_size-1);
+	while (1) {
+		slot = __atomic_load_n(&array->find_slots[i], __ATOMIC_ACQUIRE);
+		if (!slot) {
+			if (__sync_bool_compare_and_swap(&array->find_slots[i],
+					0, new_slot))
+				return idx;
+			// lost the slot, look at what is in it now
+			continue;
 		}
+		if (str && s_slot_matches(array, slot, hash, str, len))
+			return SLOT_IDX(slot);
+		i = (i+1) & (array->find_size-1);
 	}
-	return STRIDX_NO_ENTRY;
 }
 
-int s_stash_at_bin(struct hashed_strarray* array, const char* str, int idx, int bin);
+// Stores str in the next free space of the bins and publishes
+// it as idx (0-based).
+static int s_store(struct hashed_strarray* array, const char* str, int len,
+	int idx)
+{
+	uint32_t pos, start, end;
+	int entry_len, bin, off;
+	char* new_bin;
+
+	entry_len = BIN_STR_HEADER+len+1;
+	if (entry_len > BIN_INCREMENT) {
+		fprintf(stderr, "String too long.\n");
+		return -1;
+	}
+	do {
+		pos = array->str_end;
+		start = pos;
+		// entries do not cross bins
+		if (start%BIN_INCREMENT + entry_len > BIN_INCREMENT)
+			start = (start/BIN_INCREMENT + 1) * BIN_INCREMENT;
+		end = start + entry_len;
+		if (start/BIN_INCREMENT >= array->num_bins) {
+			fprintf(stderr, "All string bins full.\n");
+			return -1;
+		}
+	} while (!__sync_bool_compare_and_swap(&array->str_end, pos, end));
+
+	bin = start/BIN_INCREMENT;
+	off = start%BIN_INCREMENT;
+	if (!array->bin_strings[bin]) {
+		new_bin = calloc(BIN_INCREMENT, /*elsize*/ 1);
+		if (!new_bin) {
+			fprintf(stderr, "Out of memory.\n");
+			return -1;
+		}
+		if (!__sync_bool_compare_and_swap(&array->bin_strings[bin],
+				0, new_bin))
+			free(new_bin);
+	}
+	*(uint32_t*)&array->bin_strings[bin][off] = idx;
+	*(uint16_t*)&array->bin_strings[bin][off+4] = entry_len;
+	memcpy(&array->bin_strings[bin][off+BIN_STR_HEADER], str, len+1);
+	// bin_len is the highest end of an entry in the bin
+	while ((pos = array->bin_len[bin]) < off+entry_len)
+		__sync_bool_compare_and_swap(&array->bin_len[bin], pos,
+			off+entry_len);
+
+	array->index_to_bin[idx] = bin;
+	__atomic_store_n(&array->bin_offsets[idx], off+BIN_STR_HEADER,
+		__ATOMIC_RELEASE);
+	return 0;
+}
 
 int strarray_add(struct hashed_strarray* array, const char* str, int* idx)
 {
-	int bin, i, free_index, rc, start_index;
-	unsigned long hash;
+	int i, free_index, rc, start_index, len;
+	uint32_t hash;
 
 	*idx = strarray_find(array, str);
 	if (*idx != STRIDX_NO_ENTRY) return 0;
 
-	hash = hash_djb2((const unsigned char*) str);
+	hash = s_hash_len(str, &len);
 
 	// search free index
 	start_index = hash % array->highest_index;
@@ -956,7 +1153,9 @@ int strarray_add(struct hashed_strarray* array, const char* str, int* idx)
 		int cur_i = (start_index+i)%array->highest_index;
 		if (!cur_i) // never issue index 0
 			continue;
-		if (!array->bin_offsets[cur_i])
+		if (!array->bin_offsets[cur_i]
+		    && __sync_bool_compare_and_swap(&array->bin_offsets[cur_i],
+				0, BIN_RESERVED))
 			break;
 	}
 	if (i >= array->highest_index) {
@@ -964,49 +1163,88 @@ int strarray_add(struct hashed_strarray* array, const char* str, int* idx)
 		return -1;
 	}
 	free_index = (start_index+i)%array->highest_index;
-	bin = hash % array->num_bins;
-	rc = s_stash_at_bin(array, str, free_index, bin);
-	if (rc) return rc;
-	*idx = free_index + 1;
+	rc = s_store(array, str, len, free_index);
+	if (rc) {
+		array->bin_offsets[free_index] = 0;
+		return rc;
+	}
+	*idx = s_index_add(array, hash, free_index+1, str, len);
+	if (*idx != free_index+1) {
+		// Another thread added the same string. Bin 0 offset 0
+		// marks the index free again, the entry stays behind
+		// unreferenced in its bin.
+		array->index_to_bin[free_index] = 0;
+		__atomic_store_n(&array->bin_offsets[free_index], 0,
+			__ATOMIC_RELEASE);
+	}
 	return 0;
 }
 
-int s_stash_at_bin(struct hashed_strarray* array, const char* str, int idx, int bin)
-{
-	int str_len = strlen(str);
-	// check whether bin needs expansion
-	if (!(array->bin_len[bin]%BIN_INCREMENT)
-	    || array->bin_len[bin]%BIN_INCREMENT + BIN_STR_HEADER+str_len+1 > BIN_INCREMENT)
-	{
-		int new_alloclen;
-		void* new_ptr;
-		new_alloclen = ((array->bin_len[bin]
-				+ BIN_STR_HEADER+str_len+1)/BIN_INCREMENT + 1)
-			  * BIN_INCREMENT;
-		new_ptr = realloc(array->bin_strings[bin], new_alloclen);
-		if (!new_ptr) {
-			fprintf(stderr, "Out of memory.\n");
+int strarray_stash(struct hashed_strarray* array, const char* str, int idx)
+{
+	// not published in find_slots, strarray_find()
+	// cannot be used after stash anyway, only lookup can.
+	return s_store(array, str, strlen(str), idx-1);
+}
+
+int strarray_load_bin(struct hashed_strarray* array, int bin,
+	const char* data, int len)
+{
+	int off, idx, entry_len;
+
+	free(array->bin_strings[bin]);
+	array->bin_strings[bin] = 0;
+	array->bin_len[bin] = 0;
+	if (!len) return 0;
+	if (len > BIN_INCREMENT) {
+		fprintf(stderr, "Internal error.\n");
+		return -1;
+	}
+	array->bin_strings[bin] = calloc(BIN_INCREMENT, /*elsize*/ 1);
+	if (!array->bin_strings[bin]) {
+		fprintf(stderr, "Out of memory.\n");
+		return -1;
+	}
+	memcpy(array->bin_strings[bin], data, len);
+	array->bin_len[bin] = len;
+	// later strarray_add() calls append after the last bin
+	if (bin*BIN_INCREMENT + len > array->str_end)
+		array->str_end = bin*BIN_INCREMENT + len;
+	// Index the entries that bin_offsets and index_to_bin point
+	// to, which skips the ones left behind by add races.
+	for (off = BIN_MIN_OFFSET; off < len; off += entry_len) {
+		// each entry must end with its string's 0 inside the bin
+		entry_len = *(uint16_t*)&data[off-2];
+		if (entry_len < BIN_STR_HEADER+1
+		    || off-BIN_STR_HEADER + entry_len > len
+		    || data[off-BIN_STR_HEADER + entry_len-1])
 			return -1;
-		}
-		if (new_alloclen > array->bin_len[bin])
-			memset(new_ptr+array->bin_len[bin], 0, new_alloclen-array->bin_len[bin]);
-		array->bin_strings[bin] = new_ptr;
+		idx = *(uint32_t*)&data[off-6];
+		if (idx < 0 || idx >= array->highest_index
+		    || array->bin_offsets[idx] != off
+		    || array->index_to_bin[idx] != bin)
+			continue;
+		s_index_add(array, hash_djb2((const unsigned char*)
+			&data[off]), idx+1, /*str*/ 0, 0);
 	}
-	// append new string at end of bin
-	*(uint32_t*)&array->bin_strings[bin][array->bin_len[bin]] = idx;
-	*(uint16_t*)&array->bin_strings[bin][array->bin_len[bin]+4] = BIN_STR_HEADER+str_len+1;
-	strcpy(&array->bin_strings[bin][array->bin_len[bin]+BIN_STR_HEADER], str);
-	array->index_to_bin[idx] = bin;
-	array->bin_offsets[idx] = array->bin_len[bin]+BIN_STR_HEADER;
-	array->bin_len[bin] += BIN_STR_HEADER+str_len+1;
 	return 0;
 }
 
-int strarray_stash(struct hashed_strarray* array, const char* str, int idx)
+int strarray_check(struct hashed_strarray* array)
 {
-	// The bin is just a random number here, because find
-	// cannot be used after stash anyway, only lookup can.
-	return s_stash_at_bin(array, str, idx-1, idx % array->num_bins);
+	int i, bin, off;
+
+	for (i = 0; i < array->highest_index; i++) {
+		bin = array->index_to_bin[i];
+		off = array->bin_offsets[i];
+		if (!bin && !off)
+			continue;
+		if (bin >= array->num_bins || off < BIN_MIN_OFFSET
+		    || off >= array->bin_len[bin]
+		    || *(uint32_t*)&array->bin_strings[bin][off-6] != i)
+			return -1;
+	}
+	return 0;
 }
 
 int strarray_used_slots(struct hashed_strarray* array)
@@ -1031,14 +1269,20 @@ int strarray_init(struct hashed_strarray* array, int highest_index)
 	array->bin_len = calloc(array->num_bins,sizeof(*array->bin_len));
 	array->bin_offsets = calloc(array->highest_index,sizeof(*array->bin_offsets));
 	array->index_to_bin = calloc(array->highest_index,sizeof(*array->index_to_bin));
+	// at most half full
+	for (array->find_size = 1; array->find_size < 2*highest_index;
+	     array->find_size <<= 1);
+	array->find_slots = calloc(array->find_size,sizeof(*array->find_slots));
 	
 	if (!array->bin_strings || !array->bin_len
-	    || !array->bin_offsets || !array->index_to_bin) {
+	    || !array->bin_offsets || !array->index_to_bin
+	    || !array->find_slots) {
 		fprintf(stderr, "Out of memory in %s:%i\n", __FILE__, __LINE__);
 		free(array->bin_strings);
 		free(array->bin_len);
 		free(array->bin_offsets);
 		free(array->index_to_bin);
+		free(array->find_slots);
 		return -1;
 	}
 	return 0;
@@ -1047,8 +1291,7 @@ int strarray_init(struct hashed_strarray* array, int highest_index)
 void strarray_free(struct hashed_strarray* array)
 {
 	int i;
-	for (i = 0; i < sizeof(array->bin_strings)/
-		sizeof(array->bin_strings[0]); i++) {
+	for (i = 0; array->bin_strings && i < array->num_bins; i++) {
 		free(array->bin_strings[i]);
 		array->bin_strings[i] = 0;
 	}
@@ -1060,6 +1303,8 @@ void strarray_free(struct hashed_strarray* array)
 	array->bin_offsets = 0;
 	free(array->index_to_bin);
 	array->index_to_bin = 0;
+	free(array->find_slots);
+	array->find_slots = 0;
 }
 
 int row_pos_to_y(int num_rows, int row, int pos)
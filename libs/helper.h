@@ -102,6 +102,11 @@ void write_lut64(uint8_t* two_minors, int off_in_frame, uint64_t u64);
 
 int get_vm_mb(void);
 int get_random(void);
+// map_file() maps regular files read-only and reads everything
+// else, such as pipes, into memory. Either way the data is
+// released with unmap_file().
+int map_file(FILE* f, uint8_t** data, int* len, int* mapped);
+void unmap_file(uint8_t* data, int len, int mapped);
 int compare_with_number(const char* a, const char* b);
 // If no next word is found, *end == *beg
 void next_word(const char* s, int start, int* beg, int* end);
@@ -119,10 +124,16 @@ void printf_wrap(FILE* f, char* line, int prefix_len,
 
 uint32_t hash_djb2(const unsigned char* str);
 
-// Strings are distributed among bins. Each bin is
-// one continuous stream of zero-terminated strings
-// prefixed with a 32+16=48-bit header. The allocation
-// increment for each bin is 32k.
+// Strings are stored in bins, fixed-size chunks of 32k that
+// are filled in order and never move. Each bin is one
+// continuous stream of zero-terminated strings prefixed
+// with a 32+16=48-bit header.
+// strarray_find() does not walk the bins but looks up
+// the hash in find_slots, an open-addressing table with
+// find_size (power of 2) slots, so a hit costs one
+// memcmp() in the common case.
+// All calls can run concurrently from several threads,
+// see helper.c for how strarray_add() works without locks.
 struct hashed_strarray
 {
 	int highest_index;
@@ -131,12 +142,33 @@ struct hashed_strarray
 	char** bin_strings;
 	int* bin_len;
 	int num_bins;
+	uint32_t str_end; // bin*32k+offset where the next entry goes
+	uint64_t* find_slots; // hash << 32 | index, 0 means empty
+	int find_size;
 };
 
 #define STRIDX_64K	0xFFFF
 #define STRIDX_1M	1000000
 
+// STRIDX_BITS is the width of the string indices that the model
+// stores, str16_t and the connection point arrays of each tile.
+// 16 keeps the compact layout and allows up to 64k strings, 32
+// is for parts with more strings (make clean, then
+// make CPPFLAGS=-DSTRIDX_BITS=32).
+// str16_t keeps its name in both cases.
+#ifndef STRIDX_BITS
+#define STRIDX_BITS	16
+#endif
+
+#if STRIDX_BITS == 16
 typedef uint16_t str16_t;
+#define STRIDX_MAX	STRIDX_64K
+#elif STRIDX_BITS == 32
+typedef uint32_t str16_t;
+#define STRIDX_MAX	STRIDX_1M
+#else
+#error STRIDX_BITS must be 16 or 32
+#endif
 
 int strarray_init(struct hashed_strarray* array, int highest_index);
 void strarray_free(struct hashed_strarray* array);
@@ -146,10 +178,23 @@ const char* strarray_lookup(struct hashed_strarray* array, int idx);
 // can use 0 as a special value to indicate 'no string'.
 #define STRIDX_NO_ENTRY 0
 int strarray_find(struct hashed_strarray* array, const char* str);
+// strarray_find_len() finds a string that is not zero-terminated.
+int strarray_find_len(struct hashed_strarray* array, const char* str, int len);
+// Strings that are added are never moved or removed, the
+// pointer from strarray_lookup() stays valid until strarray_free().
 int strarray_add(struct hashed_strarray* array, const char* str, int* idx);
 // If you stash a string to a fixed index, you cannot use strarray_find()
 // anymore, only strarray_lookup().
 int strarray_stash(struct hashed_strarray* array, const char* str, int idx);
 int strarray_used_slots(struct hashed_strarray* array);
+// strarray_load_bin() replaces the contents of one bin, used to
+// restore a fresh array after its bin_offsets and index_to_bin
+// arrays. It fails if an entry does not end inside the bin.
+int strarray_load_bin(struct hashed_strarray* array, int bin,
+	const char* data, int len);
+// strarray_check() fails if an index of a restored or concurrently
+// filled array does not point to an entry of its bin, or a free
+// index still names a bin.
+int strarray_check(struct hashed_strarray* array);
 
 int row_pos_to_y(int num_rows, int row, int pos);
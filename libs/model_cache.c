@@ -0,0 +1,638 @@
+//
+// Author: Wolfgang Spraul
+//
+// This is free and unencumbered software released into the public domain.
+// For details see the UNLICENSE file at the root of the source tree.
+//
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "model.h"
+
+//
+// A snapshot file has the following layout, all blobs are
+// aligned to 8 bytes:
+//
+//   struct cache_hdr
+//   struct fpga_model (only the non-pointer fields are used)
+//   blobs: the shared switches arrays (model->sw_mem) and
+//          their adjacency arrays (model->sw_adj_mem)
+//   blobs: pinw, devs, conn_point_names, connpt_index,
+//          conn_point_dests, switches not in sw_mem for each
+//          tile, then the string array
+//   struct fpga_tile[x_width*y_height]
+//
+// Pointers inside the saved devs and tiles are replaced with
+// file offsets, 0 stays 0. The used_switches bitsets are not
+// saved, they are all 0 in a fresh model. Bump CACHE_VERSION whenever the
+// layout or one of the saved structures changes. Since the
+// model is rebuilt by the code that writes the snapshot, the
+// source stamp CACHE_BUILD_ID makes sure that no snapshot
+// outlives a change to that code (see model_cache.o in
+// libs/Makefile).
+//
+
+#define CACHE_MAGIC	"FPGAMDL"
+#define CACHE_VERSION	8
+#ifndef CACHE_BUILD_ID
+#define CACHE_BUILD_ID	""
+#endif
+#define CACHE_ALIGN	8
+
+struct cache_hdr
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t sizeof_ptr, sizeof_model, sizeof_tile, sizeof_dev;
+	uint32_t sizeof_str16; // see STRIDX_BITS
+	char build_id[32];
+	uint64_t file_len;
+	uint64_t model_o, tiles_o;
+
+	int32_t str_highest_index, str_num_bins;
+	uint64_t str_bin_offsets_o, str_index_to_bin_o;
+	uint64_t str_bin_len_o, str_bins_o; // bins_o: uint64_t[num_bins]
+};
+
+#define CACHE_OFF(u64)		((void*) (uintptr_t) (u64))
+#define CACHE_PTR(map, p)	((p) ? (void*) ((char*) (map) + (uintptr_t) (p)) : 0)
+
+static const char* cache_path(struct fpga_model* model)
+{
+	static char path[1024];
+	const char* dir, *home;
+	char key[sizeof(model->cfg_columns)
+		+ sizeof(model->cfg_left_wiring)
+		+ sizeof(model->cfg_right_wiring) + 16];
+
+	dir = getenv("FPGATOOLS_MODEL_CACHE");
+	if (dir) {
+		if (!*dir || !strcmp(dir, "off"))
+			return 0;
+		snprintf(path, sizeof(path), "%s", dir);
+	} else if ((dir = getenv("XDG_CACHE_HOME")) && *dir)
+		snprintf(path, sizeof(path), "%s/fpgatools", dir);
+	else if ((home = getenv("HOME")) && *home) {
+		snprintf(path, sizeof(path), "%s/.cache", home);
+		mkdir(path, 0755);
+		snprintf(path, sizeof(path), "%s/.cache/fpgatools", home);
+	} else
+		return 0;
+	mkdir(path, 0755);
+
+	snprintf(key, sizeof(key), "%i %s %s %s", model->cfg_rows,
+		model->cfg_columns, model->cfg_left_wiring,
+		model->cfg_right_wiring);
+	snprintf(&path[strlen(path)], sizeof(path)-strlen(path),
+		"/model-%08x.bin", hash_djb2((const unsigned char*) key));
+	return path;
+}
+
+// cache_put() appends a blob to the snapshot and returns its offset
+// in *off, or 0 if the blob is empty.
+static int cache_put(FILE* f, const void* data, size_t len, uint64_t* off)
+{
+	static const uint8_t pad[CACHE_ALIGN];
+	long pos;
+
+	*off = 0;
+	if (!len) return 0;
+	pos = ftell(f);
+	if (pos < 0) return errno;
+	if (pos % CACHE_ALIGN) {
+		if (fwrite(pad, CACHE_ALIGN - pos%CACHE_ALIGN, 1, f) != 1)
+			return EIO;
+		pos += CACHE_ALIGN - pos%CACHE_ALIGN;
+	}
+	if (fwrite(data, len, 1, f) != 1)
+		return EIO;
+	*off = pos;
+	return 0;
+}
+
+static int cache_write(FILE* f, struct fpga_model* model)
+{
+	struct cache_hdr hdr;
+	struct fpga_tile* tiles, *tile;
+	struct fpga_device* devs;
+	uint64_t* bins_o, off, sw_off, sw_adj_off;
+	int num_tiles, i, j, rc;
+
+	tiles = 0;
+	devs = 0;
+	bins_o = 0;
+	memset(&hdr, 0, sizeof(hdr));
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1) FAIL(EIO);
+	rc = cache_put(f, model, sizeof(*model), &hdr.model_o);
+	if (rc) FAIL(rc);
+	rc = cache_put(f, model->sw_mem, model->sw_mem_len, &sw_off);
+	if (rc) FAIL(rc);
+	rc = cache_put(f, model->sw_adj_mem, model->sw_adj_mem_len,
+		&sw_adj_off);
+	if (rc) FAIL(rc);
+
+	num_tiles = model->x_width * model->y_height;
+	tiles = malloc(num_tiles * sizeof(*tiles));
+	if (!tiles) FAIL(ENOMEM);
+	memcpy(tiles, model->tiles, num_tiles * sizeof(*tiles));
+	for (i = 0; i < num_tiles; i++) {
+		tile = &tiles[i];
+		if (tile->num_devs) {
+			devs = malloc(tile->num_devs * sizeof(*devs));
+			if (!devs) FAIL(ENOMEM);
+			memcpy(devs, tile->devs, tile->num_devs * sizeof(*devs));
+			for (j = 0; j < tile->num_devs; j++) {
+				// Snapshots are only taken of freshly
+				// built models without configuration.
+				if (devs[j].instantiated) FAIL(EINVAL);
+				rc = cache_put(f, devs[j].pinw,
+					devs[j].num_pinw_total*sizeof(*devs[j].pinw),
+					&off);
+				if (rc) FAIL(rc);
+				devs[j].pinw = CACHE_OFF(off);
+			}
+			rc = cache_put(f, devs, tile->num_devs*sizeof(*devs), &off);
+			if (rc) FAIL(rc);
+			tile->devs = CACHE_OFF(off);
+			free(devs);
+			devs = 0;
+		}
+		rc = cache_put(f, tile->conn_point_names,
+			tile->num_conn_point_names*2*sizeof(str16_t), &off);
+		if (rc) FAIL(rc);
+		tile->conn_point_names = CACHE_OFF(off);
+		rc = cache_put(f, tile->connpt_index,
+			tile->connpt_index_size*sizeof(str16_t), &off);
+		if (rc) FAIL(rc);
+		tile->connpt_index = CACHE_OFF(off);
+		rc = cache_put(f, tile->conn_point_dests,
+			tile->num_conn_point_dests*3*sizeof(str16_t), &off);
+		if (rc) FAIL(rc);
+		tile->conn_point_dests = CACHE_OFF(off);
+		if (tile->switches && (char*) tile->switches
+			>= (char*) model->sw_mem && (char*) tile->switches
+			< (char*) model->sw_mem + model->sw_mem_len)
+			off = sw_off + ((char*) tile->switches
+				- (char*) model->sw_mem);
+		else {
+			rc = cache_put(f, tile->switches,
+				tile->num_switches*sizeof(uint32_t), &off);
+			if (rc) FAIL(rc);
+		}
+		tile->switches = CACHE_OFF(off);
+		tile->used_switches = 0;
+		tile->sw_adj = tile->sw_adj ? CACHE_OFF(sw_adj_off
+			+ ((char*) tile->sw_adj - (char*) model->sw_adj_mem)) : 0;
+	}
+
+	hdr.str_highest_index = model->str.highest_index;
+	hdr.str_num_bins = model->str.num_bins;
+	rc = cache_put(f, model->str.bin_offsets, model->str.highest_index
+		* sizeof(*model->str.bin_offsets), &hdr.str_bin_offsets_o);
+	if (rc) FAIL(rc);
+	rc = cache_put(f, model->str.index_to_bin, model->str.highest_index
+		* sizeof(*model->str.index_to_bin), &hdr.str_index_to_bin_o);
+	if (rc) FAIL(rc);
+	rc = cache_put(f, model->str.bin_len, model->str.num_bins
+		* sizeof(*model->str.bin_len), &hdr.str_bin_len_o);
+	if (rc) FAIL(rc);
+	bins_o = calloc(model->str.num_bins, sizeof(*bins_o));
+	if (!bins_o) FAIL(ENOMEM);
+	for (i = 0; i < model->str.num_bins; i++) {
+		rc = cache_put(f, model->str.bin_strings[i],
+			model->str.bin_len[i], &bins_o[i]);
+		if (rc) FAIL(rc);
+	}
+	rc = cache_put(f, bins_o, model->str.num_bins * sizeof(*bins_o),
+		&hdr.str_bins_o);
+	if (rc) FAIL(rc);
+	rc = cache_put(f, tiles, num_tiles * sizeof(*tiles), &hdr.tiles_o);
+	if (rc) FAIL(rc);
+
+	memcpy(hdr.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	hdr.version = CACHE_VERSION;
+	hdr.sizeof_ptr = sizeof(void*);
+	hdr.sizeof_model = sizeof(struct fpga_model);
+	hdr.sizeof_tile = sizeof(struct fpga_tile);
+	hdr.sizeof_dev = sizeof(struct fpga_device);
+	hdr.sizeof_str16 = sizeof(str16_t);
+	strncpy(hdr.build_id, CACHE_BUILD_ID, sizeof(hdr.build_id)-1);
+	hdr.file_len = ftell(f);
+	if (fseek(f, 0, SEEK_SET)) FAIL(errno);
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1) FAIL(EIO);
+
+	free(bins_o);
+	free(tiles);
+	return 0;
+fail:
+	free(bins_o);
+	free(devs);
+	free(tiles);
+	return rc;
+}
+
+int fpga_cache_save(struct fpga_model* model)
+{
+	const char* path;
+	char tmp_path[1024+32];
+	FILE* f;
+	int rc;
+
+	path = cache_path(model);
+	if (!path) return 0;
+
+	// Write to a temporary file first so that a concurrent
+	// fpga_cache_load() never sees a partial snapshot.
+	snprintf(tmp_path, sizeof(tmp_path), "%s.%i", path, (int) getpid());
+	f = fopen(tmp_path, "w");
+	if (!f) return errno;
+	rc = cache_write(f, model);
+	if (fclose(f) && !rc)
+		rc = EIO;
+	if (!rc && rename(tmp_path, path))
+		rc = errno;
+	if (rc) {
+		unlink(tmp_path);
+		FAIL(rc);
+	}
+	return 0;
+fail:
+	return rc;
+}
+
+// cache_blob() returns whether count elements of size bytes at
+// file offset off are inside the snapshot.
+static int cache_blob(size_t len, uint64_t off, int64_t count, size_t size)
+{
+	if (count < 0) return 0;
+	if (!count) return 1;
+	return off >= sizeof(struct cache_hdr) && off <= len
+	    && (uint64_t) count*size <= len - off;
+}
+
+// Tiles with the same switchbox share their switches and sw_adj
+// arrays, cache_check_tile() checks each pair only once.
+struct cache_sw_seen
+{
+	uint64_t switches_o, sw_adj_o;
+	int num_switches;
+	int num_connpts; // lowest num_conn_point_names the arrays allow
+};
+
+// Returns the number of connpts that the switches and sw_adj
+// arrays of tile refer to, or -1 if they are not valid.
+static int cache_check_switches(const struct cache_hdr* hdr, size_t len,
+	const struct fpga_tile* tile)
+{
+	const uint32_t* switches;
+	const int* adj;
+	int num_connpts, num_adj, next, i;
+
+	if (!cache_blob(len, (uintptr_t) tile->switches,
+		tile->num_switches, sizeof(*tile->switches))
+	    || !tile->sw_adj
+	    || !cache_blob(len, (uintptr_t) tile->sw_adj, 1, sizeof(int)))
+		return -1;
+	switches = CACHE_PTR(hdr, tile->switches);
+	adj = CACHE_PTR(hdr, tile->sw_adj);
+	num_adj = adj[0];
+	if (num_adj < 0 || !cache_blob(len, (uintptr_t) tile->sw_adj,
+		1 + 2*(int64_t) num_adj + 2*(int64_t) tile->num_switches,
+		sizeof(int)))
+		return -1;
+	num_connpts = num_adj;
+	for (i = 0; i < tile->num_switches; i++) {
+		if (SW_FROM_I(switches[i]) >= num_connpts)
+			num_connpts = SW_FROM_I(switches[i])+1;
+		if (SW_TO_I(switches[i]) >= num_connpts)
+			num_connpts = SW_TO_I(switches[i])+1;
+	}
+	// the sw_adj chains must run in index order, see SW_ADJ_NEXT()
+	for (i = 0; i < 2*num_adj; i++) {
+		if (adj[1+i] < NO_SWITCH || adj[1+i] >= tile->num_switches)
+			return -1;
+	}
+	for (i = 0; i < 2*tile->num_switches; i++) {
+		next = adj[1 + 2*num_adj + i];
+		if (next != NO_SWITCH && (next <= i % tile->num_switches
+		    || next >= tile->num_switches))
+			return -1;
+	}
+	return num_connpts;
+}
+
+// Every offset, count and index of a tile is checked before the
+// tile is used, so a truncated or corrupt snapshot is rejected
+// instead of crashing the model build.
+static int cache_check_tile(const struct cache_hdr* hdr, size_t len,
+	const struct fpga_model* saved, const struct fpga_tile* tile,
+	struct cache_sw_seen* seen, int seen_size)
+{
+	struct fpga_tile t;
+	const struct fpga_device* devs;
+	const str16_t* pinw;
+	int i, j, h;
+
+	// t gets pointers into the snapshot, so that the model.h
+	// macros can be used
+	t = *tile;
+	if (!cache_blob(len, (uintptr_t) t.devs, t.num_devs, sizeof(*t.devs)))
+		return 0;
+	devs = CACHE_PTR(hdr, t.devs);
+	for (i = 0; i < t.num_devs; i++) {
+		if ((unsigned) devs[i].type > DEV_MCB
+		    || devs[i].instantiated || devs[i].pinw_req_for_cfg
+		    || devs[i].num_pinw_in < 0
+		    || devs[i].num_pinw_in > devs[i].num_pinw_total
+		    || !cache_blob(len, (uintptr_t) devs[i].pinw,
+			devs[i].num_pinw_total, sizeof(*devs[i].pinw)))
+			return 0;
+		pinw = CACHE_PTR(hdr, devs[i].pinw);
+		for (j = 0; j < devs[i].num_pinw_total; j++) {
+			if (pinw[j] > hdr->str_highest_index)
+				return 0;
+		}
+	}
+
+	if (t.num_conn_point_names > SWITCH_MAX_CONNPT_O+1
+	    || !cache_blob(len, (uintptr_t) t.conn_point_names,
+		2*(int64_t) t.num_conn_point_names, sizeof(str16_t))
+	    || t.connpt_index_size != connpt_index_size(t.num_conn_point_names)
+	    || !cache_blob(len, (uintptr_t) t.connpt_index,
+		t.connpt_index_size, sizeof(str16_t))
+	    || !cache_blob(len, (uintptr_t) t.conn_point_dests,
+		3*(int64_t) t.num_conn_point_dests, sizeof(str16_t)))
+		return 0;
+	t.conn_point_names = CACHE_PTR(hdr, t.conn_point_names);
+	t.connpt_index = CACHE_PTR(hdr, t.connpt_index);
+	t.conn_point_dests = CACHE_PTR(hdr, t.conn_point_dests);
+	for (i = 0; i < t.num_conn_point_names; i++) {
+		if (CONNPT_DESTS_O(&t, i) > t.num_conn_point_dests
+		    || CONNPT_STR16(&t, i) > hdr->str_highest_index)
+			return 0;
+	}
+	for (i = 0; i < t.connpt_index_size; i++) {
+		if (t.connpt_index[i] > t.num_conn_point_names)
+			return 0;
+	}
+	for (i = 0; i < t.num_conn_point_dests; i++) {
+		if (CONN_DEST_X(&t, i) >= saved->x_width
+		    || CONN_DEST_Y(&t, i) >= saved->y_height
+		    || CONN_DEST_STR(&t, i) > hdr->str_highest_index)
+			return 0;
+	}
+
+	if (t.num_switches < 0) return 0;
+	if (!t.num_switches) return !t.sw_adj;
+	for (h = ((uintptr_t) tile->switches >> 2) & (seen_size-1);
+	     seen[h].switches_o; h = (h+1) & (seen_size-1)) {
+		if (seen[h].switches_o == (uintptr_t) tile->switches
+		    && seen[h].sw_adj_o == (uintptr_t) tile->sw_adj
+		    && seen[h].num_switches == t.num_switches)
+			break;
+	}
+	if (!seen[h].switches_o) {
+		seen[h].num_connpts = cache_check_switches(hdr, len, tile);
+		if (seen[h].num_connpts < 0)
+			return 0;
+		seen[h].switches_o = (uintptr_t) tile->switches;
+		seen[h].sw_adj_o = (uintptr_t) tile->sw_adj;
+		seen[h].num_switches = t.num_switches;
+	}
+	return seen[h].num_connpts <= t.num_conn_point_names;
+}
+
+static int cache_check(const struct cache_hdr* hdr, size_t len,
+	const struct fpga_model* key)
+{
+	const struct fpga_model* saved;
+	const struct fpga_tile* tiles;
+	struct cache_sw_seen* seen;
+	const uint64_t* bins_o;
+	const int* bin_len;
+	int num_tiles, seen_size, i;
+
+	if (len < sizeof(*hdr)
+	    || memcmp(hdr->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC))
+	    || hdr->version != CACHE_VERSION
+	    || hdr->sizeof_ptr != sizeof(void*)
+	    || hdr->sizeof_model != sizeof(struct fpga_model)
+	    || hdr->sizeof_tile != sizeof(struct fpga_tile)
+	    || hdr->sizeof_dev != sizeof(struct fpga_device)
+	    || hdr->sizeof_str16 != sizeof(str16_t)
+	    || strncmp(hdr->build_id, CACHE_BUILD_ID, sizeof(hdr->build_id))
+	    || hdr->file_len != len
+	    || !hdr->model_o || !hdr->tiles_o
+	    || !hdr->str_bin_offsets_o || !hdr->str_index_to_bin_o
+	    || !hdr->str_bin_len_o || !hdr->str_bins_o
+	    || !cache_blob(len, hdr->model_o, 1, sizeof(struct fpga_model)))
+		return 0;
+	saved = (void*) ((char*) hdr + hdr->model_o);
+	if (saved->cfg_rows != key->cfg_rows
+	    || strcmp(saved->cfg_columns, key->cfg_columns)
+	    || strcmp(saved->cfg_left_wiring, key->cfg_left_wiring)
+	    || strcmp(saved->cfg_right_wiring, key->cfg_right_wiring))
+		return 0;
+
+	// The bin contents are checked by strarray_load_bin(), the
+	// index by strarray_check().
+	if (hdr->str_highest_index <= 0
+	    || hdr->str_highest_index > STRIDX_MAX
+	    || hdr->str_num_bins != hdr->str_highest_index / 64
+	    || !cache_blob(len, hdr->str_bin_offsets_o,
+		hdr->str_highest_index, sizeof(*key->str.bin_offsets))
+	    || !cache_blob(len, hdr->str_index_to_bin_o,
+		hdr->str_highest_index, sizeof(*key->str.index_to_bin))
+	    || !cache_blob(len, hdr->str_bin_len_o,
+		hdr->str_num_bins, sizeof(*bin_len))
+	    || !cache_blob(len, hdr->str_bins_o,
+		hdr->str_num_bins, sizeof(*bins_o)))
+		return 0;
+
+	// the model fields that fpga_cache_load() takes over
+	if (!saved->frozen
+	    || saved->x_width <= 0 || saved->y_height <= 0
+	    || saved->x_width > sizeof(saved->x_major)/sizeof(*saved->x_major)
+	    || saved->center_x < 0 || saved->center_x >= saved->x_width
+	    || saved->center_y < 0 || saved->center_y >= saved->y_height
+	    || saved->left_gclk_sep_x < 0
+	    || saved->left_gclk_sep_x >= saved->x_width
+	    || saved->right_gclk_sep_x < 0
+	    || saved->right_gclk_sep_x >= saved->x_width)
+		return 0;
+	for (i = 0; i < saved->x_width; i++) {
+		if (saved->x_major[i] < 0
+		    || saved->x_major[i] > saved->x_width)
+			return 0;
+	}
+	num_tiles = saved->x_width * saved->y_height;
+	if (!cache_blob(len, hdr->tiles_o, num_tiles, sizeof(*tiles)))
+		return 0;
+	tiles = (void*) ((char*) hdr + hdr->tiles_o);
+	for (seen_size = 16; seen_size < num_tiles*2; seen_size *= 2);
+	seen = calloc(seen_size, sizeof(*seen));
+	if (!seen) return 0;
+	for (i = 0; i < num_tiles; i++) {
+		if (!cache_check_tile(hdr, len, saved, &tiles[i],
+			seen, seen_size))
+			break;
+	}
+	free(seen);
+	if (i < num_tiles)
+		return 0;
+
+	bin_len = (void*) ((char*) hdr + hdr->str_bin_len_o);
+	bins_o = (void*) ((char*) hdr + hdr->str_bins_o);
+	for (i = 0; i < hdr->str_num_bins; i++) {
+		if (!cache_blob(len, bins_o[i], bin_len[i], 1))
+			return 0;
+	}
+	return 1;
+}
+
+// cache_unload() takes back a partial fpga_cache_load(), the devs
+// of the first num_devs_tiles tiles have been copied.
+static void cache_unload(struct fpga_model* model, int num_devs_tiles)
+{
+	int i;
+
+	for (i = 0; i < num_devs_tiles; i++)
+		free(model->tiles[i].devs);
+	free(model->tiles);
+	model->tiles = 0;
+	free(model->tile_mem);
+	model->tile_mem = 0;
+	model->tile_mem_len = 0;
+	free(model->tmp_str);
+	model->tmp_str = 0;
+	strarray_free(&model->str);
+	munmap(model->cache_map, model->cache_map_len);
+	model->cache_map = 0;
+	model->cache_map_len = 0;
+	model->x_width = 0;
+	model->y_height = 0;
+	model->frozen = 0;
+}
+
+int fpga_cache_load(struct fpga_model* model)
+{
+	const char* path;
+	struct stat st;
+	struct cache_hdr* hdr;
+	struct fpga_model* saved;
+	struct fpga_tile* tile;
+	struct fpga_device* devs;
+	uint64_t* bins_o;
+	uint32_t* used;
+	size_t used_words;
+	int* bin_len;
+	void* map;
+	int fd, num_tiles, num_devs_tiles, i, j, rc;
+
+	num_devs_tiles = 0;
+	path = cache_path(model);
+	if (!path) return ENOENT;
+	fd = open(path, O_RDONLY);
+	if (fd == -1) return ENOENT;
+	if (fstat(fd, &st) || !st.st_size) {
+		close(fd);
+		return ENOENT;
+	}
+	// The mapping is private so that switches can be enabled
+	// in the mapped arrays without touching the file.
+	map = mmap(0, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) return ENOENT;
+	hdr = map;
+	if (!cache_check(hdr, st.st_size, model)) {
+		munmap(map, st.st_size);
+		// rebuilding the model saves a new snapshot
+		unlink(path);
+		return ENOENT;
+	}
+	saved = (void*) ((char*) map + hdr->model_o);
+
+	model->x_width = saved->x_width;
+	model->y_height = saved->y_height;
+	model->center_x = saved->center_x;
+	model->center_y = saved->center_y;
+	model->left_gclk_sep_x = saved->left_gclk_sep_x;
+	model->right_gclk_sep_x = saved->right_gclk_sep_x;
+	memcpy(model->x_major, saved->x_major, sizeof(model->x_major));
+	model->frozen = saved->frozen;
+	model->cache_map = map;
+	model->cache_map_len = st.st_size;
+
+	model->tmp_str = malloc((model->x_width > model->y_height
+		? model->x_width : model->y_height) * sizeof(*model->tmp_str));
+	if (!model->tmp_str) FAIL(ENOMEM);
+
+	num_tiles = model->x_width * model->y_height;
+	model->tiles = malloc(num_tiles * sizeof(*model->tiles));
+	if (!model->tiles) FAIL(ENOMEM);
+	memcpy(model->tiles, (char*) map + hdr->tiles_o,
+		num_tiles * sizeof(*model->tiles));
+	for (i = 0; i < num_tiles; i++) {
+		tile = &model->tiles[i];
+		if (tile->num_devs) {
+			// devs are copied because free_devices() frees them
+			devs = malloc(tile->num_devs * sizeof(*devs));
+			if (!devs) FAIL(ENOMEM);
+			memcpy(devs, (char*) map + (uintptr_t) tile->devs,
+				tile->num_devs * sizeof(*devs));
+			for (j = 0; j < tile->num_devs; j++)
+				devs[j].pinw = CACHE_PTR(map, devs[j].pinw);
+			tile->devs = devs;
+		} else
+			tile->devs = 0;
+		num_devs_tiles = i+1;
+		tile->conn_point_names = CACHE_PTR(map, tile->conn_point_names);
+		tile->connpt_index = CACHE_PTR(map, tile->connpt_index);
+		tile->conn_point_dests = CACHE_PTR(map, tile->conn_point_dests);
+		tile->switches = CACHE_PTR(map, tile->switches);
+		tile->sw_adj = CACHE_PTR(map, tile->sw_adj);
+	}
+
+	// all used_switches bitsets in one zeroed block
+	used_words = 0;
+	for (i = 0; i < num_tiles; i++)
+		used_words += SW_USED_WORDS(model->tiles[i].num_switches);
+	used = calloc(used_words ? used_words : 1, sizeof(*used));
+	if (!used) FAIL(ENOMEM);
+	model->tile_mem = used;
+	model->tile_mem_len = used_words*sizeof(*used);
+	for (i = 0; i < num_tiles; i++) {
+		tile = &model->tiles[i];
+		tile->used_switches = tile->num_switches ? used : 0;
+		used += SW_USED_WORDS(tile->num_switches);
+	}
+
+	rc = strarray_init(&model->str, hdr->str_highest_index);
+	if (rc) {
+		memset(&model->str, 0, sizeof(model->str));
+		FAIL(ENOMEM);
+	}
+	if (model->str.num_bins != hdr->str_num_bins) FAIL(EINVAL);
+	memcpy(model->str.bin_offsets, (char*) map + hdr->str_bin_offsets_o,
+		hdr->str_highest_index * sizeof(*model->str.bin_offsets));
+	memcpy(model->str.index_to_bin, (char*) map + hdr->str_index_to_bin_o,
+		hdr->str_highest_index * sizeof(*model->str.index_to_bin));
+	bin_len = (void*) ((char*) map + hdr->str_bin_len_o);
+	bins_o = (void*) ((char*) map + hdr->str_bins_o);
+	for (i = 0; i < hdr->str_num_bins; i++) {
+		rc = strarray_load_bin(&model->str, i,
+			CACHE_PTR(map, bins_o[i]), bin_len[i]);
+		if (rc) FAIL(rc);
+	}
+	rc = strarray_check(&model->str);
+	if (rc) FAIL(rc);
+	return 0;
+fail:
+	// Any snapshot that cannot be loaded is thrown away and the
+	// model is built from scratch.
+	cache_unload(model, num_devs_tiles);
+	if (rc != ENOMEM)
+		unlink(path);
+	return ENOENT;
+}
@@ -24,6 +24,9 @@ int init_conns(struct fpga_model* model)
 {
 	int rc;
 
+	rc = stage_open(model);
+	if (rc) goto xout;
+
 	rc = connect_logic_carry(model);
 	if (rc) goto xout;
 
@@ -49,11 +52,46 @@ int init_conns(struct fpga_model* model)
 
 	rc = run_dirwires(model);
 	if (rc) goto xout;
+
+	rc = stage_commit(model);
+	if (rc) goto xout;
 	return 0;
 xout:
 	return rc;
 }
 
+int freeze_conns(struct fpga_model* model)
+{
+	struct fpga_tile* tile;
+	str16_t* triples;
+	int i, j, n, max_dests;
+
+	if (model->frozen) return 0;
+	max_dests = 0;
+	for (i = 0; i < model->x_width * model->y_height; i++) {
+		if (model->tiles[i].num_conn_point_dests > max_dests)
+			max_dests = model->tiles[i].num_conn_point_dests;
+	}
+	triples = malloc((max_dests ? max_dests : 1)*3*sizeof(*triples));
+	if (!triples) {
+		OUT_OF_MEM();
+		return ENOMEM;
+	}
+	for (i = 0; i < model->x_width * model->y_height; i++) {
+		tile = &model->tiles[i];
+		n = tile->num_conn_point_dests;
+		memcpy(triples, tile->conn_point_dests, n*3*sizeof(*triples));
+		for (j = 0; j < n; j++) {
+			tile->conn_point_dests[j] = triples[j*3];
+			tile->conn_point_dests[n+j] = triples[j*3+1];
+			tile->conn_point_dests[2*n+j] = triples[j*3+2];
+		}
+	}
+	free(triples);
+	model->frozen = 1;
+	return 0;
+}
+
 static int connect_logic_carry(struct fpga_model* model)
 {
 	int x, y, rc;
@@ -347,7 +347,8 @@ void free_devices(struct fpga_model* model)
 				fdev_delete(model, y, x, tile->devs[i].type,
 					fdev_typeidx(model, y, x, i));
 			}
-			free(tile->devs);
+			if (!in_tile_mem(model, tile->devs))
+				free(tile->devs);
 			tile->devs = 0;
 			tile->num_devs = 0;
 		}
@@ -364,6 +365,9 @@ static int add_dev(struct fpga_model* model,
 	int rc;
 
 	tile = YX_TILE(model, y, x);
+	tile->devs = tile_array_own(model, tile->devs, tile->num_devs,
+		sizeof(*tile->devs), DEV_INCREMENT);
+	EXIT(tile->num_devs && !tile->devs);
 	if (!(tile->num_devs % DEV_INCREMENT)) {
 		void* new_ptr = realloc(tile->devs,
 			(tile->num_devs+DEV_INCREMENT)*sizeof(*tile->devs));
@@ -15,8 +15,10 @@ const char* pf(const char* fmt, ...)
 {
 	// safe to call it NUM_PF_BUFStimes in 1 expression,
 	// such as function params or a net structure
-	static char pf_buf[NUM_PF_BUFS][128];
-	static int last_buf = 0;
+	// The buffers are per thread so that multiple threads
+	// can build parts of the model at the same time.
+	static __thread char pf_buf[NUM_PF_BUFS][128];
+	static __thread int last_buf = 0;
 	va_list list;
 	last_buf = (last_buf+1)%NUM_PF_BUFS;
 	pf_buf[last_buf][0] = 0;
@@ -28,8 +30,8 @@ const char* pf(const char* fmt, ...)
 
 const char* wpref(struct fpga_model* model, int y, int x, const char* wire_name)
 {
-	static char buf[8][128];
-	static int last_buf = 0;
+	static __thread char buf[8][128];
+	static __thread int last_buf = 0;
 	const char *prefix;
 	int i;
 
@@ -98,7 +100,7 @@ int has_connpt(struct fpga_model* model, int y, int x,
 	const char* name)
 {
 	struct fpga_tile* tile;
-	uint16_t name_i;
+	str16_t name_i;
 	int i;
 
 	i = strarray_find(&model->str, name);
@@ -107,63 +109,144 @@ int has_connpt(struct fpga_model* model, int y, int x,
 	name_i = i;
 
 	tile = YX_TILE(model, y, x);
-	for (i = 0; i < tile->num_conn_point_names; i++) {
-		if (tile->conn_point_names[i*2+1] == name_i)
-			return 1;
+	return connpt_lookup(tile, name_i) != -1;
+}
+
+#define CONNPT_INDEX_MIN	16
+#define CONNPT_HASH(name_i, size) \
+	((((uint32_t) (name_i) * 2654435761u) >> 16) & ((size)-1))
+
+int connpt_index_size(int num_names)
+{
+	int size;
+
+	if (!num_names) return 0;
+	for (size = CONNPT_INDEX_MIN; size < num_names*2; size *= 2);
+	return size;
+}
+
+static void connpt_index_insert(str16_t* index, int index_size,
+	str16_t name_i, int connpt_o)
+{
+	int h;
+
+	for (h = CONNPT_HASH(name_i, index_size); index[h];
+		h = (h+1) & (index_size-1));
+	index[h] = connpt_o+1;
+}
+
+void connpt_index_fill(const struct fpga_tile* tile, str16_t* index,
+	int index_size)
+{
+	int i;
+
+	memset(index, 0, index_size*sizeof(*index));
+	for (i = 0; i < tile->num_conn_point_names; i++)
+		connpt_index_insert(index, index_size,
+			tile->conn_point_names[i*2+1], i);
+}
+
+int connpt_lookup(const struct fpga_tile* tile, str16_t name_i)
+{
+	int h, connpt_o;
+
+	if (!tile->connpt_index_size) return -1;
+	for (h = CONNPT_HASH(name_i, tile->connpt_index_size);
+		tile->connpt_index[h];
+		h = (h+1) & (tile->connpt_index_size-1)) {
+		connpt_o = tile->connpt_index[h]-1;
+		if (tile->conn_point_names[connpt_o*2+1] == name_i)
+			return connpt_o;
 	}
-	return 0;
+	return -1;
 }
 
 #define CONN_NAMES_INCREMENT	128
 
 // add_switch() assumes that the new element is appended
 // at the end of the array.
-static void connpt_names_array_append(struct fpga_tile* tile, int name_i)
+static void connpt_names_array_append(struct fpga_model* model,
+	struct fpga_tile* tile, int name_i)
 {
+	tile->conn_point_names = tile_array_own(model, tile->conn_point_names,
+		tile->num_conn_point_names, 2*sizeof(str16_t),
+		CONN_NAMES_INCREMENT);
+	EXIT(tile->num_conn_point_names && !tile->conn_point_names);
 	if (!(tile->num_conn_point_names % CONN_NAMES_INCREMENT)) {
-		uint16_t* new_ptr = realloc(tile->conn_point_names,
-			(tile->num_conn_point_names+CONN_NAMES_INCREMENT)*2*sizeof(uint16_t));
+		str16_t* new_ptr = realloc(tile->conn_point_names,
+			(tile->num_conn_point_names+CONN_NAMES_INCREMENT)*2*sizeof(str16_t));
 		if (!new_ptr) EXIT(ENOMEM);
 		tile->conn_point_names = new_ptr;
 	}
 	tile->conn_point_names[tile->num_conn_point_names*2] = tile->num_conn_point_dests;
 	tile->conn_point_names[tile->num_conn_point_names*2+1] = name_i;
 	tile->num_conn_point_names++;
+
+	if (tile->num_conn_point_names*2 > tile->connpt_index_size) {
+		int new_size = connpt_index_size(tile->num_conn_point_names);
+		str16_t* new_index = malloc(new_size*sizeof(*new_index));
+		if (!new_index) EXIT(ENOMEM);
+		connpt_index_fill(tile, new_index, new_size);
+		if (!in_tile_mem(model, tile->connpt_index))
+			free(tile->connpt_index);
+		tile->connpt_index = new_index;
+		tile->connpt_index_size = new_size;
+	} else
+		connpt_index_insert(tile->connpt_index, tile->connpt_index_size,
+			name_i, tile->num_conn_point_names-1);
 }
 
 int add_connpt_name(struct fpga_model* model, int y, int x,
-	const char* connpt_name, int warn_if_duplicate, uint16_t* name_i,
+	const char* connpt_name, int warn_if_duplicate, str16_t* name_i,
 	int* conn_point_o)
 {
-	struct fpga_tile* tile;
-	uint16_t _name_i;
 	int rc, i;
 
-	tile = &model->tiles[y * model->x_width + x];
 	rc = strarray_add(&model->str, connpt_name, &i);
 	if (rc) return rc;
-	if (i > 0xFFFF) {
+	if (i > STRIDX_MAX) {
 		fprintf(stderr, "Internal error in %s:%i\n", __FILE__, __LINE__);
 		return -1;
 	}
-	_name_i = i;
 	if (name_i) *name_i = i;
+	if (model->stage) {
+		// the offset is only known after the stage is committed
+		if (conn_point_o) {
+			HERE();
+			return -1;
+		}
+		return stage_connpt(model, y, x, i, warn_if_duplicate);
+	}
+	return add_connpt_name_i(model, y, x, i, warn_if_duplicate,
+		conn_point_o);
+}
 
-	// Search for an existing connection point under name.
-	for (i = 0; i < tile->num_conn_point_names; i++) {
-		if (tile->conn_point_names[i*2+1] == _name_i)
-			break;
+int add_connpt_name_i(struct fpga_model* model, int y, int x,
+	str16_t name_i, int warn_if_duplicate, int* conn_point_o)
+{
+	struct fpga_tile* tile;
+	int i;
+
+	if (model->frozen) {
+		HERE();
+		return EINVAL;
 	}
+	tile = &model->tiles[y * model->x_width + x];
+
+	// Search for an existing connection point under name.
+	i = connpt_lookup(tile, name_i);
+	if (i == -1)
+		i = tile->num_conn_point_names;
 	if (conn_point_o) *conn_point_o = i;
 	if (i < tile->num_conn_point_names) {
 		if (warn_if_duplicate)
 			fprintf(stderr,
 				"Duplicate connection point name y%02i x%02u %s\n",
-				y, x, connpt_name);
+				y, x, strarray_lookup(&model->str, name_i));
 		return 0;
 	}
 	// This is the first connection under name, add name.
-	connpt_names_array_append(tile, _name_i);
+	connpt_names_array_append(model, tile, name_i);
 	return 0;
 }
 
@@ -219,22 +302,33 @@ xout:
 
 int add_conn_uni(struct fpga_model* model, int y1, int x1, const char* name1, int y2, int x2, const char* name2)
 {
-	struct fpga_tile* tile;
-	uint16_t name1_i, name2_i;
-	uint16_t* new_ptr;
-	int conn_start, num_conn_point_dests_for_this_wire, rc, j, conn_point_o;
-
-	rc = add_connpt_name(model, y1, x1, name1, 0 /* warn_if_duplicate */,
-		&name1_i, &conn_point_o);
-	if (rc) goto xout;
+	int rc, name1_i, name2_i;
 
-	rc = strarray_add(&model->str, name2, &j);
+	rc = strarray_add(&model->str, name1, &name1_i);
 	if (rc) return rc;
-	if (j > 0xFFFF) {
+	rc = strarray_add(&model->str, name2, &name2_i);
+	if (rc) return rc;
+	if (name1_i > STRIDX_MAX || name2_i > STRIDX_MAX) {
 		fprintf(stderr, "Internal error in %s:%i\n", __FILE__, __LINE__);
 		return -1;
 	}
-	name2_i = j;
+	if (model->stage)
+		return stage_conn(model, y1, x1, name1_i, y2, x2, name2_i);
+	return add_conn_uni_i(model, y1, x1, name1_i, y2, x2, name2_i);
+}
+
+int add_conn_uni_i(struct fpga_model* model, int y1, int x1, str16_t name1_i,
+	int y2, int x2, str16_t name2_i)
+{
+	struct fpga_tile* tile;
+	str16_t* new_ptr;
+	int conn_start, num_conn_point_dests_for_this_wire, rc, j, conn_point_o;
+
+	// add_connpt_name_i() fails on a frozen model
+	rc = add_connpt_name_i(model, y1, x1, name1_i, 0 /* warn_if_duplicate */,
+		&conn_point_o);
+	if (rc) goto xout;
+
 	tile = &model->tiles[y1 * model->x_width + x1];
 	conn_start = tile->conn_point_names[conn_point_o*2];
 	if (conn_point_o+1 >= tile->num_conn_point_names)
@@ -248,10 +342,12 @@ int add_conn_uni(struct fpga_model* model, int y1, int x1, const char* name1, in
 		    && tile->conn_point_dests[j*3+1] == y2
 		    && tile->conn_point_dests[j*3+2] == name2_i) {
 			fprintf(stderr, "Duplicate conn (num_conn_point_dests %i): y%02i x%02i %s - y%02i x%02i %s.\n",
-				num_conn_point_dests_for_this_wire, y1, x1, name1, y2, x2, name2);
+				num_conn_point_dests_for_this_wire, y1, x1,
+				strarray_lookup(&model->str, name1_i), y2, x2,
+				strarray_lookup(&model->str, name2_i));
 			for (j = conn_start; j < conn_start + num_conn_point_dests_for_this_wire; j++) {
 				fprintf(stderr, "c%i: y%02i x%02i %s -> y%02i x%02i %s\n", j,
-					y1, x1, name1,
+					y1, x1, strarray_lookup(&model->str, name1_i),
 					tile->conn_point_dests[j*3+1], tile->conn_point_dests[j*3],
 					strarray_lookup(&model->str, tile->conn_point_dests[j*3+2]));
 			}
@@ -259,8 +355,11 @@ int add_conn_uni(struct fpga_model* model, int y1, int x1, const char* name1, in
 		}
 	}
 
+	tile->conn_point_dests = tile_array_own(model, tile->conn_point_dests,
+		tile->num_conn_point_dests, 3*sizeof(str16_t), CONNS_INCREMENT);
+	EXIT(tile->num_conn_point_dests && !tile->conn_point_dests);
 	if (!(tile->num_conn_point_dests % CONNS_INCREMENT)) {
-		new_ptr = realloc(tile->conn_point_dests, (tile->num_conn_point_dests+CONNS_INCREMENT)*3*sizeof(uint16_t));
+		new_ptr = realloc(tile->conn_point_dests, (tile->num_conn_point_dests+CONNS_INCREMENT)*3*sizeof(str16_t));
 		if (!new_ptr) {
 			fprintf(stderr, "Out of memory %s:%i\n", __FILE__, __LINE__);
 			return 0;
@@ -268,7 +367,7 @@ int add_conn_uni(struct fpga_model* model, int y1, int x1, const char* name1, in
 		tile->conn_point_dests = new_ptr;
 	}
 	if (tile->num_conn_point_dests > j)
-		memmove(&tile->conn_point_dests[(j+1)*3], &tile->conn_point_dests[j*3], (tile->num_conn_point_dests-j)*3*sizeof(uint16_t));
+		memmove(&tile->conn_point_dests[(j+1)*3], &tile->conn_point_dests[j*3], (tile->num_conn_point_dests-j)*3*sizeof(str16_t));
 	tile->conn_point_dests[j*3] = x2;
 	tile->conn_point_dests[j*3+1] = y2;
 	tile->conn_point_dests[j*3+2] = name2_i;
@@ -278,9 +377,11 @@ int add_conn_uni(struct fpga_model* model, int y1, int x1, const char* name1, in
 		conn_point_o++;
 	}
 #if DBG_ADD_CONN_UNI
-	printf("conn_point_dests for y%02i x%02i %s now:\n", y1, x1, name1);
+	printf("conn_point_dests for y%02i x%02i %s now:\n", y1, x1,
+		strarray_lookup(&model->str, name1_i));
 	for (j = conn_start; j < conn_start + num_conn_point_dests_for_this_wire+1; j++) {
-		fprintf(stderr, "c%i: y%02i x%02i %s -> y%02i x%02i %s\n", j, y1, x1, name1,
+		fprintf(stderr, "c%i: y%02i x%02i %s -> y%02i x%02i %s\n", j, y1, x1,
+			strarray_lookup(&model->str, name1_i),
 			tile->conn_point_dests[j*3+1], tile->conn_point_dests[j*3],
 			strarray_lookup(&model->str, tile->conn_point_dests[j*3+2]));
 	}
@@ -368,7 +469,10 @@ fail:
 
 #define SWITCH_ALLOC_INCREMENT 256
 
+// add_switch() adds missing connection points. Keep in sync with
+// model_stage.c, which does the same for staged switches.
 #define DBG_ALLOW_ADDPOINTS
+
 // Enable CHECK_DUPLICATES when working on the switch architecture,
 // but otherwise keep it disabled since it slows down building the
 // model a lot.
@@ -377,9 +481,7 @@ fail:
 int add_switch(struct fpga_model* model, int y, int x, const char* from,
 	const char* to, int is_bidirectional)
 {
-	struct fpga_tile* tile = YX_TILE(model, y, x);
-	int rc, i, from_idx, to_idx, from_connpt_o, to_connpt_o;
-	uint32_t new_switch;
+	int rc, from_idx, to_idx;
 
 // later this can be strarray_find() and not strarray_add(), but
 // then we need all wires and ports to be present first...
@@ -397,37 +499,41 @@ int add_switch(struct fpga_model* model, int y, int x, const char* from,
 			from, from_idx, to, to_idx);
 		return -1;
 	}
+	if (model->stage)
+		return stage_switch(model, y, x, from_idx, to_idx,
+			is_bidirectional);
+	return add_switch_i(model, y, x, from_idx, to_idx, is_bidirectional);
+xout:
+	return rc;
+}
 
-	// It seems searching backwards is a little faster than
-	// searching forwards. Merging the two loops into one
-	// made the total slower, presumably due to cache issues.
-	from_connpt_o = -1;
-	for (i = tile->num_conn_point_names-1; i >= 0; i--) {
-		if (tile->conn_point_names[i*2+1] == from_idx) {
-			from_connpt_o = i;
-			break;
-		}
-	}
-	to_connpt_o = -1;
-	for (i = tile->num_conn_point_names-1; i >= 0; i--) {
-		if (tile->conn_point_names[i*2+1] == to_idx) {
-			to_connpt_o = i;
-			break;
-		}
+int add_switch_i(struct fpga_model* model, int y, int x, str16_t from_idx,
+	str16_t to_idx, int is_bidirectional)
+{
+	struct fpga_tile* tile = YX_TILE(model, y, x);
+	int from_connpt_o, to_connpt_o;
+	uint32_t new_switch;
+
+	if (model->frozen) {
+		HERE();
+		return EINVAL;
 	}
+	from_connpt_o = connpt_lookup(tile, from_idx);
+	to_connpt_o = connpt_lookup(tile, to_idx);
 #ifdef DBG_ALLOW_ADDPOINTS
 	if (from_connpt_o == -1) {
 		from_connpt_o = tile->num_conn_point_names;
-		connpt_names_array_append(tile, from_idx);
+		connpt_names_array_append(model, tile, from_idx);
 	}
 	if (to_connpt_o == -1) {
 		to_connpt_o = tile->num_conn_point_names;
-		connpt_names_array_append(tile, to_idx);
+		connpt_names_array_append(model, tile, to_idx);
 	}
 #endif
 	if (from_connpt_o == -1 || to_connpt_o == -1) {
 		fprintf(stderr, "No conn point for switch from %s (%i/%i) or %s (%i/%i).\n",
-			from, from_idx, from_connpt_o, to, to_idx, to_connpt_o);
+			strarray_lookup(&model->str, from_idx), from_idx, from_connpt_o,
+			strarray_lookup(&model->str, to_idx), to_idx, to_connpt_o);
 		return -1;
 	}
 	if (from_connpt_o > SWITCH_MAX_CONNPT_O
@@ -441,14 +547,20 @@ int add_switch(struct fpga_model* model, int y, int x, const char* from,
 		new_switch |= SWITCH_BIDIRECTIONAL;
 
 #ifdef CHECK_DUPLICATES
+	{ int i;
 	for (i = 0; i < tile->num_switches; i++) {
 		if ((tile->switches[i] & 0x3FFFFFFF) == (new_switch & 0x3FFFFFFF)) {
 			fprintf(stderr, "Internal error in %s:%i duplicate switch from %s to %s\n",
-				__FILE__, __LINE__, from, to);
+				__FILE__, __LINE__, strarray_lookup(&model->str, from_idx),
+				strarray_lookup(&model->str, to_idx));
 			return -1;
 		}
-	}
+	}}
 #endif
+	tile->switches = tile_array_own(model, tile->switches,
+		tile->num_switches, sizeof(*tile->switches),
+		SWITCH_ALLOC_INCREMENT);
+	EXIT(tile->num_switches && !tile->switches);
 	if (!(tile->num_switches % SWITCH_ALLOC_INCREMENT)) {
 		uint32_t* new_ptr = realloc(tile->switches,
 			(tile->num_switches+SWITCH_ALLOC_INCREMENT)*sizeof(*tile->switches));
@@ -458,10 +570,23 @@ int add_switch(struct fpga_model* model, int y, int x, const char* from,
 		}
 		tile->switches = new_ptr;
 	}
+	if (tile->used_switches && !(tile->num_switches % 32)) {
+		uint32_t* new_used;
+		tile->used_switches = tile_array_own(model, tile->used_switches,
+			SW_USED_WORDS(tile->num_switches),
+			sizeof(*tile->used_switches), 1);
+		EXIT(!tile->used_switches);
+		new_used = realloc(tile->used_switches,
+			(SW_USED_WORDS(tile->num_switches)+1)*sizeof(*new_used));
+		if (!new_used) {
+			fprintf(stderr, "Out of memory %s:%i\n", __FILE__, __LINE__);
+			return -1;
+		}
+		new_used[SW_USED_WORDS(tile->num_switches)] = 0;
+		tile->used_switches = new_used;
+	}
 	tile->switches[tile->num_switches++] = new_switch;
 	return 0;
-xout:
-	return rc;
 }
 
 int add_switch_set(struct fpga_model* model, int y, int x, const char* prefix,
@@ -510,11 +635,16 @@ int replicate_switches_and_names(struct fpga_model* model,
 	    || !from_tile->num_conn_point_names
 	    || !from_tile->num_switches) FAIL(EINVAL);
 
-	to_tile->conn_point_names = malloc(((from_tile->num_conn_point_names/CONN_NAMES_INCREMENT)+1)*CONN_NAMES_INCREMENT*2*sizeof(uint16_t));
+	to_tile->conn_point_names = malloc(((from_tile->num_conn_point_names/CONN_NAMES_INCREMENT)+1)*CONN_NAMES_INCREMENT*2*sizeof(str16_t));
 	if (!to_tile->conn_point_names) EXIT(ENOMEM);
-	memcpy(to_tile->conn_point_names, from_tile->conn_point_names, from_tile->num_conn_point_names*2*sizeof(uint16_t));
+	memcpy(to_tile->conn_point_names, from_tile->conn_point_names, from_tile->num_conn_point_names*2*sizeof(str16_t));
 	to_tile->num_conn_point_names = from_tile->num_conn_point_names;
 
+	to_tile->connpt_index = malloc(from_tile->connpt_index_size*sizeof(*from_tile->connpt_index));
+	if (!to_tile->connpt_index) EXIT(ENOMEM);
+	memcpy(to_tile->connpt_index, from_tile->connpt_index, from_tile->connpt_index_size*sizeof(*from_tile->connpt_index));
+	to_tile->connpt_index_size = from_tile->connpt_index_size;
+
 	to_tile->switches = malloc(((from_tile->num_switches/SWITCH_ALLOC_INCREMENT)+1)*SWITCH_ALLOC_INCREMENT*sizeof(*from_tile->switches));
 	if (!to_tile->switches) EXIT(ENOMEM);
 	memcpy(to_tile->switches, from_tile->switches, from_tile->num_switches*sizeof(*from_tile->switches));
@@ -6,6 +6,7 @@
 //
 
 #include <stdarg.h>
+#include <sys/mman.h>
 #include "model.h"
 #include "parts.h"
 
@@ -23,10 +24,15 @@ int fpga_build_model(struct fpga_model* model, int fpga_rows,
 		sizeof(model->cfg_left_wiring)-1);
 	strncpy(model->cfg_right_wiring, right_wiring,
 		sizeof(model->cfg_right_wiring)-1);
-	strarray_init(&model->str, STRIDX_64K);
+	model->idcode = xc_find_idcode(fpga_rows, columns);
 	rc = get_xc6_routing_bitpos(&model->sw_bitpos, &model->num_bitpos);
 	if (rc) FAIL(rc);
 
+	rc = fpga_cache_load(model);
+	if (!rc) return 0;
+	if (rc != ENOENT) FAIL(rc);
+	strarray_init(&model->str, STRIDX_MAX);
+
 	// The order of tiles, then devices, then ports, then
 	// connections and finally switches is important so
 	// that the codes can build upon each other.
@@ -52,6 +58,16 @@ int fpga_build_model(struct fpga_model* model, int fpga_rows,
 
 	rc = init_switches(model, /*routing_sw*/ !s_high_speed_replicate);
 	if (rc) FAIL(rc);
+
+	rc = freeze_conns(model);
+	if (rc) FAIL(rc);
+
+	rc = index_switches(model);
+	if (rc) FAIL(rc);
+
+	// a missing snapshot only costs time on the next run
+	if (fpga_cache_save(model))
+		HERE();
 	return 0;
 fail:
 	return rc;
@@ -59,14 +75,29 @@ fail:
 
 int fpga_free_model(struct fpga_model* model)
 {
-	int rc;
+	int i, rc;
 
 	if (!model) return 0;
 	rc = model->rc;
 	free_devices(model);
+	free(model->tile_mem);
+	free(model->sw_mem);
+	free(model->sw_adj_mem);
+	free(model->nets);
+	free(model->net_els);
+	if (model->net_tiles) {
+		for (i = 0; i < model->x_width*model->y_height; i++) {
+			free(model->net_tiles[i].nets);
+			free(model->net_tiles[i].num_el);
+			free(model->net_tiles[i].sw_net);
+		}
+		free(model->net_tiles);
+	}
 	free(model->tmp_str);
 	strarray_free(&model->str);
 	free(model->tiles);
+	if (model->cache_map)
+		munmap(model->cache_map, model->cache_map_len);
 	free_xc6_routing_bitpos(model->sw_bitpos);
 	memset(model, 0, sizeof(*model));
 	return rc;
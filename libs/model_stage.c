@@ -0,0 +1,755 @@
+//
+// Author: Wolfgang Spraul
+//
+// This is free and unencumbered software released into the public domain.
+// For details see the UNLICENSE file at the root of the source tree.
+//
+
+#include <malloc.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "model.h"
+
+#define MAX_THREADS		64
+#define STAGE_OPS_INCREMENT	(64*1024)
+// Ops are committed in chunks of at most STAGE_MAX_OPS, so that the
+// ops and their sort arrays stay small next to the tile regions.
+#define STAGE_MAX_OPS		(512*1024)
+// Staged switches add missing connection points, like add_switch()
+// in model_helper.c.
+#define DBG_ALLOW_ADDPOINTS
+
+enum { STAGE_CONNPT = 1, STAGE_CONN, STAGE_SWITCH };
+
+struct stage_op
+{
+	uint8_t type;
+	uint8_t flag; // warn_if_duplicate or is_bidirectional
+	uint16_t y, x;
+	str16_t name_i; // connpt, conn source or switch from
+	uint16_t y2, x2;
+	str16_t name2_i; // conn dest or switch to
+};
+
+struct model_stage
+{
+	int num_ops, ops_array_size;
+	struct stage_op* ops;
+
+	// filled by stage_commit()
+	int* tile_start; // num_tiles+1 offsets into tile_ops
+	int* tile_ops;
+	uint32_t* op_res; // connpt_o or switch of each op
+	int* tile_names, *tile_dests, *tile_sw; // new sizes of each tile
+	size_t* tile_mem_o; // offset of each tile's arrays in mem
+	char* mem;
+	size_t* sw_o; // offset of each tile's new switches in sw
+	uint32_t* sw;
+	size_t sw_len;
+	int next_tile;
+	int rc;
+};
+
+int model_threads(void)
+{
+	static int s_threads = 0;
+	const char* env;
+	long n;
+
+	if (s_threads)
+		return s_threads;
+	env = getenv("FPGATOOLS_THREADS");
+	if (env && *env)
+		n = strtol(env, 0, 10);
+	else
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n < 1) n = 1;
+	if (n > MAX_THREADS) n = MAX_THREADS;
+	s_threads = n;
+	return s_threads;
+}
+
+int stage_open(struct fpga_model* model)
+{
+	if (model->stage || model->frozen) {
+		HERE();
+		return EINVAL;
+	}
+	model->stage = calloc(1, sizeof(*model->stage));
+	if (!model->stage) {
+		OUT_OF_MEM();
+		return ENOMEM;
+	}
+	return 0;
+}
+
+static int stage_flush(struct fpga_model* model);
+
+static int stage_append(struct fpga_model* model, struct stage_op** op)
+{
+	struct model_stage* stage = model->stage;
+	void* new_ptr;
+	int rc;
+
+	if (stage->num_ops >= STAGE_MAX_OPS) {
+		rc = stage_flush(model);
+		if (rc) return rc;
+	}
+	if (stage->num_ops >= stage->ops_array_size) {
+		new_ptr = realloc(stage->ops, (stage->ops_array_size
+			+ STAGE_OPS_INCREMENT) * sizeof(*stage->ops));
+		if (!new_ptr) {
+			OUT_OF_MEM();
+			return ENOMEM;
+		}
+		stage->ops = new_ptr;
+		stage->ops_array_size += STAGE_OPS_INCREMENT;
+	}
+	*op = &stage->ops[stage->num_ops++];
+	return 0;
+}
+
+int stage_connpt(struct fpga_model* model, int y, int x, str16_t name_i,
+	int warn_if_duplicate)
+{
+	struct stage_op* op;
+	int rc;
+
+	if ((rc = stage_append(model, &op))) return rc;
+	op->type = STAGE_CONNPT;
+	op->flag = warn_if_duplicate;
+	op->y = y;
+	op->x = x;
+	op->name_i = name_i;
+	return 0;
+}
+
+int stage_conn(struct fpga_model* model, int y1, int x1, str16_t name1_i,
+	int y2, int x2, str16_t name2_i)
+{
+	struct stage_op* op;
+	int rc;
+
+	if ((rc = stage_append(model, &op))) return rc;
+	op->type = STAGE_CONN;
+	op->y = y1;
+	op->x = x1;
+	op->name_i = name1_i;
+	op->y2 = y2;
+	op->x2 = x2;
+	op->name2_i = name2_i;
+	return 0;
+}
+
+int stage_switch(struct fpga_model* model, int y, int x, str16_t from_i,
+	str16_t to_i, int is_bidirectional)
+{
+	struct stage_op* op;
+	int rc;
+
+	if ((rc = stage_append(model, &op))) return rc;
+	op->type = STAGE_SWITCH;
+	op->flag = is_bidirectional;
+	op->y = y;
+	op->x = x;
+	op->name_i = from_i;
+	op->name2_i = to_i;
+	return 0;
+}
+
+
+static int in_mem(const void* p, const void* mem, size_t len)
+{
+	return mem && (const char*) p >= (const char*) mem
+		&& (const char*) p < (const char*) mem + len;
+}
+
+int in_tile_mem(struct fpga_model* model, const void* p)
+{
+	return p && (in_mem(p, model->tile_mem, model->tile_mem_len)
+		|| in_mem(p, model->sw_mem, model->sw_mem_len)
+		|| in_mem(p, model->cache_map, model->cache_map_len));
+}
+
+void* tile_array_own(struct fpga_model* model, void* p, int num, int elsize,
+	int increment)
+{
+	void* new_ptr;
+
+	if (!in_tile_mem(model, p))
+		return p;
+	new_ptr = malloc(((num+increment-1)/increment)*increment*elsize);
+	if (!new_ptr) {
+		OUT_OF_MEM();
+		return 0;
+	}
+	memcpy(new_ptr, p, num*elsize);
+	return new_ptr;
+}
+
+#define ALIGN8(n)	(((n)+7) & ~(size_t) 7)
+
+struct commit_worker
+{
+	struct fpga_model* model;
+	struct model_stage* stage;
+	int (*tile_f)(struct commit_worker* w, int tile_i);
+
+	str16_t* connpt_map; // str16_t -> connpt_o+1, count_tile()
+	int* dests_o; // start and end of each connpt's dests, fill_tile()
+};
+
+// count_tile() resolves all connection points and switches of a tile
+// in the order they were staged, and records the resulting sizes.
+static int count_tile(struct commit_worker* w, int tile_i)
+{
+	struct fpga_model* model = w->model;
+	struct model_stage* stage = w->stage;
+	struct fpga_tile* tile = &model->tiles[tile_i];
+	const struct stage_op* op;
+	int y, x, i, num_names, num_dests, num_sw, from_o, to_o, rc;
+	uint32_t* res;
+
+	y = tile_i / model->x_width;
+	x = tile_i % model->x_width;
+	num_names = tile->num_conn_point_names;
+	num_dests = tile->num_conn_point_dests;
+	num_sw = tile->num_switches;
+	for (i = 0; i < num_names; i++)
+		w->connpt_map[tile->conn_point_names[i*2+1]] = i+1;
+
+	rc = 0;
+	for (i = stage->tile_start[tile_i]; i < stage->tile_start[tile_i+1]; i++) {
+		op = &stage->ops[stage->tile_ops[i]];
+		res = &stage->op_res[stage->tile_ops[i]];
+		if (op->type == STAGE_SWITCH) {
+			from_o = w->connpt_map[op->name_i]-1;
+			to_o = w->connpt_map[op->name2_i]-1;
+#ifdef DBG_ALLOW_ADDPOINTS
+			if ((from_o == -1 || to_o == -1)
+			    && num_names+2 > STRIDX_MAX) {
+				HERE();
+				rc = EINVAL;
+				break;
+			}
+			if (from_o == -1) {
+				from_o = num_names++;
+				w->connpt_map[op->name_i] = num_names;
+			}
+			if (to_o == -1) {
+				to_o = num_names++;
+				w->connpt_map[op->name2_i] = num_names;
+			}
+#endif
+			if (from_o == -1 || to_o == -1) {
+				fprintf(stderr, "No conn point for switch from %s (%i/%i) or %s (%i/%i).\n",
+					strarray_lookup(&model->str, op->name_i), op->name_i, from_o,
+					strarray_lookup(&model->str, op->name2_i), op->name2_i, to_o);
+				rc = -1;
+				break;
+			}
+			if (from_o > SWITCH_MAX_CONNPT_O
+			    || to_o > SWITCH_MAX_CONNPT_O) {
+				fprintf(stderr, "Internal error in %s:%i (from_o %i to_o %i)\n",
+					__FILE__, __LINE__, from_o, to_o);
+				rc = -1;
+				break;
+			}
+			*res = (from_o << 15) | to_o;
+			if (op->flag)
+				*res |= SWITCH_BIDIRECTIONAL;
+			num_sw++;
+			continue;
+		}
+		// STAGE_CONNPT or STAGE_CONN
+		if (!w->connpt_map[op->name_i]) {
+			if (num_names >= STRIDX_MAX) {
+				HERE();
+				rc = EINVAL;
+				break;
+			}
+			w->connpt_map[op->name_i] = ++num_names;
+		} else if (op->type == STAGE_CONNPT && op->flag)
+			fprintf(stderr,
+				"Duplicate connection point name y%02i x%02u %s\n",
+				y, x, strarray_lookup(&model->str, op->name_i));
+		*res = w->connpt_map[op->name_i]-1;
+		if (op->type == STAGE_CONN)
+			num_dests++; // upper bound, duplicates are dropped later
+	}
+
+	for (i = 0; i < tile->num_conn_point_names; i++)
+		w->connpt_map[tile->conn_point_names[i*2+1]] = 0;
+	for (i = stage->tile_start[tile_i]; i < stage->tile_start[tile_i+1]; i++) {
+		op = &stage->ops[stage->tile_ops[i]];
+		w->connpt_map[op->name_i] = 0;
+		if (op->type == STAGE_SWITCH)
+			w->connpt_map[op->name2_i] = 0;
+	}
+
+	stage->tile_names[tile_i] = num_names;
+	stage->tile_dests[tile_i] = num_dests;
+	stage->tile_sw[tile_i] = num_sw;
+	return rc;
+}
+
+static size_t tile_mem_size(struct fpga_model* model,
+	struct model_stage* stage, int tile_i)
+{
+	struct fpga_tile* tile = &model->tiles[tile_i];
+	size_t size;
+	int i;
+
+	size = ALIGN8(stage->tile_names[tile_i]*2*sizeof(str16_t))
+		+ ALIGN8(connpt_index_size(stage->tile_names[tile_i])
+			*sizeof(str16_t))
+		+ ALIGN8(stage->tile_dests[tile_i]*3*sizeof(str16_t))
+		+ ALIGN8(SW_USED_WORDS(stage->tile_sw[tile_i])*sizeof(uint32_t))
+		+ ALIGN8(tile->num_devs*sizeof(*tile->devs));
+	for (i = 0; i < tile->num_devs; i++)
+		size += ALIGN8(tile->devs[i].num_pinw_total*sizeof(str16_t));
+	return size;
+}
+
+static void free_tile_array(struct fpga_model* model, void* p)
+{
+	if (!in_tile_mem(model, p))
+		free(p);
+}
+
+// fill_tile() writes the tile's arrays into the new region, in
+// the same order that add_connpt_name_i(), add_conn_uni_i() and
+// add_switch_i() would have created them. It cannot fail, so that
+// no tile is left pointing into a freed region.
+static int fill_tile(struct commit_worker* w, int tile_i)
+{
+	struct fpga_model* model = w->model;
+	struct model_stage* stage = w->stage;
+	struct fpga_tile* tile = &model->tiles[tile_i];
+	const struct stage_op* op;
+	str16_t* names, *index, *dests;
+	uint32_t* switches, *used;
+	struct fpga_device* devs;
+	char* p;
+	int num_names, num_sw, y, x, i, j, c, end, sum, *start, *pos;
+
+	y = tile_i / model->x_width;
+	x = tile_i % model->x_width;
+	num_names = stage->tile_names[tile_i];
+	start = w->dests_o;
+	pos = w->dests_o + num_names+1;
+
+	p = stage->mem + stage->tile_mem_o[tile_i];
+	names = (str16_t*) p;
+	p += ALIGN8(num_names*2*sizeof(str16_t));
+	index = (str16_t*) p;
+	p += ALIGN8(connpt_index_size(num_names)*sizeof(str16_t));
+	dests = (str16_t*) p;
+	p += ALIGN8(stage->tile_dests[tile_i]*3*sizeof(str16_t));
+	used = (uint32_t*) p;
+	p += ALIGN8(SW_USED_WORDS(stage->tile_sw[tile_i])*sizeof(uint32_t));
+	devs = (struct fpga_device*) p;
+	// Only tiles with new switches get a new switches array, the
+	// others keep theirs until share_switches().
+	switches = (stage->tile_sw[tile_i] > tile->num_switches)
+		? stage->sw + stage->sw_o[tile_i] : tile->switches;
+	p += ALIGN8(tile->num_devs*sizeof(*tile->devs));
+
+	// count the dests of each connpt, then give each a slot
+	for (i = 0; i < num_names; i++) {
+		if (i >= tile->num_conn_point_names) {
+			start[i] = 0;
+			continue;
+		}
+		end = (i+1 < tile->num_conn_point_names)
+			? tile->conn_point_names[(i+1)*2]
+			: tile->num_conn_point_dests;
+		start[i] = end - tile->conn_point_names[i*2];
+	}
+	for (i = stage->tile_start[tile_i]; i < stage->tile_start[tile_i+1]; i++) {
+		if (stage->ops[stage->tile_ops[i]].type == STAGE_CONN)
+			start[stage->op_res[stage->tile_ops[i]]]++;
+	}
+	sum = 0;
+	for (i = 0; i < num_names; i++) {
+		c = start[i];
+		start[i] = sum;
+		pos[i] = sum;
+		sum += c;
+	}
+
+	for (i = 0; i < tile->num_conn_point_names; i++) {
+		names[i*2+1] = tile->conn_point_names[i*2+1];
+		end = (i+1 < tile->num_conn_point_names)
+			? tile->conn_point_names[(i+1)*2]
+			: tile->num_conn_point_dests;
+		c = end - tile->conn_point_names[i*2];
+		memcpy(&dests[pos[i]*3],
+			&tile->conn_point_dests[tile->conn_point_names[i*2]*3],
+			c*3*sizeof(str16_t));
+		pos[i] += c;
+	}
+	if (switches != tile->switches)
+		memcpy(switches, tile->switches,
+			tile->num_switches*sizeof(*switches));
+	num_sw = tile->num_switches;
+
+	for (i = stage->tile_start[tile_i]; i < stage->tile_start[tile_i+1]; i++) {
+		op = &stage->ops[stage->tile_ops[i]];
+		c = stage->op_res[stage->tile_ops[i]];
+		if (op->type == STAGE_SWITCH) {
+			names[SW_FROM_I(c)*2+1] = op->name_i;
+			names[SW_TO_I(c)*2+1] = op->name2_i;
+			switches[num_sw++] = c;
+			continue;
+		}
+		names[c*2+1] = op->name_i;
+		if (op->type != STAGE_CONN)
+			continue;
+		// Is the connection made a second time?
+		for (j = start[c]; j < pos[c]; j++) {
+			if (dests[j*3] == op->x2
+			    && dests[j*3+1] == op->y2
+			    && dests[j*3+2] == op->name2_i)
+				break;
+		}
+		if (j < pos[c]) {
+			fprintf(stderr, "Duplicate conn (num_conn_point_dests %i): y%02i x%02i %s - y%02i x%02i %s.\n",
+				pos[c]-start[c], y, x,
+				strarray_lookup(&model->str, op->name_i), op->y2, op->x2,
+				strarray_lookup(&model->str, op->name2_i));
+			for (j = start[c]; j < pos[c]; j++) {
+				fprintf(stderr, "c%i: y%02i x%02i %s -> y%02i x%02i %s\n", j,
+					y, x, strarray_lookup(&model->str, op->name_i),
+					dests[j*3+1], dests[j*3],
+					strarray_lookup(&model->str, dests[j*3+2]));
+			}
+			continue;
+		}
+		dests[pos[c]*3] = op->x2;
+		dests[pos[c]*3+1] = op->y2;
+		dests[pos[c]*3+2] = op->name2_i;
+		pos[c]++;
+	}
+
+	// close the gaps left by duplicate conns
+	sum = 0;
+	for (i = 0; i < num_names; i++) {
+		names[i*2] = sum;
+		if (start[i] != sum)
+			memmove(&dests[sum*3], &dests[start[i]*3],
+				(pos[i]-start[i])*3*sizeof(str16_t));
+		sum += pos[i]-start[i];
+	}
+
+	memcpy(devs, tile->devs, tile->num_devs*sizeof(*devs));
+	for (i = 0; i < tile->num_devs; i++) {
+		if (!devs[i].pinw) continue;
+		memcpy(p, devs[i].pinw, devs[i].num_pinw_total*sizeof(str16_t));
+		free_tile_array(model, devs[i].pinw);
+		devs[i].pinw = (str16_t*) p;
+		p += ALIGN8(devs[i].num_pinw_total*sizeof(str16_t));
+	}
+
+	free_tile_array(model, tile->conn_point_names);
+	free_tile_array(model, tile->connpt_index);
+	free_tile_array(model, tile->conn_point_dests);
+	if (switches != tile->switches)
+		free_tile_array(model, tile->switches);
+	memset(used, 0, SW_USED_WORDS(num_sw)*sizeof(*used));
+	if (tile->used_switches)
+		memcpy(used, tile->used_switches, SW_USED_WORDS(
+			tile->num_switches)*sizeof(*used));
+	free_tile_array(model, tile->used_switches);
+	free_tile_array(model, tile->devs);
+	tile->num_conn_point_names = num_names;
+	tile->conn_point_names = num_names ? names : 0;
+	tile->connpt_index_size = connpt_index_size(num_names);
+	tile->connpt_index = num_names ? index : 0;
+	if (num_names)
+		connpt_index_fill(tile, index, tile->connpt_index_size);
+	tile->num_conn_point_dests = sum;
+	tile->conn_point_dests = sum ? dests : 0;
+	tile->num_switches = num_sw;
+	tile->switches = num_sw ? switches : 0;
+	tile->used_switches = num_sw ? used : 0;
+	tile->devs = tile->num_devs ? devs : 0;
+	return 0;
+}
+
+static void* commit_thread(void* _w)
+{
+	struct commit_worker* w = _w;
+	struct model_stage* stage = w->stage;
+	int num_tiles, tile_i, rc;
+
+	num_tiles = w->model->x_width * w->model->y_height;
+	while (!stage->rc && (tile_i = __sync_fetch_and_add(
+		&stage->next_tile, 1)) < num_tiles) {
+		rc = w->tile_f(w, tile_i);
+		if (rc) {
+			__sync_bool_compare_and_swap(&stage->rc, 0, rc);
+			break;
+		}
+	}
+	return 0;
+}
+
+// Runs tile_f on all tiles, each tile is taken by exactly one thread.
+// The scratch buffers of the workers are allocated before any tile
+// is touched.
+static int run_workers(struct fpga_model* model, struct model_stage* stage,
+	int (*tile_f)(struct commit_worker* w, int tile_i),
+	int map_entries, int dests_o_entries)
+{
+	struct commit_worker workers[MAX_THREADS];
+	pthread_t threads[MAX_THREADS];
+	int num_threads, i, rc;
+
+	num_threads = model_threads();
+	memset(workers, 0, num_threads*sizeof(*workers));
+	for (i = 0; i < num_threads; i++) {
+		workers[i].model = model;
+		workers[i].stage = stage;
+		workers[i].tile_f = tile_f;
+		if (map_entries && !(workers[i].connpt_map = calloc(map_entries,
+				sizeof(*workers[i].connpt_map)))) {
+			OUT_OF_MEM();
+			FAIL(ENOMEM);
+		}
+		if (dests_o_entries && !(workers[i].dests_o = malloc(
+				dests_o_entries*sizeof(*workers[i].dests_o)))) {
+			OUT_OF_MEM();
+			FAIL(ENOMEM);
+		}
+	}
+	stage->next_tile = 0;
+	i = 0;
+	if (num_threads > 1) {
+		for (; i < num_threads; i++) {
+			if (pthread_create(&threads[i], 0, commit_thread,
+					&workers[i]))
+				break;
+		}
+	}
+	if (!i) // no threads at all, run in this thread
+		commit_thread(&workers[0]);
+	num_threads = i;
+	for (i = 0; i < num_threads; i++)
+		pthread_join(threads[i], 0);
+	rc = stage->rc;
+fail:
+	for (i = 0; i < model_threads(); i++) {
+		free(workers[i].connpt_map);
+		free(workers[i].dests_o);
+	}
+	return rc;
+}
+
+static uint32_t switches_hash(const uint32_t* switches, int num_switches)
+{
+	uint32_t hash;
+	int i;
+
+	hash = 2166136261u;
+	for (i = 0; i < num_switches; i++)
+		hash = (hash ^ switches[i]) * 16777619u;
+	return hash;
+}
+
+// share_switches() puts one copy of each distinct switches array
+// into a new model->sw_mem and points all tiles with that array
+// to it. All other switches arrays are freed.
+static int share_switches(struct fpga_model* model, struct model_stage* stage)
+{
+	struct fpga_tile* tile, *other;
+	int num_tiles, table_size, tile_i, h, rc, *table, *first;
+	size_t* first_o, sw_len;
+	uint32_t* sw_mem;
+
+	num_tiles = model->x_width * model->y_height;
+	for (table_size = 16; table_size < num_tiles*2; table_size *= 2);
+	table = calloc(table_size, sizeof(*table));
+	first = malloc(num_tiles*sizeof(*first));
+	first_o = malloc(num_tiles*sizeof(*first_o));
+	sw_mem = 0;
+	if (!table || !first || !first_o) {
+		OUT_OF_MEM();
+		FAIL(ENOMEM);
+	}
+
+	// first[tile_i] is the first tile with the same switches
+	sw_len = 0;
+	for (tile_i = 0; tile_i < num_tiles; tile_i++) {
+		tile = &model->tiles[tile_i];
+		first[tile_i] = -1;
+		if (!tile->num_switches) continue;
+		for (h = switches_hash(tile->switches, tile->num_switches)
+				& (table_size-1);
+			table[h]; h = (h+1) & (table_size-1)) {
+			other = &model->tiles[table[h]-1];
+			if (other->num_switches == tile->num_switches
+			    && (other->switches == tile->switches
+				|| !memcmp(other->switches, tile->switches,
+					tile->num_switches*sizeof(uint32_t)))) {
+				first[tile_i] = table[h]-1;
+				break;
+			}
+		}
+		if (first[tile_i] != -1) continue;
+		table[h] = tile_i+1;
+		first[tile_i] = tile_i;
+		first_o[tile_i] = sw_len;
+		sw_len += tile->num_switches;
+	}
+
+	sw_mem = malloc((sw_len ? sw_len : 1)*sizeof(*sw_mem));
+	if (!sw_mem) {
+		OUT_OF_MEM();
+		FAIL(ENOMEM);
+	}
+	for (tile_i = 0; tile_i < num_tiles; tile_i++) {
+		if (first[tile_i] != tile_i) continue;
+		tile = &model->tiles[tile_i];
+		memcpy(&sw_mem[first_o[tile_i]], tile->switches,
+			tile->num_switches*sizeof(*sw_mem));
+	}
+	for (tile_i = 0; tile_i < num_tiles; tile_i++) {
+		if (first[tile_i] == -1) continue;
+		tile = &model->tiles[tile_i];
+		if (!in_tile_mem(model, tile->switches)
+		    && !in_mem(tile->switches, stage->sw,
+				stage->sw_len*sizeof(*stage->sw)))
+			free(tile->switches);
+		tile->switches = &sw_mem[first_o[first[tile_i]]];
+	}
+	free(model->sw_mem);
+	model->sw_mem = sw_mem;
+	model->sw_mem_len = sw_len*sizeof(*sw_mem);
+	sw_mem = 0;
+	rc = 0;
+fail:
+	free(sw_mem);
+	free(first_o);
+	free(first);
+	free(table);
+	return rc;
+}
+
+// Commits the ops staged so far and empties the stage, which stays
+// open.
+static int stage_flush(struct fpga_model* model)
+{
+	struct model_stage* stage = model->stage;
+	int num_tiles, tile_i, max_names, i, rc;
+	size_t mem_len;
+
+	model->stage = 0;
+	num_tiles = model->x_width * model->y_height;
+
+	// sort the ops into tiles, keeping their order
+	stage->tile_start = calloc(num_tiles+1, sizeof(*stage->tile_start));
+	stage->tile_ops = malloc((stage->num_ops ? stage->num_ops : 1)
+		* sizeof(*stage->tile_ops));
+	stage->op_res = malloc((stage->num_ops ? stage->num_ops : 1)
+		* sizeof(*stage->op_res));
+	stage->tile_names = malloc(num_tiles*sizeof(*stage->tile_names));
+	stage->tile_dests = malloc(num_tiles*sizeof(*stage->tile_dests));
+	stage->tile_sw = malloc(num_tiles*sizeof(*stage->tile_sw));
+	stage->tile_mem_o = malloc(num_tiles*sizeof(*stage->tile_mem_o));
+	stage->sw_o = malloc(num_tiles*sizeof(*stage->sw_o));
+	if (!stage->tile_start || !stage->tile_ops || !stage->op_res
+	    || !stage->tile_names || !stage->tile_dests || !stage->tile_sw
+	    || !stage->tile_mem_o || !stage->sw_o) {
+		OUT_OF_MEM();
+		FAIL(ENOMEM);
+	}
+	for (i = 0; i < stage->num_ops; i++)
+		stage->tile_start[stage->ops[i].y*model->x_width
+			+ stage->ops[i].x + 1]++;
+	for (tile_i = 0; tile_i < num_tiles; tile_i++)
+		stage->tile_start[tile_i+1] += stage->tile_start[tile_i];
+	for (i = 0; i < stage->num_ops; i++)
+		stage->tile_ops[stage->tile_start[stage->ops[i].y
+			*model->x_width + stage->ops[i].x]++] = i;
+	for (tile_i = num_tiles; tile_i > 0; tile_i--)
+		stage->tile_start[tile_i] = stage->tile_start[tile_i-1];
+	stage->tile_start[0] = 0;
+
+	// phase 1: count
+	rc = run_workers(model, stage, count_tile,
+		model->str.highest_index+1, 0);
+	if (rc) FAIL(rc);
+
+	// one region for the arrays of all tiles, and a temporary
+	// one for the switches of tiles that get new switches
+	mem_len = 0;
+	max_names = 0;
+	stage->sw_len = 0;
+	for (tile_i = 0; tile_i < num_tiles; tile_i++) {
+		stage->tile_mem_o[tile_i] = mem_len;
+		mem_len += tile_mem_size(model, stage, tile_i);
+		if (stage->tile_names[tile_i] > max_names)
+			max_names = stage->tile_names[tile_i];
+		if (stage->tile_sw[tile_i] > model->tiles[tile_i].num_switches) {
+			stage->sw_o[tile_i] = stage->sw_len;
+			stage->sw_len += stage->tile_sw[tile_i];
+		}
+	}
+	stage->mem = malloc(mem_len ? mem_len : 1);
+	stage->sw = malloc((stage->sw_len ? stage->sw_len : 1)
+		* sizeof(*stage->sw));
+	if (!stage->mem || !stage->sw) {
+		OUT_OF_MEM();
+		FAIL(ENOMEM);
+	}
+
+	// phase 2: fill
+	rc = run_workers(model, stage, fill_tile, 0, 2*(max_names+1));
+	if (rc) FAIL(rc);
+	free(model->tile_mem);
+	model->tile_mem = stage->mem;
+	model->tile_mem_len = mem_len;
+	stage->mem = 0;
+
+	rc = share_switches(model, stage);
+	if (rc) FAIL(rc);
+fail:
+	free(stage->sw);
+	free(stage->sw_o);
+	free(stage->mem);
+	free(stage->tile_mem_o);
+	free(stage->tile_sw);
+	free(stage->tile_dests);
+	free(stage->tile_names);
+	free(stage->op_res);
+	free(stage->tile_ops);
+	free(stage->tile_start);
+	stage->sw = 0;
+	stage->sw_o = 0;
+	stage->tile_mem_o = 0;
+	stage->tile_sw = 0;
+	stage->tile_dests = 0;
+	stage->tile_names = 0;
+	stage->op_res = 0;
+	stage->tile_ops = 0;
+	stage->tile_start = 0;
+	stage->num_ops = 0;
+	model->stage = stage;
+	// give the pages of the old arrays back
+	malloc_trim(0);
+	return rc;
+}
+
+int stage_commit(struct fpga_model* model)
+{
+	struct model_stage* stage = model->stage;
+	int rc;
+
+	if (!stage) return 0;
+	rc = stage_flush(model);
+	model->stage = 0;
+	free(stage->ops);
+	free(stage);
+	return rc;
+}
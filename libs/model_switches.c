@@ -35,6 +35,9 @@ int init_switches(struct fpga_model *model, int routing_sw)
 {
 	int rc;
 
+	rc = stage_open(model);
+	if (rc) FAIL(rc);
+
 	if (routing_sw) {
 		rc = init_routing(model);
 		if (rc) FAIL(rc);
@@ -99,6 +102,9 @@ int init_switches(struct fpga_model *model, int routing_sw)
 
 	rc = init_center_topbot_cfb_dfb(model);
 	if (rc) FAIL(rc);
+
+	rc = stage_commit(model);
+	if (rc) FAIL(rc);
 	return 0;
 fail:
 	return rc;
@@ -2508,3 +2514,94 @@ static int init_center_topbot_cfb_dfb(struct fpga_model *model)
 fail:
 	return rc;
 }
+
+// Tiles with the same switches array share one sw_adj array.
+int index_switches(struct fpga_model* model)
+{
+	struct fpga_tile* tile;
+	int num_tiles, table_size, tile_i, h, i, ft, c, m, rc;
+	int* table, *adj_o, *owner_m, *adj;
+	char* owner;
+	size_t adj_len;
+
+	num_tiles = model->x_width * model->y_height;
+	for (table_size = 16; table_size < num_tiles*2; table_size *= 2);
+	table = calloc(table_size, sizeof(*table));
+	adj_o = malloc(num_tiles*sizeof(*adj_o));
+	owner_m = malloc(num_tiles*sizeof(*owner_m));
+	owner = calloc(num_tiles, sizeof(*owner));
+	if (!table || !adj_o || !owner_m || !owner) {
+		OUT_OF_MEM();
+		FAIL(ENOMEM);
+	}
+
+	// adj_o[tile_i] is the offset of the tile's sw_adj in
+	// sw_adj_mem, or -1. The first tile with a switches array owns
+	// the sw_adj, m is the number of connpts it covers.
+	adj_len = 0;
+	for (tile_i = 0; tile_i < num_tiles; tile_i++) {
+		tile = &model->tiles[tile_i];
+		adj_o[tile_i] = -1;
+		if (!tile->num_switches) continue;
+		for (h = ((uintptr_t) tile->switches >> 2) & (table_size-1);
+		     table[h]; h = (h+1) & (table_size-1)) {
+			if (model->tiles[table[h]-1].switches == tile->switches
+			    && model->tiles[table[h]-1].num_switches
+				== tile->num_switches) {
+				adj_o[tile_i] = adj_o[table[h]-1];
+				break;
+			}
+		}
+		if (adj_o[tile_i] != -1) continue;
+		table[h] = tile_i+1;
+		m = 0;
+		for (i = 0; i < tile->num_switches; i++) {
+			if (SW_FROM_I(tile->switches[i]) >= m)
+				m = SW_FROM_I(tile->switches[i])+1;
+			if (SW_TO_I(tile->switches[i]) >= m)
+				m = SW_TO_I(tile->switches[i])+1;
+		}
+		owner[tile_i] = 1;
+		owner_m[tile_i] = m;
+		adj_o[tile_i] = adj_len;
+		adj_len += 1 + 2*m + 2*tile->num_switches;
+	}
+
+	free(model->sw_adj_mem);
+	model->sw_adj_mem = malloc((adj_len ? adj_len : 1)*sizeof(int));
+	if (!model->sw_adj_mem) {
+		OUT_OF_MEM();
+		FAIL(ENOMEM);
+	}
+	model->sw_adj_mem_len = adj_len*sizeof(int);
+	for (tile_i = 0; tile_i < num_tiles; tile_i++) {
+		tile = &model->tiles[tile_i];
+		if (adj_o[tile_i] == -1) {
+			tile->sw_adj = 0;
+			continue;
+		}
+		adj = &model->sw_adj_mem[adj_o[tile_i]];
+		tile->sw_adj = adj;
+		if (!owner[tile_i])
+			continue;
+		m = owner_m[tile_i];
+		adj[0] = m;
+		for (i = 0; i < 2*m; i++)
+			adj[1+i] = NO_SWITCH;
+		for (i = tile->num_switches-1; i >= 0; i--) {
+			for (ft = SW_TO; ft <= SW_FROM; ft++) {
+				c = SW_I(tile->switches[i], ft);
+				adj[1 + 2*m + ft*tile->num_switches + i]
+					= adj[1 + ft*m + c];
+				adj[1 + ft*m + c] = i;
+			}
+		}
+	}
+	rc = 0;
+fail:
+	free(owner);
+	free(owner_m);
+	free(adj_o);
+	free(table);
+	return rc;
+}
@@ -5,11 +5,12 @@
 // For details see the UNLICENSE file at the root of the source tree.
 //
 
+#include <pthread.h>
 #include "model.h"
 #include "control.h"
 #include "parts.h"
 
-const char* iob_xc6slx9_sitenames[IOB_WORDS*2/8] =
+static const char* iob_xc6slx9_sitenames[896*2/IOB_ENTRY_LEN] =
 {
 	// Note that the configuration space for 4*6 IOBs
 	// that are marked with 0 is used for clocks etc,
@@ -60,32 +61,32 @@ const char* iob_xc6slx9_sitenames[IOB_WORDS*2/8] =
 
 int get_num_iobs(int idcode)
 {
-	if ((idcode & IDCODE_MASK) != XC6SLX9)
+	const struct xc_info* xci = xc_info(idcode);
+
+	if (!xci)
 		EXIT(1);
-	return sizeof(iob_xc6slx9_sitenames)/sizeof(iob_xc6slx9_sitenames[0]);
+	return XC_IOB_DATA_LEN(xci)/IOB_ENTRY_LEN;
 }
 
 const char* get_iob_sitename(int idcode, int idx)
 {
-	if ((idcode & IDCODE_MASK) != XC6SLX9)
-		EXIT(1);
-	if (idx < 0 || idx > sizeof(iob_xc6slx9_sitenames)/sizeof(iob_xc6slx9_sitenames[0]))
+	const struct xc_info* xci = xc_info(idcode);
+
+	if (!xci || idx < 0 || idx >= XC_IOB_DATA_LEN(xci)/IOB_ENTRY_LEN)
 		EXIT(1);
-	return iob_xc6slx9_sitenames[idx];
+	return xci->iob_sitenames[idx];
 }
 
 int find_iob_sitename(int idcode, const char* name)
 {
+	const struct xc_info* xci = xc_info(idcode);
 	int i;
 
-	if ((idcode & IDCODE_MASK) != XC6SLX9) {
-		HERE();
+	if (!xci)
 		return -1;
-	}
-	for (i = 0; i < sizeof(iob_xc6slx9_sitenames)
-			/sizeof(iob_xc6slx9_sitenames[0]); i++) {
-		if (iob_xc6slx9_sitenames[i]
-		    && !strcmp(iob_xc6slx9_sitenames[i], name))
+	for (i = 0; i < XC_IOB_DATA_LEN(xci)/IOB_ENTRY_LEN; i++) {
+		if (xci->iob_sitenames[i]
+		    && !strcmp(xci->iob_sitenames[i], name))
 			return i;
 	}
 	return -1;
@@ -93,16 +94,13 @@ int find_iob_sitename(int idcode, const char* name)
 
 int xc_num_rows(int idcode)
 {
-	if ((idcode & IDCODE_MASK) != XC6SLX9) {
-		HERE();
-		return -1;
-	}
-	return NUM_ROWS;
+	const struct xc_info* xci = xc_info(idcode);
+
+	return xci ? xci->num_rows : -1;
 }
 
-const struct xc_info* xc_info(int idcode)
-{
-	static const struct xc_info xc6slx9_info = {
+static struct xc_info xc6slx9_info = {
+		.idcode = XC6SLX9,
 		.num_rows = 4,
 		.left_wiring =
 			/* row 3 */ "UWUWUWUW" "WWWWUUUU" \
@@ -361,98 +359,111 @@ const struct xc_info* xc_info(int idcode)
 			 [220] = { XC_T2_IOB_UNBONDED, 97 },
 			 [221] = { XC_T2_IOB_UNBONDED, 98 },
 			 [222] = { XC_T2_IOB_PAD, 75 },
-			 [223] = { XC_T2_IOB_PAD, 74 }}};
-	switch (idcode & IDCODE_MASK) {
-		case XC6SLX9: return &xc6slx9_info;
+			 [223] = { XC_T2_IOB_PAD, 74 }},
+		.bram_frames_per_row = 144,
+		.iob_words = 896,
+		.flr = 896,
+		.part_str = "6slx9tqg144",
+		.iob_sitenames = iob_xc6slx9_sitenames };
+
+// Larger parts are added with another xc_info and an entry here.
+static struct xc_info* s_xc_parts[] = { &xc6slx9_info };
+
+static pthread_once_t s_xc_parts_once = PTHREAD_ONCE_INIT;
+
+static void init_xc_parts(void)
+{
+	struct xc_info* xci;
+	int i, j;
+
+	for (i = 0; i < sizeof(s_xc_parts)/sizeof(*s_xc_parts); i++) {
+		xci = s_xc_parts[i];
+		// running sum of the minors of all majors to the left
+		xci->major_framestart[0] = 0;
+		for (j = 0; j < xci->num_majors; j++)
+			xci->major_framestart[j+1] = xci->major_framestart[j]
+				+ xci->majors[j].minors;
+		xci->frames_per_row = xci->major_framestart[xci->num_majors];
+	}
+}
+
+const struct xc_info* xc_info(int idcode)
+{
+	int i;
+
+	pthread_once(&s_xc_parts_once, init_xc_parts);
+	// the slx4 is an slx9 die
+	if ((idcode & IDCODE_MASK) == XC6SLX4)
+		idcode = XC6SLX9;
+	for (i = 0; i < sizeof(s_xc_parts)/sizeof(*s_xc_parts); i++) {
+		if (s_xc_parts[i]->idcode == (idcode & IDCODE_MASK))
+			return s_xc_parts[i];
 	}
 	HERE();
 	return 0;
 }
 
+int xc_find_idcode(int rows, const char* major_str)
+{
+	int i;
+
+	for (i = 0; i < sizeof(s_xc_parts)/sizeof(*s_xc_parts); i++) {
+		if (s_xc_parts[i]->num_rows == rows
+		    && !strcmp(s_xc_parts[i]->major_str, major_str))
+			return s_xc_parts[i]->idcode;
+	}
+	return 0;
+}
+
 int get_major_minors(int idcode, int major)
 {
-	static const int minors_per_major[] = // for slx9
-	{
-		/*  0 */	 4, // 505 bytes = middle 8-bit for each minor?
-		/*  1 */ 	30, // left
-		/*  2 */ 	31, // logic M
-		/*  3 */ 	30, // logic L
-		/*  4 */ 	25, // bram
-		/*  5 */ 	31, // logic M
-		/*  6 */ 	30, // logic L
-		/*  7 */ 	24, // macc
-		/*  8 */ 	31, // logic M
-		/*  9 */ 	31, // center
-		/* 10 */ 	31, // logic M
-		/* 11 */ 	30, // logic L
-		/* 12 */ 	31, // logic M
-		/* 13 */ 	30, // logic L
-		/* 14 */ 	25, // bram
-		/* 15 */ 	31, // logic M
-		/* 16 */ 	30, // logic L
-		/* 17 */	30, // right
-	};
-	if ((idcode & IDCODE_MASK) != XC6SLX9)
-		EXIT(1);
-	if (major < 0 || major
-		> sizeof(minors_per_major)/sizeof(minors_per_major[0]))
+	const struct xc_info* xci = xc_info(idcode);
+
+	if (!xci || major < 0 || major >= xci->num_majors)
 		EXIT(1);
-	return minors_per_major[major];
+	return xci->majors[major].minors;
 }
 
 enum major_type get_major_type(int idcode, int major)
 {
-	static const int major_types[] = // for slx9
-	{
-		/*  0 */ MAJ_ZERO,
-		/*  1 */ MAJ_LEFT,
-		/*  2 */ MAJ_LOGIC_XM,
-		/*  3 */ MAJ_LOGIC_XL,
-		/*  4 */ MAJ_BRAM,
-		/*  5 */ MAJ_LOGIC_XM,
-		/*  6 */ MAJ_LOGIC_XL,
-		/*  7 */ MAJ_MACC,
-		/*  8 */ MAJ_LOGIC_XM,
-		/*  9 */ MAJ_CENTER,
-		/* 10 */ MAJ_LOGIC_XM,
-		/* 11 */ MAJ_LOGIC_XL,
-		/* 12 */ MAJ_LOGIC_XM,
-		/* 13 */ MAJ_LOGIC_XL,
-		/* 14 */ MAJ_BRAM,
-		/* 15 */ MAJ_LOGIC_XM,
-		/* 16 */ MAJ_LOGIC_XL,
-		/* 17 */ MAJ_RIGHT
-	};
-	if ((idcode & IDCODE_MASK) != XC6SLX9)
-		EXIT(1);
-	if (major < 0 || major
-		> sizeof(major_types)/sizeof(major_types[0]))
+	const struct xc_info* xci = xc_info(idcode);
+	int flags;
+
+	if (!xci || major < 0 || major >= xci->num_majors)
 		EXIT(1);
-	return major_types[major];
+	flags = xci->majors[major].flags;
+	if (flags & XC_MAJ_ZERO) return MAJ_ZERO;
+	if (flags & XC_MAJ_LEFT) return MAJ_LEFT;
+	if (flags & XC_MAJ_RIGHT) return MAJ_RIGHT;
+	if (flags & XC_MAJ_CENTER) return MAJ_CENTER;
+	if (flags & XC_MAJ_XM) return MAJ_LOGIC_XM;
+	if (flags & XC_MAJ_XL) return MAJ_LOGIC_XL;
+	if (flags & XC_MAJ_BRAM) return MAJ_BRAM;
+	if (flags & XC_MAJ_MACC) return MAJ_MACC;
+	EXIT(1);
 }
 
 int get_rightside_major(int idcode)
 {
-	if ((idcode & IDCODE_MASK) != XC6SLX9) {
-		HERE();
-		return -1;
-	}
-	return XC6_SLX9_RIGHTMOST_MAJOR;
+	const struct xc_info* xci = xc_info(idcode);
+
+	return xci ? xci->num_majors-1 : -1;
 }
 
 int get_major_framestart(int idcode, int major)
 {
-	int i, frame_count;
+	const struct xc_info* xci = xc_info(idcode);
 
-	frame_count = 0;
-	for (i = 0; i < major; i++)
-		frame_count += get_major_minors(idcode, i);
-	return frame_count;
+	if (!xci || major < 0 || major > xci->num_majors)
+		EXIT(1);
+	return xci->major_framestart[major];
 }
 
 int get_frames_per_row(int idcode)
 {
-	return get_major_framestart(idcode, get_rightside_major(idcode)+1);
+	const struct xc_info* xci = xc_info(idcode);
+
+	return xci ? xci->frames_per_row : -1;
 }
 
 //
@@ -55,6 +55,7 @@ struct xc_type2_info
 
 struct xc_info
 {
+	int idcode;
 	int num_rows;
 	const char* left_wiring;
 	const char* right_wiring;
@@ -63,24 +64,40 @@ struct xc_info
 	struct xc_major_info majors[XC_MAX_MAJORS];
 	int num_type2;
 	struct xc_type2_info type2[XC_MAX_TYPE2_ENTRIES];
+
+	// frame geometry
+	int bram_frames_per_row; // type 1 (bram data) frames
+	int iob_words; // 16-bit words of type 2 (iob) data
+	int flr; // frame length register value
+	const char* part_str; // header string b, e.g. 6slx9tqg144
+	// iob_words*2/IOB_ENTRY_LEN entries, 0 if not an iob
+	const char** iob_sitenames;
+
+	// derived from majors by xc_info()
+	int frames_per_row; // type 0 frames, without padding
+	int major_framestart[XC_MAX_MAJORS+1];
 };
 
+// returns 0 (after HERE()) for unsupported parts
 const struct xc_info* xc_info(int idcode);
+// returns the idcode of the part with rows and major_str, or 0
+int xc_find_idcode(int rows, const char* major_str);
 
 #define FRAME_SIZE		130
-#define FRAMES_PER_ROW		505 // for slx4 and slx9
 #define PADDING_FRAMES_PER_ROW	2
-#define NUM_ROWS		4 // for slx9 and slx9
-
-#define FRAMES_DATA_START	0
-#define FRAMES_DATA_LEN		(NUM_ROWS*FRAMES_PER_ROW*FRAME_SIZE)
-#define BRAM_DATA_START		FRAMES_DATA_LEN
-#define BRAM_DATA_LEN		(4*144*FRAME_SIZE)
-#define IOB_DATA_START		(BRAM_DATA_START + BRAM_DATA_LEN)
-#define IOB_WORDS		896 // 16-bit words, for slx4 and slx9
-#define IOB_DATA_LEN		(IOB_WORDS*2)
 #define IOB_ENTRY_LEN		8
-#define BITS_LEN		(IOB_DATA_START+IOB_DATA_LEN)
+
+// Offsets into struct fpga_bits. The frames of all rows come first,
+// followed by bram data and the iob block.
+#define XC_NUM_FRAMES(xci)	((xci)->num_rows*(xci)->frames_per_row)
+#define XC_FRAMES_DATA_LEN(xci)	(XC_NUM_FRAMES(xci)*FRAME_SIZE)
+#define XC_BRAM_DATA_START(xci)	XC_FRAMES_DATA_LEN(xci)
+#define XC_BRAM_DATA_LEN(xci) \
+	((xci)->num_rows*(xci)->bram_frames_per_row*FRAME_SIZE)
+#define XC_IOB_DATA_START(xci) \
+	(XC_BRAM_DATA_START(xci) + XC_BRAM_DATA_LEN(xci))
+#define XC_IOB_DATA_LEN(xci)	((xci)->iob_words*2)
+#define XC_BITS_LEN(xci)	(XC_IOB_DATA_START(xci) + XC_IOB_DATA_LEN(xci))
 
 #define XC6_HCLK_BYTES		2
 #define XC6_HCLK_BITS		(XC6_HCLK_BYTES*8)
@@ -165,7 +182,6 @@ enum major_type get_major_type(int idcode, int major);
 
 #define XC6_ZERO_MAJOR 0
 #define XC6_LEFTSIDE_MAJOR 1
-#define XC6_SLX9_RIGHTMOST_MAJOR 17
 
 int get_rightside_major(int idcode);
 int get_major_framestart(int idcode, int major);
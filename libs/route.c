@@ -0,0 +1,942 @@
+//
+// Author: Wolfgang Spraul
+//
+// This is free and unencumbered software released into the public domain.
+// For details see the UNLICENSE file at the root of the source tree.
+//
+
+#include <time.h>
+#include <pthread.h>
+#include "model.h"
+#include "control.h"
+#include "parts.h"
+
+//
+// The routing graph has one node per connection point of every tile,
+// node = tile_base[tile_i] + connpt_o. Nodes joined by conns are the
+// same physical wire, moving between them costs nothing. Switches go
+// from one wire to another and cost the wire they enter. Congestion
+// is counted per wire, i.e. per union-find root of the conns.
+//
+// Nets are grouped into batches of nets with non-overlapping bounding
+// boxes. The nets of a batch are routed in parallel against the wire
+// usage at the start of the batch, and their wires are added to the
+// usage in net order after the batch. Since no net sees the result
+// of another net in the same batch, the routes do not depend on the
+// number of threads.
+//
+
+#define ROUTE_ALLOC_INCREMENT	64
+#define ROUTE_MAX_THREADS	64
+#define ROUTE_MAX_BATCHES	32
+#define ROUTE_BBOX_MARGIN	3
+
+struct route_sw
+{
+	int tile_i;
+	swidx_t swidx;
+	int wire;
+};
+
+struct route_net
+{
+	net_idx_t net_i;
+	int src_node;
+	int num_sinks;
+	int* sinks;
+
+	int num_sw, sw_size;
+	struct route_sw* sw;
+	int num_tree, tree_size;
+	int* tree; // nodes reached so far, search starts there
+
+	int y_min, y_max, x_min, x_max; // of all pins
+	int batch;
+};
+
+struct heap_el
+{
+	float f, g;
+	int node, tile_i;
+};
+
+struct router
+{
+	struct fpga_model* model;
+	int num_tiles, num_nodes;
+	int* tile_base; // num_tiles+1
+	int* wire; // node -> first node of its wire
+	int max_span; // longest wire, in Manhattan distance
+	float astar_fac;
+
+	uint8_t* pin; // per wire, wire is a device pin
+	uint8_t* fixed; // per wire, used by a switch outside the router
+	// per tile, one byte per switch that is 1 if the switch has
+	// no bits, or 0 if all switches of the tile can be used
+	uint8_t** sw_nobits;
+	int num_nobits;
+	uint8_t** nobits; // the distinct sw_nobits arrays
+	uint16_t* occ; // per wire, number of nets using it
+	float* hist; // per wire, congestion history
+	uint8_t* seen; // per wire, scratch for the overuse count
+	float pres_fac;
+
+	int num_nets;
+	struct route_net* nets;
+	int* order; // net indices sorted by batch
+	int batch_start, batch_end, next_net; // into order
+	int rc;
+};
+
+// search state of one thread, per node
+struct route_worker
+{
+	struct router* r;
+	float* cost;
+	int* prev; // 2*prev_node + 1 for a conn, 2*prev_node for a switch, -1 start
+	uint32_t* visit;
+	uint32_t stamp;
+	long expanded;
+
+	int heap_len, heap_size;
+	struct heap_el* heap;
+};
+
+static int find_wire(int* wire, int node)
+{
+	while (wire[node] != node) {
+		wire[node] = wire[wire[node]];
+		node = wire[node];
+	}
+	return node;
+}
+
+static int node_tile(const struct router* r, int node)
+{
+	int lo, hi, mid;
+
+	lo = 0;
+	hi = r->num_tiles-1;
+	while (lo < hi) {
+		mid = (lo+hi+1)/2;
+		if (r->tile_base[mid] <= node)
+			lo = mid;
+		else
+			hi = mid-1;
+	}
+	return lo;
+}
+
+static void router_free(struct router* r)
+{
+	int i;
+
+	for (i = 0; i < r->num_nets; i++) {
+		free(r->nets[i].sinks);
+		free(r->nets[i].sw);
+		free(r->nets[i].tree);
+	}
+	free(r->nets);
+	free(r->order);
+	for (i = 0; i < r->num_nobits; i++)
+		free(r->nobits[i]);
+	free(r->nobits);
+	free(r->sw_nobits);
+	free(r->seen);
+	free(r->hist);
+	free(r->occ);
+	free(r->fixed);
+	free(r->pin);
+	free(r->wire);
+	free(r->tile_base);
+	memset(r, 0, sizeof(*r));
+}
+
+// Only the switches of routing tiles that are in model->sw_bitpos
+// can be written to a bitstream, see write_routing_sw(). Routing
+// tiles with the same switches array share one sw_nobits array.
+static int router_find_nobits(struct router* r)
+{
+	struct fpga_model* model = r->model;
+	struct fpga_tile* tile;
+	const uint32_t** nobits_sw;
+	void* new_ptr;
+	size_t num_tiles, max_switches;
+	int tile_i, y, x, i, rc;
+	str16_t from_i, to_i;
+	swidx_t sw;
+
+	nobits_sw = 0;
+	if (r->num_tiles <= 0) FAIL(EINVAL);
+	num_tiles = r->num_tiles;
+	r->sw_nobits = calloc(num_tiles, sizeof(*r->sw_nobits));
+	if (!r->sw_nobits) FAIL(ENOMEM);
+
+	// Outside of routing, iologic, logic and iob tiles, no switch
+	// can be written (see write_switches()), they all share one
+	// array of ones.
+	max_switches = 1;
+	for (tile_i = 0; tile_i < r->num_tiles; tile_i++) {
+		if (model->tiles[tile_i].num_switches > 0
+		    && (size_t) model->tiles[tile_i].num_switches > max_switches)
+			max_switches = model->tiles[tile_i].num_switches;
+	}
+	r->nobits = malloc(ROUTE_ALLOC_INCREMENT*sizeof(*r->nobits));
+	nobits_sw = malloc(ROUTE_ALLOC_INCREMENT*sizeof(*nobits_sw));
+	if (!r->nobits || !nobits_sw) FAIL(ENOMEM);
+	r->nobits[0] = malloc(max_switches);
+	if (!r->nobits[0]) FAIL(ENOMEM);
+	memset(r->nobits[0], 1, max_switches);
+	nobits_sw[0] = 0;
+	r->num_nobits = 1;
+
+	for (tile_i = 0; tile_i < r->num_tiles; tile_i++) {
+		tile = &model->tiles[tile_i];
+		y = tile_i / model->x_width;
+		x = tile_i % model->x_width;
+		if (!tile->num_switches)
+			continue;
+		if (!is_atx(X_ROUTING_COL, model, x)
+		    || y < TOP_IO_TILES
+		    || y >= model->y_height-BOT_IO_TILES
+		    || is_aty(Y_ROW_HORIZ_AXSYMM|Y_CHIP_HORIZ_REGS, model, y)) {
+			if (!is_atyx(YX_DEV_ILOGIC|YX_DEV_LOGIC|YX_DEV_IOB,
+					model, y, x))
+				r->sw_nobits[tile_i] = r->nobits[0];
+			continue;
+		}
+		for (i = 0; i < r->num_nobits; i++) {
+			if (nobits_sw[i] == tile->switches)
+				break;
+		}
+		if (i < r->num_nobits) {
+			r->sw_nobits[tile_i] = r->nobits[i];
+			continue;
+		}
+		if (!(r->num_nobits % ROUTE_ALLOC_INCREMENT)) {
+			new_ptr = realloc(r->nobits, (r->num_nobits
+				+ ROUTE_ALLOC_INCREMENT)*sizeof(*r->nobits));
+			if (!new_ptr) FAIL(ENOMEM);
+			r->nobits = new_ptr;
+			new_ptr = realloc(nobits_sw, (r->num_nobits
+				+ ROUTE_ALLOC_INCREMENT)*sizeof(*nobits_sw));
+			if (!new_ptr) FAIL(ENOMEM);
+			nobits_sw = new_ptr;
+		}
+		r->nobits[r->num_nobits] = malloc(tile->num_switches);
+		if (!r->nobits[r->num_nobits]) FAIL(ENOMEM);
+		memset(r->nobits[r->num_nobits], 1, tile->num_switches);
+		nobits_sw[r->num_nobits] = tile->switches;
+		for (i = 0; i < model->num_bitpos; i++) {
+			// extract_routing_switches() cannot read back
+			// bidirectional switches yet
+			if (model->sw_bitpos[i].bidir)
+				continue;
+			from_i = fpga_wire2str_i(model, model->sw_bitpos[i].from);
+			to_i = fpga_wire2str_i(model, model->sw_bitpos[i].to);
+			if (connpt_lookup(tile, from_i) == -1
+			    || connpt_lookup(tile, to_i) == -1)
+				continue;
+			sw = fpga_switch_lookup(model, y, x, from_i, to_i);
+			if (sw != NO_SWITCH)
+				r->nobits[r->num_nobits][sw] = 0;
+		}
+		r->sw_nobits[tile_i] = r->nobits[r->num_nobits++];
+	}
+	free(nobits_sw);
+	return 0;
+fail:
+	free(nobits_sw);
+	return rc;
+}
+
+static int router_init(struct router* r, struct fpga_model* model)
+{
+	struct fpga_tile* tile, *dest_tile;
+	struct fpga_device* dev;
+	uint16_t (*bbox)[4];
+	int tile_i, c, c2, i, j, a, b, span, rc;
+
+	memset(r, 0, sizeof(*r));
+	bbox = 0;
+	r->model = model;
+	r->num_tiles = model->x_width * model->y_height;
+	r->tile_base = malloc((r->num_tiles+1)*sizeof(*r->tile_base));
+	if (!r->tile_base) goto fail_mem;
+	for (tile_i = 0; tile_i < r->num_tiles; tile_i++) {
+		r->tile_base[tile_i] = r->num_nodes;
+		r->num_nodes += model->tiles[tile_i].num_conn_point_names;
+	}
+	r->tile_base[r->num_tiles] = r->num_nodes;
+
+	r->wire = malloc(r->num_nodes*sizeof(*r->wire));
+	r->pin = calloc(r->num_nodes, sizeof(*r->pin));
+	r->fixed = calloc(r->num_nodes, sizeof(*r->fixed));
+	r->occ = calloc(r->num_nodes, sizeof(*r->occ));
+	r->hist = calloc(r->num_nodes, sizeof(*r->hist));
+	r->seen = calloc(r->num_nodes, sizeof(*r->seen));
+	bbox = malloc(r->num_nodes*sizeof(*bbox));
+	if (!r->wire || !r->pin || !r->fixed || !r->occ || !r->hist
+	    || !r->seen || !bbox)
+		goto fail_mem;
+
+	// join the nodes of each wire
+	for (i = 0; i < r->num_nodes; i++)
+		r->wire[i] = i;
+	for (tile_i = 0; tile_i < r->num_tiles; tile_i++) {
+		tile = &model->tiles[tile_i];
+		for (c = 0; c < tile->num_conn_point_names; c++) {
+			for (j = CONNPT_DESTS_O(tile, c);
+			     j < CONNPT_DESTS_END(tile, c); j++) {
+				dest_tile = YX_TILE(model, CONN_DEST_Y(tile, j),
+					CONN_DEST_X(tile, j));
+				c2 = connpt_lookup(dest_tile,
+					CONN_DEST_STR(tile, j));
+				if (c2 == -1) { HERE(); continue; }
+				a = find_wire(r->wire, r->tile_base[tile_i] + c);
+				b = find_wire(r->wire, r->tile_base[
+					dest_tile - model->tiles] + c2);
+				if (a < b)
+					r->wire[b] = a;
+				else if (b < a)
+					r->wire[a] = b;
+			}
+		}
+	}
+
+	// flatten, and find the longest wire for the A* lower bound
+	for (i = 0; i < r->num_nodes; i++)
+		r->wire[i] = find_wire(r->wire, i);
+	for (tile_i = 0; tile_i < r->num_tiles; tile_i++) {
+		for (i = r->tile_base[tile_i]; i < r->tile_base[tile_i+1]; i++) {
+			a = r->wire[i];
+			if (a == i) {
+				bbox[a][0] = bbox[a][1] = tile_i / model->x_width;
+				bbox[a][2] = bbox[a][3] = tile_i % model->x_width;
+				continue;
+			}
+			if (tile_i / model->x_width < bbox[a][0])
+				bbox[a][0] = tile_i / model->x_width;
+			if (tile_i / model->x_width > bbox[a][1])
+				bbox[a][1] = tile_i / model->x_width;
+			if (tile_i % model->x_width < bbox[a][2])
+				bbox[a][2] = tile_i % model->x_width;
+			if (tile_i % model->x_width > bbox[a][3])
+				bbox[a][3] = tile_i % model->x_width;
+		}
+	}
+	r->max_span = 1;
+	for (i = 0; i < r->num_nodes; i++) {
+		if (r->wire[i] != i) continue;
+		span = bbox[i][1]-bbox[i][0] + bbox[i][3]-bbox[i][2];
+		if (span > r->max_span)
+			r->max_span = span;
+	}
+	free(bbox);
+	bbox = 0;
+
+	// Device pins can only be the start or end of a route, and
+	// wires of switches that are already in use are taken.
+	for (tile_i = 0; tile_i < r->num_tiles; tile_i++) {
+		tile = &model->tiles[tile_i];
+		for (i = 0; i < tile->num_devs; i++) {
+			dev = &tile->devs[i];
+			for (j = 0; j < dev->num_pinw_total; j++) {
+				c = connpt_lookup(tile, dev->pinw[j]);
+				if (c == -1) continue;
+				r->pin[r->wire[r->tile_base[tile_i] + c]] = 1;
+			}
+		}
+		for (i = fpga_switch_used_first(model, tile_i / model->x_width,
+			tile_i % model->x_width); i != NO_SWITCH;
+		     i = fpga_switch_used_next(model, tile_i / model->x_width,
+			tile_i % model->x_width, i)) {
+			r->fixed[r->wire[r->tile_base[tile_i]
+				+ SW_FROM_I(tile->switches[i])]] = 1;
+			r->fixed[r->wire[r->tile_base[tile_i]
+				+ SW_TO_I(tile->switches[i])]] = 1;
+		}
+	}
+	rc = router_find_nobits(r);
+	if (rc) {
+		router_free(r);
+		return rc;
+	}
+	return 0;
+fail_mem:
+	OUT_OF_MEM();
+	rc = ENOMEM;
+	free(bbox);
+	router_free(r);
+	return rc;
+}
+
+static void worker_free(struct route_worker* w)
+{
+	free(w->heap);
+	free(w->visit);
+	free(w->prev);
+	free(w->cost);
+	memset(w, 0, sizeof(*w));
+}
+
+static int worker_init(struct route_worker* w, struct router* r)
+{
+	memset(w, 0, sizeof(*w));
+	w->r = r;
+	w->cost = malloc(r->num_nodes*sizeof(*w->cost));
+	w->prev = malloc(r->num_nodes*sizeof(*w->prev));
+	w->visit = calloc(r->num_nodes, sizeof(*w->visit));
+	if (!w->cost || !w->prev || !w->visit) {
+		OUT_OF_MEM();
+		worker_free(w);
+		return ENOMEM;
+	}
+	return 0;
+}
+
+static int heap_push(struct route_worker* w, float f, float g, int node,
+	int tile_i)
+{
+	struct heap_el el;
+	void* new_ptr;
+	int i;
+
+	if (w->heap_len >= w->heap_size) {
+		new_ptr = realloc(w->heap, (w->heap_size+ROUTE_ALLOC_INCREMENT
+			*ROUTE_ALLOC_INCREMENT)*sizeof(*w->heap));
+		if (!new_ptr) {
+			OUT_OF_MEM();
+			return ENOMEM;
+		}
+		w->heap = new_ptr;
+		w->heap_size += ROUTE_ALLOC_INCREMENT*ROUTE_ALLOC_INCREMENT;
+	}
+	el.f = f;
+	el.g = g;
+	el.node = node;
+	el.tile_i = tile_i;
+	for (i = w->heap_len++; i && w->heap[(i-1)/2].f > f; i = (i-1)/2)
+		w->heap[i] = w->heap[(i-1)/2];
+	w->heap[i] = el;
+	return 0;
+}
+
+static struct heap_el heap_pop(struct route_worker* w)
+{
+	struct heap_el top, last;
+	int i, child;
+
+	top = w->heap[0];
+	last = w->heap[--w->heap_len];
+	for (i = 0; (child = 2*i+1) < w->heap_len; i = child) {
+		if (child+1 < w->heap_len
+		    && w->heap[child+1].f < w->heap[child].f)
+			child++;
+		if (last.f <= w->heap[child].f)
+			break;
+		w->heap[i] = w->heap[child];
+	}
+	w->heap[i] = last;
+	return top;
+}
+
+static float wire_cost(const struct router* r, int wire)
+{
+	return (1 + r->hist[wire]) * (1 + r->pres_fac * r->occ[wire]);
+}
+
+static int tile_dist(const struct router* r, int tile_a, int tile_b)
+{
+	return abs(tile_a / r->model->x_width - tile_b / r->model->x_width)
+		+ abs(tile_a % r->model->x_width - tile_b % r->model->x_width);
+}
+
+// Manhattan estimate of the cost from tile_i to the sink. Every wire
+// covers at most max_span and costs at least 1, so with astar_fac 1
+// this is off from a lower bound by at most one wire.
+static float route_h(const struct router* r, int tile_i, int sink_tile_i)
+{
+	int dist;
+
+	dist = tile_dist(r, tile_i, sink_tile_i);
+	return r->astar_fac * dist / r->max_span;
+}
+
+static int relax(struct route_worker* w, int node, int tile_i, float g,
+	int prev, int sink_tile_i)
+{
+	if (w->visit[node] == w->stamp && w->cost[node] <= g)
+		return 0;
+	w->visit[node] = w->stamp;
+	w->cost[node] = g;
+	w->prev[node] = prev;
+	return heap_push(w, g + route_h(w->r, tile_i, sink_tile_i), g,
+		node, tile_i);
+}
+
+static int net_add_tree(struct route_net* net, int node)
+{
+	void* new_ptr;
+
+	if (net->num_tree >= net->tree_size) {
+		new_ptr = realloc(net->tree, (net->tree_size
+			+ ROUTE_ALLOC_INCREMENT)*sizeof(*net->tree));
+		if (!new_ptr) {
+			OUT_OF_MEM();
+			return ENOMEM;
+		}
+		net->tree = new_ptr;
+		net->tree_size += ROUTE_ALLOC_INCREMENT;
+	}
+	net->tree[net->num_tree++] = node;
+	return 0;
+}
+
+static int net_add_sw(struct route_net* net, int tile_i, swidx_t swidx,
+	int wire)
+{
+	void* new_ptr;
+
+	if (net->num_sw >= net->sw_size) {
+		new_ptr = realloc(net->sw, (net->sw_size
+			+ ROUTE_ALLOC_INCREMENT)*sizeof(*net->sw));
+		if (!new_ptr) {
+			OUT_OF_MEM();
+			return ENOMEM;
+		}
+		net->sw = new_ptr;
+		net->sw_size += ROUTE_ALLOC_INCREMENT;
+	}
+	net->sw[net->num_sw].tile_i = tile_i;
+	net->sw[net->num_sw].swidx = swidx;
+	net->sw[net->num_sw].wire = wire;
+	net->num_sw++;
+	return 0;
+}
+
+// route_sink() searches from the tree of the net to sink, and adds
+// the path to the tree. Returns ENOTSUP if the sink cannot be reached.
+static int route_sink(struct route_worker* w, struct route_net* net, int sink)
+{
+	struct router* r = w->r;
+	struct fpga_model* model = r->model;
+	struct fpga_tile* tile, *dest_tile;
+	struct heap_el el;
+	int sink_tile_i, sink_wire, src_wire, dest_tile_i, node, c, c2, w2;
+	int i, j, p, rc;
+	swidx_t sw;
+
+	sink_tile_i = node_tile(r, sink);
+	sink_wire = r->wire[sink];
+	src_wire = r->wire[net->src_node];
+	w->stamp++;
+	w->heap_len = 0;
+	for (i = 0; i < net->num_tree; i++) {
+		rc = relax(w, net->tree[i], node_tile(r, net->tree[i]), 0,
+			-1, sink_tile_i);
+		if (rc) FAIL(rc);
+	}
+	node = -1;
+	while (w->heap_len) {
+		el = heap_pop(w);
+		if (el.g > w->cost[el.node])
+			continue; // stale
+		w->expanded++;
+		if (r->wire[el.node] == sink_wire) {
+			node = el.node;
+			break;
+		}
+		if (r->pin[r->wire[el.node]] && r->wire[el.node] != src_wire)
+			continue;
+		tile = &model->tiles[el.tile_i];
+		c = el.node - r->tile_base[el.tile_i];
+
+		// other connpts of the same wire
+		for (j = CONNPT_DESTS_O(tile, c); j < CONNPT_DESTS_END(tile, c); j++) {
+			dest_tile = YX_TILE(model, CONN_DEST_Y(tile, j),
+				CONN_DEST_X(tile, j));
+			c2 = connpt_lookup(dest_tile, CONN_DEST_STR(tile, j));
+			if (c2 == -1) continue;
+			dest_tile_i = dest_tile - model->tiles;
+			rc = relax(w, r->tile_base[dest_tile_i] + c2,
+				dest_tile_i, el.g, 2*el.node+1, sink_tile_i);
+			if (rc) FAIL(rc);
+		}
+
+		// switches into other wires
+		if (!tile->sw_adj) continue;
+		for (sw = SW_ADJ_FIRST(tile, c, SW_FROM); sw != NO_SWITCH;
+		     sw = SW_ADJ_NEXT(tile, sw, SW_FROM)) {
+			if (r->sw_nobits[el.tile_i]
+			    && r->sw_nobits[el.tile_i][sw])
+				continue;
+			c2 = SW_TO_I(tile->switches[sw]);
+			w2 = r->wire[r->tile_base[el.tile_i] + c2];
+			if (r->fixed[w2] || (r->pin[w2] && w2 != sink_wire))
+				continue;
+			rc = relax(w, r->tile_base[el.tile_i] + c2, el.tile_i,
+				el.g + wire_cost(r, w2), 2*el.node, sink_tile_i);
+			if (rc) FAIL(rc);
+		}
+	}
+	if (node == -1)
+		return ENOTSUP;
+
+	// walk back to the tree
+	for (; w->prev[node] != -1; node = p) {
+		p = w->prev[node]/2;
+		rc = net_add_tree(net, node);
+		if (rc) FAIL(rc);
+		if (w->prev[node] & 1)
+			continue;
+		i = node_tile(r, node);
+		tile = &model->tiles[i];
+		c = p - r->tile_base[i];
+		c2 = node - r->tile_base[i];
+		for (sw = SW_ADJ_FIRST(tile, c, SW_FROM); sw != NO_SWITCH;
+		     sw = SW_ADJ_NEXT(tile, sw, SW_FROM)) {
+			if (SW_TO_I(tile->switches[sw]) == c2
+			    && (!r->sw_nobits[i] || !r->sw_nobits[i][sw]))
+				break;
+		}
+		if (sw == NO_SWITCH) FAIL(EINVAL);
+		rc = net_add_sw(net, i, sw, r->wire[node]);
+		if (rc) FAIL(rc);
+	}
+	return 0;
+fail:
+	return rc;
+}
+
+// route_net() only reads the wire usage, the caller adds the
+// wires of the net to it.
+static int route_net(struct route_worker* w, struct route_net* net)
+{
+	int i, rc;
+
+	net->num_sw = 0;
+	net->num_tree = 0;
+	rc = net_add_tree(net, net->src_node);
+	if (rc) FAIL(rc);
+	for (i = 0; i < net->num_sinks; i++) {
+		rc = route_sink(w, net, net->sinks[i]);
+		if (rc) {
+			fprintf(stderr, "#E %s:%i net %i: no route to sink %i\n",
+				__FILE__, __LINE__, net->net_i, i);
+			FAIL(rc);
+		}
+	}
+	return 0;
+fail:
+	return rc;
+}
+
+// Sinks are routed nearest first, so that later sinks can branch
+// off the wires of earlier ones.
+static int route_net_setup(struct router* r, struct route_net* net)
+{
+	struct fpga_model* model = r->model;
+	struct fpga_net* net_p;
+	struct fpga_device* dev;
+	int i, j, c, node, src_tile_i, tmp;
+
+	net_p = fnet_get(model, net->net_i);
+	if (!net_p) return EINVAL;
+	net->src_node = -1;
+	net->sinks = malloc((net_p->len+1)*sizeof(*net->sinks));
+	if (!net->sinks) {
+		OUT_OF_MEM();
+		return ENOMEM;
+	}
+	for (i = 0; i < net_p->len; i++) {
+		// net already routed?
+		if (!(net_p->el[i].idx & NET_IDX_IS_PINW))
+			return EINVAL;
+		dev = FPGA_DEV(model, net_p->el[i].y, net_p->el[i].x,
+			net_p->el[i].dev_idx);
+		c = connpt_lookup(YX_TILE(model, net_p->el[i].y,
+			net_p->el[i].x), dev->pinw[net_p->el[i].idx
+			& NET_IDX_MASK]);
+		if (c == -1) return EINVAL;
+		node = r->tile_base[net_p->el[i].y*model->x_width
+			+ net_p->el[i].x] + c;
+		if ((net_p->el[i].idx & NET_IDX_MASK) < dev->num_pinw_in) {
+			net->sinks[net->num_sinks++] = node;
+			continue;
+		}
+		if (net->src_node != -1) return EINVAL; // at most 1 outpin
+		net->src_node = node;
+	}
+	for (i = 0; i < net_p->len; i++) {
+		if (!i || net_p->el[i].y < net->y_min)
+			net->y_min = net_p->el[i].y;
+		if (!i || net_p->el[i].y > net->y_max)
+			net->y_max = net_p->el[i].y;
+		if (!i || net_p->el[i].x < net->x_min)
+			net->x_min = net_p->el[i].x;
+		if (!i || net_p->el[i].x > net->x_max)
+			net->x_max = net_p->el[i].x;
+	}
+	// todo: vcc and gnd have no outpin
+	if (net->src_node == -1 || !net->num_sinks)
+		return EINVAL;
+
+	src_tile_i = node_tile(r, net->src_node);
+	for (i = 1; i < net->num_sinks; i++) {
+		for (j = i; j > 0; j--) {
+			if (tile_dist(r, node_tile(r, net->sinks[j]), src_tile_i)
+			    >= tile_dist(r, node_tile(r, net->sinks[j-1]),
+					src_tile_i))
+				break;
+			tmp = net->sinks[j];
+			net->sinks[j] = net->sinks[j-1];
+			net->sinks[j-1] = tmp;
+		}
+	}
+	return 0;
+}
+
+static double route_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+// Each net goes into the first batch in which its bounding box, grown
+// by ROUTE_BBOX_MARGIN, overlaps no other net. The tiles covered by
+// each batch are kept in one byte map per batch.
+static int route_batches(struct router* r)
+{
+	struct route_net* net;
+	uint8_t* map;
+	int num_batches, b, i, y, x, free_b, rc;
+	int y_min, y_max, x_min, x_max, *count;
+
+	map = calloc(ROUTE_MAX_BATCHES*r->num_tiles, sizeof(*map));
+	count = calloc(ROUTE_MAX_BATCHES+1, sizeof(*count));
+	r->order = malloc((r->num_nets+1)*sizeof(*r->order));
+	if (!map || !count || !r->order) {
+		OUT_OF_MEM();
+		FAIL(ENOMEM);
+	}
+	num_batches = 0;
+	for (i = 0; i < r->num_nets; i++) {
+		net = &r->nets[i];
+		y_min = net->y_min - ROUTE_BBOX_MARGIN;
+		if (y_min < 0) y_min = 0;
+		y_max = net->y_max + ROUTE_BBOX_MARGIN;
+		if (y_max >= r->model->y_height) y_max = r->model->y_height-1;
+		x_min = net->x_min - ROUTE_BBOX_MARGIN;
+		if (x_min < 0) x_min = 0;
+		x_max = net->x_max + ROUTE_BBOX_MARGIN;
+		if (x_max >= r->model->x_width) x_max = r->model->x_width-1;
+		for (b = 0; b < num_batches; b++) {
+			free_b = 1;
+			for (y = y_min; free_b && y <= y_max; y++) {
+				for (x = x_min; x <= x_max; x++) {
+					if (map[b*r->num_tiles + y*r->model->x_width + x]) {
+						free_b = 0;
+						break;
+					}
+				}
+			}
+			if (free_b) break;
+		}
+		if (b >= num_batches) {
+			if (num_batches < ROUTE_MAX_BATCHES)
+				num_batches++;
+			else // overlaps, but still deterministic
+				b = ROUTE_MAX_BATCHES-1;
+		}
+		for (y = y_min; y <= y_max; y++) {
+			for (x = x_min; x <= x_max; x++)
+				map[b*r->num_tiles + y*r->model->x_width + x] = 1;
+		}
+		net->batch = b;
+		count[b+1]++;
+	}
+	// order the nets by batch, and by index within a batch
+	for (b = 0; b < num_batches; b++)
+		count[b+1] += count[b];
+	for (i = 0; i < r->num_nets; i++)
+		r->order[count[r->nets[i].batch]++] = i;
+	rc = 0;
+fail:
+	free(count);
+	free(map);
+	return rc;
+}
+
+static void* route_thread(void* _w)
+{
+	struct route_worker* w = _w;
+	struct router* r = w->r;
+	int order_i, rc;
+
+	while (!__atomic_load_n(&r->rc, __ATOMIC_RELAXED)
+	       && (order_i = __sync_fetch_and_add(&r->next_net, 1))
+			< r->batch_end) {
+		rc = route_net(w, &r->nets[r->order[order_i]]);
+		if (rc) {
+			__sync_bool_compare_and_swap(&r->rc, 0, rc);
+			break;
+		}
+	}
+	return 0;
+}
+
+// route_batch() routes the nets of order[batch_start..batch_end]
+// with the usage as it was before the batch, then adds their wires
+// to the usage in net order.
+static int route_batch(struct router* r, struct route_worker* workers,
+	int num_workers)
+{
+	pthread_t threads[ROUTE_MAX_THREADS];
+	struct route_net* net;
+	int num_threads, i, j;
+
+	for (i = r->batch_start; i < r->batch_end; i++) {
+		net = &r->nets[r->order[i]];
+		for (j = 0; j < net->num_sw; j++)
+			r->occ[net->sw[j].wire]--;
+	}
+	r->next_net = r->batch_start;
+	num_threads = r->batch_end - r->batch_start;
+	if (num_threads > num_workers)
+		num_threads = num_workers;
+	i = 0;
+	if (num_threads > 1) {
+		for (; i < num_threads; i++) {
+			if (pthread_create(&threads[i], 0, route_thread,
+					&workers[i]))
+				break;
+		}
+	}
+	if (!i) // no threads at all, run in this thread
+		route_thread(&workers[0]);
+	num_threads = i;
+	for (i = 0; i < num_threads; i++)
+		pthread_join(threads[i], 0);
+	if (r->rc) return r->rc;
+
+	for (i = r->batch_start; i < r->batch_end; i++) {
+		net = &r->nets[r->order[i]];
+		for (j = 0; j < net->num_sw; j++)
+			r->occ[net->sw[j].wire]++;
+	}
+	return 0;
+}
+
+int froute_nets(struct froute* p)
+{
+	struct router r;
+	struct route_worker workers[ROUTE_MAX_THREADS];
+	struct froute_stats* stats;
+	double start;
+	int num_workers, max_iter, i, j, w, rc;
+
+	p->num_iter = 0;
+	memset(workers, 0, sizeof(workers));
+	rc = router_init(&r, p->model);
+	if (rc) return rc;
+	r.astar_fac = p->astar_fac ? p->astar_fac : 1.0;
+	r.nets = calloc(p->num_nets, sizeof(*r.nets));
+	if (!r.nets) {
+		OUT_OF_MEM();
+		FAIL(ENOMEM);
+	}
+	r.num_nets = p->num_nets;
+	for (i = 0; i < p->num_nets; i++) {
+		r.nets[i].net_i = p->nets[i];
+		rc = route_net_setup(&r, &r.nets[i]);
+		if (rc) FAIL(rc);
+	}
+	rc = route_batches(&r);
+	if (rc) FAIL(rc);
+
+	// FPGATOOLS_THREADS sets the number of threads, as for
+	// stage_commit(). There is no use for more threads than nets.
+	num_workers = model_threads();
+	if (num_workers > ROUTE_MAX_THREADS)
+		num_workers = ROUTE_MAX_THREADS;
+	if (num_workers > r.num_nets)
+		num_workers = r.num_nets ? r.num_nets : 1;
+	for (i = 0; i < num_workers; i++) {
+		rc = worker_init(&workers[i], &r);
+		if (rc) FAIL(rc);
+	}
+
+	max_iter = p->max_iter ? p->max_iter : FROUTE_MAX_ITER;
+	if (max_iter > FROUTE_MAX_ITER) FAIL(EINVAL);
+	// PathFinder: the first iteration ignores congestion, after
+	// that the present-congestion factor grows and the history of
+	// overused wires accumulates until no wire is shared.
+	r.pres_fac = 0;
+	for (;;) {
+		start = route_seconds();
+		for (i = 0; i < num_workers; i++)
+			workers[i].expanded = 0;
+		for (r.batch_start = 0; r.batch_start < r.num_nets;
+		     r.batch_start = r.batch_end) {
+			for (r.batch_end = r.batch_start+1;
+			     r.batch_end < r.num_nets
+			     && r.nets[r.order[r.batch_end]].batch
+				== r.nets[r.order[r.batch_start]].batch;
+			     r.batch_end++);
+			rc = route_batch(&r, workers, num_workers);
+			if (rc) FAIL(rc);
+		}
+
+		stats = &p->stats[p->num_iter++];
+		memset(stats, 0, sizeof(*stats));
+		for (i = 0; i < r.num_nets; i++) {
+			stats->wirelength += r.nets[i].num_sw;
+			for (j = 0; j < r.nets[i].num_sw; j++) {
+				w = r.nets[i].sw[j].wire;
+				if (r.occ[w] <= 1 || r.seen[w])
+					continue;
+				r.seen[w] = 1;
+				r.hist[w] += r.occ[w]-1;
+				stats->overused++;
+			}
+		}
+		for (i = 0; i < r.num_nets; i++) {
+			for (j = 0; j < r.nets[i].num_sw; j++)
+				r.seen[r.nets[i].sw[j].wire] = 0;
+		}
+		for (i = 0; i < num_workers; i++)
+			stats->expanded += workers[i].expanded;
+		stats->seconds = route_seconds() - start;
+		if (!stats->overused)
+			break;
+		if (p->num_iter >= max_iter) {
+			fprintf(stderr, "#E %s:%i %i wires still overused "
+				"after %i iterations\n", __FILE__, __LINE__,
+				stats->overused, p->num_iter);
+			FAIL(ENOTSUP);
+		}
+		r.pres_fac = r.pres_fac ? r.pres_fac*1.5 : 0.5;
+	}
+
+	for (i = 0; i < r.num_nets; i++) {
+		for (j = 0; j < r.nets[i].num_sw; j++) {
+			rc = fnet_add_sw(p->model, r.nets[i].net_i,
+				r.nets[i].sw[j].tile_i / p->model->x_width,
+				r.nets[i].sw[j].tile_i % p->model->x_width,
+				&r.nets[i].sw[j].swidx, 1);
+			if (rc) FAIL(rc);
+		}
+	}
+	for (i = 0; i < num_workers; i++)
+		worker_free(&workers[i]);
+	router_free(&r);
+	return 0;
+fail:
+	for (i = 0; i < ROUTE_MAX_THREADS; i++)
+		worker_free(&workers[i]);
+	router_free(&r);
+	return rc;
+}
@@ -0,0 +1,164 @@
+//
+// Author: Wolfgang Spraul
+//
+// This is free and unencumbered software released into the public domain.
+// For details see the UNLICENSE file at the root of the source tree.
+//
+
+#include <pthread.h>
+#include <time.h>
+#include "model.h"
+
+//
+// Interns the full xc6slx9 name set into a fresh string array from
+// 1..N threads at the same time. Every thread adds all names, each
+// starting at a different offset, so most adds race with another
+// thread adding the same string.
+//
+
+struct bench
+{
+	struct hashed_strarray array;
+	const char** names;
+	int num_names;
+	int num_threads;
+	int rc;
+};
+
+struct bench_thread
+{
+	struct bench* b;
+	int thread_i;
+	pthread_t thread;
+};
+
+static void* add_thread(void* arg)
+{
+	struct bench_thread* t = arg;
+	struct bench* b = t->b;
+	int i, name_i, idx;
+
+	for (i = 0; i < b->num_names; i++) {
+		name_i = (i + t->thread_i*b->num_names/b->num_threads)
+			% b->num_names;
+		if (strarray_add(&b->array, b->names[name_i], &idx))
+			__sync_bool_compare_and_swap(&b->rc, 0, EINVAL);
+	}
+	return 0;
+}
+
+static void* find_thread(void* arg)
+{
+	struct bench_thread* t = arg;
+	struct bench* b = t->b;
+	int i, name_i;
+
+	for (i = 0; i < b->num_names; i++) {
+		name_i = (i + t->thread_i*b->num_names/b->num_threads)
+			% b->num_names;
+		if (strarray_find(&b->array, b->names[name_i])
+		    == STRIDX_NO_ENTRY)
+			__sync_bool_compare_and_swap(&b->rc, 0, EINVAL);
+	}
+	return 0;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static int run_threads(struct bench* b, void* (*fn)(void*), double* secs)
+{
+	struct bench_thread threads[b->num_threads];
+	double start;
+	int i, rc;
+
+	start = now();
+	for (i = 0; i < b->num_threads; i++) {
+		threads[i].b = b;
+		threads[i].thread_i = i;
+		if (pthread_create(&threads[i].thread, 0, fn, &threads[i]))
+			FAIL(errno);
+	}
+	for (i = 0; i < b->num_threads; i++)
+		pthread_join(threads[i].thread, 0);
+	*secs = now() - start;
+	return b->rc;
+fail:
+	for (i--; i >= 0; i--)
+		pthread_join(threads[i].thread, 0);
+	return rc;
+}
+
+// each name must have exactly one index that maps back to it, and
+// the indices freed by lost races must be empty again
+static int check_array(struct bench* b)
+{
+	const char* str;
+	int i, idx;
+
+	if (strarray_check(&b->array)
+	    || strarray_used_slots(&b->array) != b->num_names)
+		return EINVAL;
+	for (i = 0; i < b->num_names; i++) {
+		idx = strarray_find(&b->array, b->names[i]);
+		if (idx == STRIDX_NO_ENTRY
+		    || !(str = strarray_lookup(&b->array, idx))
+		    || strcmp(str, b->names[i]))
+			return EINVAL;
+	}
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	struct fpga_model model;
+	struct bench b;
+	double add_secs, find_secs;
+	const char* str;
+	int max_threads, i, rc;
+
+	max_threads = argc > 1 ? atoi(argv[1]) : 8;
+	if (max_threads < 1) {
+		fprintf(stderr, "\nUsage: %s [max_threads]\n\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	if ((rc = fpga_build_model(&model, XC6SLX9_ROWS, XC6SLX9_COLUMNS,
+			XC6SLX9_LEFT_WIRING, XC6SLX9_RIGHT_WIRING)))
+		FAIL(rc);
+
+	memset(&b, 0, sizeof(b));
+	b.names = malloc(model.str.highest_index * sizeof(*b.names));
+	if (!b.names) FAIL(ENOMEM);
+	for (i = 1; i <= model.str.highest_index; i++) {
+		if ((str = strarray_lookup(&model.str, i)))
+			b.names[b.num_names++] = str;
+	}
+	printf("%i names\n", b.num_names);
+	printf("threads  add ns/name  find ns/name\n");
+
+	for (b.num_threads = 1; b.num_threads <= max_threads;
+	     b.num_threads++) {
+		if (strarray_init(&b.array, STRIDX_MAX)) FAIL(ENOMEM);
+		rc = run_threads(&b, add_thread, &add_secs);
+		if (rc) FAIL(rc);
+		rc = check_array(&b);
+		if (rc) FAIL(rc);
+		rc = run_threads(&b, find_thread, &find_secs);
+		if (rc) FAIL(rc);
+		strarray_free(&b.array);
+		// wall time over the names each thread handles
+		printf("%7i  %11.1f  %12.1f\n", b.num_threads,
+			add_secs*1e9/b.num_names,
+			find_secs*1e9/b.num_names);
+	}
+	free(b.names);
+	fpga_free_model(&model);
+	return EXIT_SUCCESS;
+fail:
+	return rc;
+}
@@ -0,0 +1,70 @@
+net 1 out y68 x13 LOGIC 1 pin A
+net 1 in y60 x13 LOGIC 1 pin A1
+net 1 sw y60 x13 CLEXM_LOGICIN_B0 -> X_A1
+net 1 sw y60 x12 LOGICIN_B61 -> LOGICIN_B0
+net 1 sw y60 x12 EL1E3 -> LOGICIN_B61
+net 1 sw y60 x09 NN4E0 -> EL1B3
+net 1 sw y65 x09 NN2E0 -> NN4B0
+net 1 sw y67 x09 WL1E_N3 -> NN2B0
+net 1 sw y68 x12 LOGICOUT0 -> WL1B3
+net 1 sw y68 x13 X_A -> CLEXM_LOGICOUT0
+net 2 out y68 x13 LOGIC 1 pin B
+net 2 in y60 x13 LOGIC 1 pin B1
+net 2 sw y60 x13 CLEXM_LOGICIN_B7 -> X_B1
+net 2 sw y60 x12 NN2E0 -> LOGICIN_B7
+net 2 sw y63 x12 NL1E0 -> NN2B0
+net 2 sw y64 x12 NN4E1 -> NL1B0
+net 2 sw y68 x12 LOGICOUT3 -> NN4B1
+net 2 sw y68 x13 X_B -> CLEXM_LOGICOUT3
+net 3 out y68 x13 LOGIC 1 pin C
+net 3 in y60 x13 LOGIC 1 pin C1
+net 3 sw y60 x13 CLEXM_LOGICIN_B14 -> X_C1
+net 3 sw y60 x12 NL1E_S0 -> LOGICIN_B14
+net 3 sw y60 x12 NL1E1 -> NL1B0
+net 3 sw y61 x12 NN4E2 -> NL1B1
+net 3 sw y66 x12 NN2E2 -> NN4B2
+net 3 sw y68 x12 LOGICOUT6 -> NN2B2
+net 3 sw y68 x13 X_C -> CLEXM_LOGICOUT6
+net 4 out y68 x13 LOGIC 1 pin D
+net 4 in y60 x13 LOGIC 1 pin D1
+net 4 sw y60 x13 CLEXM_LOGICIN_B22 -> X_D1
+net 4 sw y60 x12 NN2E2 -> LOGICIN_B22
+net 4 sw y63 x12 NL1E2 -> NN2B2
+net 4 sw y64 x12 NN4E3 -> NL1B2
+net 4 sw y68 x12 LOGICOUT9 -> NN4B3
+net 4 sw y68 x13 X_D -> CLEXM_LOGICOUT9
+net 5 out y68 x13 LOGIC 1 pin AMUX
+net 5 in y60 x13 LOGIC 1 pin A2
+net 5 sw y60 x13 CLEXM_LOGICIN_B1 -> X_A2
+net 5 sw y60 x12 NR1E2 -> LOGICIN_B1
+net 5 sw y61 x12 NN2E2 -> NR1B2
+net 5 sw y64 x12 NN4E2 -> NN2B2
+net 5 sw y68 x12 LOGICOUT1 -> NN4B2
+net 5 sw y68 x13 X_AMUX -> CLEXM_LOGICOUT1
+net 6 out y68 x13 LOGIC 1 pin BMUX
+net 6 in y60 x13 LOGIC 1 pin B2
+net 6 sw y60 x13 CLEXM_LOGICIN_B8 -> X_B2
+net 6 sw y60 x12 NN2E3 -> LOGICIN_B8
+net 6 sw y63 x12 NN2E3 -> NN2B3
+net 6 sw y65 x12 NN2E3 -> NN2B3
+net 6 sw y67 x12 NR1E3 -> NN2B3
+net 6 sw y68 x12 LOGICOUT4 -> NR1B3
+net 6 sw y68 x13 X_BMUX -> CLEXM_LOGICOUT4
+net 7 out y68 x13 LOGIC 1 pin CMUX
+net 7 in y60 x13 LOGIC 1 pin C2
+net 7 sw y60 x13 CLEXM_LOGICIN_B15 -> X_C2
+net 7 sw y60 x12 NR1E0 -> LOGICIN_B15
+net 7 sw y61 x12 NR1E0 -> NR1B0
+net 7 sw y63 x12 NR1E0 -> NR1B0
+net 7 sw y64 x12 NN4E0 -> NR1B0
+net 7 sw y68 x12 LOGICOUT7 -> NN4B0
+net 7 sw y68 x13 X_CMUX -> CLEXM_LOGICOUT7
+net 8 out y68 x13 LOGIC 1 pin DMUX
+net 8 in y60 x13 LOGIC 1 pin D2
+net 8 sw y60 x13 CLEXM_LOGICIN_B23 -> X_D2
+net 8 sw y60 x12 NN2E1 -> LOGICIN_B23
+net 8 sw y63 x12 NN2E1 -> NN2B1
+net 8 sw y65 x12 NN2E1 -> NN2B1
+net 8 sw y67 x12 NR1E1 -> NN2B1
+net 8 sw y68 x12 LOGICOUT10 -> NR1B1
+net 8 sw y68 x13 X_DMUX -> CLEXM_LOGICOUT10
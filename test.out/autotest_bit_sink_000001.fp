@@ -0,0 +1 @@
+dev y68 x13 LOGIC 1 D6_lut A3*A5
@@ -0,0 +1,15 @@
+dev y72 x12 IOB 1 istd LVCMOS33
+dev y72 x12 IOB 1 bypass_mux I
+dev y72 x12 IOB 1 imux I
+dev y68 x13 LOGIC 1 D6_lut A3*A5
+net 1 out y72 x12 IOB 1 pin I
+net 1 in y68 x13 LOGIC 1 pin D3
+net 1 sw y72 x12 BIOB_IBUF1_PINW -> BIOB_IBUF1
+net 1 sw y69 x13 BIOI_INNER_IBUF1 -> D_ILOGIC_IDATAIN_IODELAY_S
+net 1 sw y69 x13 D_ILOGIC_IDATAIN_IODELAY_S -> D_ILOGIC_SITE_S
+net 1 sw y69 x13 D_ILOGIC_SITE_S -> FABRICOUT_ILOGIC_SITE_S
+net 1 sw y69 x13 FABRICOUT_ILOGIC_SITE_S -> IOI_INTER_LOGICOUT7
+net 1 sw y69 x13 IOI_INTER_LOGICOUT7 -> IOI_LOGICOUT7
+net 1 sw y68 x13 CLEXM_LOGICIN_B24 -> X_D3
+net 1 sw y69 x12 LOGICOUT7 -> NR1B0
+net 1 sw y68 x12 NR1E0 -> LOGICIN_B24